@@ -0,0 +1,87 @@
+//
+//  AsyncSaver.cpp
+//  martian-terrain
+//
+
+#include "AsyncSaver.hpp"
+#include "Tmnper.hpp"
+
+#include <cstdio>
+
+using namespace std;
+
+Tmnper::AsyncSaver::AsyncSaver() : bStop(false) { worker = thread(&AsyncSaver::run, this); }
+
+Tmnper::AsyncSaver::~AsyncSaver() {
+  {
+    lock_guard<mutex> lock(mtx);
+    bStop = true;
+  }
+  cv.notify_one();
+  if (worker.joinable()) worker.join();
+}
+
+void Tmnper::AsyncSaver::enqueue(function<SaveResult()> job) {
+  {
+    lock_guard<mutex> lock(mtx);
+    jobs.push_back(move(job));
+  }
+  cv.notify_one();
+}
+
+void Tmnper::AsyncSaver::savePixels(ofPixels&& pixels, string fileName) {
+  // The lambda owns the pixels from here on -- the caller's buffer is left empty.
+  //
+  auto owned = make_shared<ofPixels>(move(pixels));
+  enqueue([owned, fileName]() {
+    auto path = ofToDataPath(fileName);
+    auto tmp = partFileName(path);
+    bool ok = ofSaveImage(*owned, tmp) && commitFile(tmp, path);
+    if (!ok) remove(tmp.c_str());
+    return SaveResult{fileName, ok};
+  });
+}
+
+void Tmnper::AsyncSaver::saveText(string contents, string fileName, string extn) {
+  enqueue([contents, fileName, extn]() { return SaveResult{fileName, saveIntoTmpr(fileName, contents, extn)}; });
+}
+
+vector<Tmnper::SaveResult> Tmnper::AsyncSaver::poll() {
+  vector<SaveResult> results;
+  lock_guard<mutex> lock(mtx);
+  results.swap(finished);
+  return results;
+}
+
+void Tmnper::AsyncSaver::run() {
+  while (true) {
+    function<SaveResult()> job;
+    {
+      unique_lock<mutex> lock(mtx);
+      cv.wait(lock, [this] { return bStop || !jobs.empty(); });
+      if (jobs.empty()) return;  // stopping and nothing left to save
+      job = move(jobs.front());
+      jobs.pop_front();
+    }
+
+    SaveResult result = job();
+
+    lock_guard<mutex> lock(mtx);
+    finished.push_back(result);
+  }
+}
+
+bool Tmnper::commitFile(const string& tmpName, const string& fileName) {
+  // rename(2) replaces the destination atomically on POSIX file systems.
+  //
+  if (rename(tmpName.c_str(), fileName.c_str()) == 0) return true;
+  remove(tmpName.c_str());
+  return false;
+}
+
+string Tmnper::partFileName(const string& fileName) {
+  auto dot = fileName.find_last_of('.');
+  auto slash = fileName.find_last_of("/\\");
+  if (dot == string::npos || (slash != string::npos && dot < slash)) return fileName + ".part";
+  return fileName.substr(0, dot) + ".part" + fileName.substr(dot);
+}
@@ -0,0 +1,91 @@
+//
+//  AsyncSaver.hpp
+//  martian-terrain
+//
+
+#pragma once /* ---- include this header file only once ---- */
+
+#ifndef AsyncSaver_hpp
+#define AsyncSaver_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ofMain.h"
+
+namespace Tmnper {
+
+using namespace std;
+
+/**
+ * The outcome of a save job, handed back to the UI thread.
+ */
+struct SaveResult {
+  string fileName;
+  bool success;
+};
+
+/**
+ * Background I/O worker for saves. The render thread only captures the
+ * data (pixels or serialized text) and hands it over; encoding and writing
+ * happens on the worker thread. Every file is first written next to its
+ * destination and then renamed into place, so readers never see a partially
+ * written file.
+ */
+class AsyncSaver {
+ public:
+  AsyncSaver();
+
+  // Drains the pending jobs and joins the worker.
+  //
+  ~AsyncSaver();
+
+  /**
+   * Queues the pixels to be PNG encoded into fileName. Takes ownership of
+   * the pixels.
+   */
+  void savePixels(ofPixels&& pixels, string fileName);
+
+  /**
+   * Queues the contents to be written into fileName, which must end with
+   * the given extension.
+   */
+  void saveText(string contents, string fileName, string extn);
+
+  /**
+   * Returns the results of the jobs finished since the last call.
+   * Meant to be called from the UI thread, once per frame.
+   */
+  vector<SaveResult> poll();
+
+ private:
+  void run();
+  void enqueue(function<SaveResult()> job);
+
+  thread worker;
+  mutex mtx;
+  condition_variable cv;
+  deque<function<SaveResult()>> jobs;
+  vector<SaveResult> finished;
+  bool bStop;
+};
+
+/**
+ * Moves the file at tmpName over fileName.
+ */
+bool commitFile(const string& tmpName, const string& fileName);
+
+/**
+ * Name of the scratch file written before being renamed to fileName.
+ * The extension is preserved since the image encoder picks the format
+ * from it.
+ */
+string partFileName(const string& fileName);
+}  // namespace Tmnper
+
+#endif /* AsyncSaver_hpp */
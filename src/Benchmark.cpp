@@ -0,0 +1,559 @@
+//
+//  Benchmark.cpp
+//  martian-terrain
+//
+
+#include "Benchmark.h"
+#include "Log.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include "ambientocclusion.h"
+#include "bounds.h"
+#include "bvh.h"
+#include "compactocttree.h"
+#include "fleet.h"
+#include "linearoctree.h"
+#include "meshorder.h"
+#include "octtree.h"
+#include "snapshot.h"
+#include "terrainlod.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <random>
+
+using namespace std;
+using namespace std::chrono;
+
+// An allocation count for the report, when the index keeps one.
+//
+static string allocationCount(long count) { return count < 0 ? "uncounted" : ofToString(count); }
+
+vector<Ray> Benchmark::terrainRays(const ofMesh &mesh, int n, unsigned seed) {
+  vector<Ray> rays;
+  if (mesh.getNumVertices() == 0) return rays;
+
+  Box bounds = meshBounds(mesh);
+  ofVec3f min = toOf(bounds.min()), max = toOf(bounds.max());
+
+  mt19937 rng(seed);
+  uniform_real_distribution<float> x(min.x, max.x), z(min.z, max.z), tilt(-0.3f, 0.3f);
+
+  rays.reserve(n);
+  for (int i = 0; i < n; i++) {
+    Vector3 dir(tilt(rng), -1, tilt(rng));
+    dir.normalize();
+    rays.push_back(Ray(Vector3(x(rng), max.y + 1, z(rng)), dir));
+  }
+  return rays;
+}
+
+Benchmark::IndexReport Benchmark::measureIndex(shared_ptr<SpatialIndex> index, const ofMesh &mesh, int maxLevel,
+                                               const vector<Ray> &rays) {
+  IndexReport report;
+
+  long allocs = index->heapAllocations();
+  auto start = steady_clock::now();
+  index->generate(mesh, maxLevel);
+  report.buildMs = duration<double, milli>(steady_clock::now() - start).count();
+  report.buildAllocs = allocs < 0 ? -1 : index->heapAllocations() - allocs;
+
+  // A rebuild over the same mesh may reuse what the first build allocated.
+  //
+  allocs = index->heapAllocations();
+  start = steady_clock::now();
+  index->generate(mesh, maxLevel);
+  report.rebuildMs = duration<double, milli>(steady_clock::now() - start).count();
+  report.rebuildAllocs = allocs < 0 ? -1 : index->heapAllocations() - allocs;
+
+  report.name = index->name();
+  report.bytes = index->memoryUsage();
+  report.rays = 0;
+  report.hits = 0;
+
+  // Check the clock every 256 rays only, to keep it out of the numbers.
+  //
+  start = steady_clock::now();
+  for (auto &ray : rays) {
+    if (index->search(ray, 0, 10000)->isPresent()) report.hits++;
+    if ((++report.rays & 255) == 0 && duration<double>(steady_clock::now() - start).count() > RAY_BUDGET_SECONDS) {
+      break;
+    }
+  }
+  double seconds = duration<double>(steady_clock::now() - start).count();
+  report.raysPerSec = seconds > 0 ? report.rays / seconds : 0;
+
+  start = steady_clock::now();
+  index.reset();
+  report.teardownMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  return report;
+}
+
+void Benchmark::logReport(const IndexReport &report) {
+  LOG_INFO("[bench] " << report.name << ": build " << report.buildMs << " ms, " << report.bytes / 1024 << " KiB, "
+                      << report.raysPerSec / 1e6 << " Mrays/s, " << report.hits << "/" << report.rays << " hits");
+  LOG_INFO("[bench] " << report.name << ": " << allocationCount(report.buildAllocs) << " allocs, rebuild "
+                      << report.rebuildMs << " ms / " << allocationCount(report.rebuildAllocs) << " allocs, teardown "
+                      << report.teardownMs << " ms");
+}
+
+void Benchmark::runIndexBenchmark(const ofMesh &mesh, int maxLevel) {
+  LOG_INFO("[bench] " << mesh.getNumVertices() << " vertices, " << mesh.getNumIndices() / 3 << " triangles, "
+                      << NUM_RAYS << " rays");
+
+  auto rays = terrainRays(mesh, NUM_RAYS);
+
+  logReport(measureIndex(make_shared<OctTree>(), mesh, maxLevel, rays));
+  logReport(measureIndex(make_shared<BVH>(), mesh, maxLevel, rays));
+  logReport(measureIndex(make_shared<LinearOctree>(), mesh, maxLevel, rays));
+  logReport(measureIndex(make_shared<CompactOctTree>(), mesh, maxLevel, rays));
+}
+
+void Benchmark::runOctreeUpdateBenchmark(const ofMesh &mesh, int maxLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  OctTree tree;
+  tree.generate(mesh, maxLevel);
+
+  auto start = steady_clock::now();
+  tree.generate(mesh, maxLevel);
+  double rebuildMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  Box bounds = meshBounds(mesh);
+  ofVec3f lo = toOf(bounds.min()), hi = toOf(bounds.max()), size = hi - lo;
+
+  mt19937 rng(235);
+  uniform_real_distribution<float> x(lo.x, hi.x), y(lo.y, hi.y), z(lo.z, hi.z), step(-0.01f, 0.01f);
+
+  // Objects dropped anywhere in the terrain's box
+  //
+  vector<int> objects;
+  start = steady_clock::now();
+  for (int i = 0; i < NUM_UPDATES; i++) objects.push_back(tree.insert(ofVec3f(x(rng), y(rng), z(rng))));
+  double insertUs = duration<double, micro>(steady_clock::now() - start).count() / NUM_UPDATES;
+
+  // ... moving a little, like rovers do between frames
+  //
+  start = steady_clock::now();
+  for (int index : objects) {
+    tree.update(index, tree.mesh.getVertex(index) + size * ofVec3f(step(rng), step(rng), step(rng)));
+  }
+  double updateUs = duration<double, micro>(steady_clock::now() - start).count() / NUM_UPDATES;
+
+  start = steady_clock::now();
+  for (int index : objects) tree.remove(index);
+  double removeUs = duration<double, micro>(steady_clock::now() - start).count() / NUM_UPDATES;
+
+  // A crater a twentieth of the terrain wide
+  //
+  start = steady_clock::now();
+  int moved = tree.deform((lo + hi) / 2, std::max(size.x, size.z) / 40, -size.y / 10);
+  double deformMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  LOG_INFO("[bench] octree updates: rebuild " << rebuildMs << " ms; insert " << insertUs << " us, move " << updateUs
+                                              << " us, remove " << removeUs << " us per point");
+  LOG_INFO("[bench] octree updates: deform " << moved << " vertices in " << deformMs << " ms, "
+                                             << (rebuildMs / std::max(updateUs / 1000, 1e-6)) << " moves per rebuild");
+}
+
+void Benchmark::runLazyOctreeBenchmark(const ofMesh &mesh, int maxLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  OctTree eager;
+  auto start = steady_clock::now();
+  eager.generate(mesh, maxLevel);
+  double eagerMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  OctTree lazy;
+  lazy.bLazy = true;
+  start = steady_clock::now();
+  lazy.generate(mesh, maxLevel);
+  double lazyMs = duration<double, milli>(steady_clock::now() - start).count();
+  size_t startBytes = lazy.memoryUsage();
+
+  // Picks around one spot, a tenth of the terrain across, as when the
+  // user works on one part of it
+  //
+  Box bounds = meshBounds(mesh);
+  ofVec3f lo = toOf(bounds.min()), hi = toOf(bounds.max()), size = hi - lo;
+  mt19937 rng(235);
+  uniform_real_distribution<float> u(0.45f, 0.55f);
+  vector<Ray> picks;
+  for (int i = 0; i < NUM_LAZY_PICKS; i++) {
+    ofVec3f p(lo.x + size.x * u(rng), hi.y + 1, lo.z + size.z * u(rng));
+    picks.push_back(Ray(toVector3(p), Vector3(0, -1, 0)));
+  }
+
+  double eagerUs = 0, lazyUs = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    OctTree &tree = pass == 0 ? eager : lazy;
+    start = steady_clock::now();
+    for (auto &ray : picks) tree.search(ray, -1000, 1000);
+    (pass == 0 ? eagerUs : lazyUs) = duration<double, micro>(steady_clock::now() - start).count() / picks.size();
+  }
+  size_t pickedBytes = lazy.memoryUsage();
+
+  // A strip along the X axis, like a path across the terrain
+  //
+  vector<ofVec3f> strip;
+  for (int i = 0; i <= 100; i++) strip.push_back(lo + ofVec3f(size.x * i / 100, 0, size.z / 3));
+  start = steady_clock::now();
+  int split = lazy.expandAround(strip, size.x / 50);
+  double stripMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  LOG_INFO("[bench] lazy octree: generate " << lazyMs << " ms / " << startBytes / 1024 << " KiB, eager " << eagerMs
+                                            << " ms / " << eager.memoryUsage() / 1024 << " KiB");
+  LOG_INFO("[bench] lazy octree: " << picks.size() << " picks in one spot " << lazyUs << " us each (eager "
+                                   << eagerUs << " us), " << pickedBytes / 1024 << " KiB; strip of " << split
+                                   << " nodes in " << stripMs << " ms, " << lazy.memoryUsage() / 1024 << " KiB");
+}
+
+void Benchmark::runDragPickBenchmark(const ofMesh &mesh, int maxLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  OctTree tree;
+  tree.generate(mesh, maxLevel);
+
+  // A camera above one corner of the terrain, the cursor sweeping across
+  // the terrain a little at a time
+  //
+  Box bounds = meshBounds(mesh);
+  ofVec3f lo = toOf(bounds.min()), hi = toOf(bounds.max()), size = hi - lo;
+  ofVec3f eye = lo + ofVec3f(0, size.y + std::max(size.x, size.z) / 2, 0);
+  vector<Ray> rays;
+  for (int i = 0; i < NUM_DRAG_PICKS; i++) {
+    float s = 0.2f + 0.6f * i / NUM_DRAG_PICKS;
+    ofVec3f target = lo + ofVec3f(size.x * s, 0, size.z * (0.3f + 0.2f * sin(s * 10)));
+    rays.push_back(Ray(toVector3(eye), toVector3((target - eye).getNormalized())));
+  }
+
+  auto start = steady_clock::now();
+  for (auto &ray : rays) tree.search(ray, -1000, 1000);
+  double fullUs = duration<double, micro>(steady_clock::now() - start).count() / rays.size();
+
+  start = steady_clock::now();
+  for (auto &ray : rays) tree.pick(ray, -1000, 1000);
+  double pickUs = duration<double, micro>(steady_clock::now() - start).count() / rays.size();
+
+  LOG_INFO("[bench] drag picks: search " << fullUs << " us, pick " << pickUs << " us per pick");
+}
+
+void Benchmark::runOcclusionBakeBenchmark(const ofMesh &mesh, int maxLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  BVH bvh;
+  bvh.generate(mesh, maxLevel);
+
+  AmbientOcclusion occlusion;
+  double oneThreadRate = 0;
+  unsigned most = ThreadPool::size();
+  for (unsigned threads = 1;; threads = std::min(threads * 2, most)) {
+    ThreadPool::setConcurrency(threads);
+    occlusion.bake(mesh, bvh, NUM_OCCLUSION_RAYS);
+    double rate = occlusion.stats.raysPerSecond();
+    if (threads == 1) oneThreadRate = rate;
+
+    double mean = 0;
+    for (float o : occlusion.occlusion) mean += o;
+    mean /= occlusion.occlusion.size();
+
+    LOG_INFO("[bench] occlusion bake, " << threads << " threads: " << occlusion.stats.rays << " rays in "
+                                        << occlusion.stats.ms << " ms, " << rate / 1e6 << " Mrays/s, speedup "
+                                        << rate / oneThreadRate << ", mean openness " << mean);
+    if (threads == most) break;
+  }
+  ThreadPool::setConcurrency(0);
+}
+
+void Benchmark::runTerrainLodBenchmark(const ofMesh &mesh, int maxLevel, int hoverLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  TerrainLod lod;
+  double oneThreadMs = 0;
+  unsigned most = ThreadPool::size();
+  for (unsigned threads = 1;; threads = std::min(threads * 2, most)) {
+    ThreadPool::setConcurrency(threads);
+    lod.build(mesh);
+    if (threads == 1) oneThreadMs = lod.stats.ms;
+    LOG_INFO("[bench] terrain lod build, " << threads << " threads: " << lod.stats.ms << " ms, speedup "
+                                           << oneThreadMs / lod.stats.ms);
+    if (threads == most) break;
+  }
+  ThreadPool::setConcurrency(0);
+
+  BVH fine, coarse;
+  fine.generate(mesh, maxLevel);
+  coarse.generate(lod.levelMesh(mesh, hoverLevel), maxLevel);
+
+  // Rays from above the terrain to random points on it
+  //
+  Box bounds = meshBounds(mesh);
+  ofVec3f lo = toOf(bounds.min()), hi = toOf(bounds.max()), size = hi - lo;
+  ofVec3f eye = (lo + hi) / 2 + ofVec3f(0, size.y + std::max(size.x, size.z) / 2, 0);
+  mt19937 rng(7);
+  uniform_real_distribution<float> unit(0, 1);
+  vector<Ray> rays;
+  for (int i = 0; i < NUM_LOD_PICKS; i++) {
+    ofVec3f target = lo + ofVec3f(size.x * unit(rng), 0, size.z * unit(rng));
+    rays.push_back(Ray(toVector3(eye), toVector3((target - eye).getNormalized())));
+  }
+
+  vector<float> fineT(rays.size()), coarseT(rays.size());
+  vector<int> fineHit(rays.size()), coarseHit(rays.size());
+  auto start = steady_clock::now();
+  for (size_t i = 0; i < rays.size(); i++) fineHit[i] = fine.intersect(rays[i], 0, FLT_MAX, fineT[i]);
+  double fineUs = duration<double, micro>(steady_clock::now() - start).count() / rays.size();
+  start = steady_clock::now();
+  for (size_t i = 0; i < rays.size(); i++) coarseHit[i] = coarse.intersect(rays[i], 0, FLT_MAX, coarseT[i]);
+  double coarseUs = duration<double, micro>(steady_clock::now() - start).count() / rays.size();
+
+  float worst = 0, mean = 0;
+  int both = 0;
+  for (size_t i = 0; i < rays.size(); i++) {
+    if (fineHit[i] < 0 || coarseHit[i] < 0) continue;
+    float apart = fabs(fineT[i] - coarseT[i]);
+    worst = std::max(worst, apart);
+    mean += apart;
+    both++;
+  }
+  LOG_INFO("[bench] terrain lod picks: full " << fine.triangles.size() << " triangles " << fineUs << " us, level "
+                                              << hoverLevel << " " << coarse.triangles.size() << " triangles "
+                                              << coarseUs << " us per pick; hits apart " << mean / std::max(both, 1)
+                                              << " on average, " << worst << " at most");
+}
+
+void Benchmark::runSnapshotBenchmark(const ofMesh &mesh, int maxLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  BVH bvh;
+  bvh.generate(mesh, maxLevel);
+  SnapshotRenderer renderer(bvh);
+
+  // From above a corner of the terrain, looking down at its center
+  //
+  Box bounds = meshBounds(mesh);
+  ofVec3f lo = toOf(bounds.min()), hi = toOf(bounds.max()), center = (lo + hi) / 2;
+  ofVec3f eye(lo.x, hi.y + (hi.x - lo.x) / 4, lo.z);
+  SnapshotRenderer::View view = {eye, center - eye, ofVec3f(0, 1, 0), 65.5f};
+
+  ofPixels pixels;
+  double oneThreadMs[2] = {0, 0};
+  unsigned most = ThreadPool::size();
+  for (unsigned threads = 1;; threads = std::min(threads * 2, most)) {
+    ThreadPool::setConcurrency(threads);
+    for (int single = 0; single < 2; single++) {
+      renderer.bSingleRays = single;
+      renderer.render(view, SNAPSHOT_BENCH_WIDTH, SNAPSHOT_BENCH_HEIGHT, pixels);  // warm up
+
+      double ms = 0;
+      for (int i = 0; i < NUM_SNAPSHOT_FRAMES; i++) {
+        renderer.render(view, SNAPSHOT_BENCH_WIDTH, SNAPSHOT_BENCH_HEIGHT, pixels);
+        ms += renderer.stats.ms;
+      }
+      ms /= NUM_SNAPSHOT_FRAMES;
+      if (threads == 1) oneThreadMs[single] = ms;
+
+      LOG_INFO("[bench] snapshot " << SNAPSHOT_BENCH_WIDTH << "x" << SNAPSHOT_BENCH_HEIGHT << ", "
+                                   << (single ? "single rays" : "packets") << ", " << threads << " threads: " << ms
+                                   << " ms per frame, " << renderer.stats.rays / ms / 1000 << " Mrays/s, speedup "
+                                   << oneThreadMs[single] / ms);
+    }
+    if (threads == most) break;
+  }
+  ThreadPool::setConcurrency(0);
+}
+
+void Benchmark::runFleetBenchmark(const ofMesh &mesh, int maxLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  BVH bvh;
+  bvh.generate(mesh, maxLevel);
+
+  Box bounds = meshBounds(mesh);
+  ofVec3f lo = toOf(bounds.min()), hi = toOf(bounds.max()), size = hi - lo;
+
+  // A diagonal across the terrain, rovers a few hundredths of it long
+  //
+  ofPolyline route;
+  for (int i = 0; i <= 64; i++) route.addVertex(lo + (hi - lo) * (i / 64.0f));
+
+  float length = std::max(size.x, size.z);
+  RoverFleet fleet;
+  fleet.footprint = {length / 200, length / 150, 0};
+  fleet.setRoute(route, length / 500);
+  fleet.spawn(NUM_FLEET_ROVERS, length / 20, fleet.footprint.halfTrack * 3);
+
+  double oneThreadMs = 0;
+  unsigned most = ThreadPool::size();
+  for (unsigned threads = 1;; threads = std::min(threads * 2, most)) {
+    ThreadPool::setConcurrency(threads);
+    fleet.tick(bvh, 1 / 60.0f);  // warm up the workers
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < NUM_FLEET_TICKS; i++) fleet.tick(bvh, 1 / 60.0f);
+    double tickMs = duration<double, milli>(steady_clock::now() - start).count() / NUM_FLEET_TICKS;
+    if (threads == 1) oneThreadMs = tickMs;
+
+    LOG_INFO("[bench] fleet of " << fleet.size() << " rovers, " << threads << " threads: " << tickMs << " ms per tick, "
+                                 << tickMs * 1000 / fleet.size() << " us per rover, speedup "
+                                 << oneThreadMs / tickMs);
+    if (threads == most) break;
+  }
+  ThreadPool::setConcurrency(0);
+}
+
+void Benchmark::runLinearOctreeBuildBenchmark(int numPoints) {
+  mt19937 rng(235);
+  uniform_real_distribution<float> unit(0, 1);
+  vector<ofVec3f> points(numPoints);
+  for (auto &p : points) p = ofVec3f(unit(rng), unit(rng), unit(rng));
+
+  // Every sort pass reads and writes a code and an index per point
+  //
+  double sortBytes = 6.0 * 2 * numPoints * (sizeof(uint64_t) + sizeof(uint32_t));
+
+  double oneThreadMs = 0;
+  unsigned most = ThreadPool::size();
+  for (unsigned threads = 1;; threads = std::min(threads * 2, most)) {
+    ThreadPool::setConcurrency(threads);
+
+    LinearOctree tree;
+    auto start = steady_clock::now();
+    tree.build(points.data(), points.size());
+    double buildMs = duration<double, milli>(steady_clock::now() - start).count();
+    if (threads == 1) oneThreadMs = buildMs;
+
+    auto &stats = tree.buildStats;
+    LOG_INFO("[bench] linear octree of " << numPoints << " points, " << threads << " threads: " << buildMs
+                                         << " ms (codes " << stats.codesMs << ", sort " << stats.sortMs
+                                         << ", hierarchy " << stats.hierarchyMs << "), " << tree.nodes.size()
+                                         << " nodes");
+    LOG_INFO("[bench] linear octree: " << numPoints / buildMs / 1000 << " Mpoints/s, sort "
+                                       << sortBytes / stats.sortMs / 1e6 << " GB/s, speedup "
+                                       << oneThreadMs / buildMs);
+    if (threads == most) break;
+  }
+  ThreadPool::setConcurrency(0);
+}
+
+// A set associative cache of 64 byte lines with LRU replacement, 32 KiB
+// like a typical L1 data cache. Counts the misses of the addresses fed to
+// it.
+//
+namespace {
+struct CacheModel {
+  static const int LINE = 64, SETS = 64, WAYS = 8;
+
+  vector<uint64_t> tags;  // per set, most recently used first
+  size_t accesses, misses;
+
+  CacheModel() : tags(SETS * WAYS, ~0ull), accesses(0), misses(0) {}
+
+  void access(uint64_t address) {
+    uint64_t line = address / LINE;
+    uint64_t *set = &tags[(line % SETS) * WAYS];
+    int way = 0;
+    while (way < WAYS - 1 && set[way] != line) way++;
+    if (set[way] != line) misses++;
+    std::copy_backward(set, set + way, set + way + 1);
+    set[0] = line;
+    accesses++;
+  }
+
+  double missRate() const { return accesses ? double(misses) / accesses : 0; }
+};
+}  // namespace
+
+// Vertices the post transform cache of the GPU (a FIFO of cacheSize) has
+// to shade per triangle, for the mesh's index buffer.
+//
+static double vertexCacheMissRatio(const ofMesh &mesh, int cacheSize = 32) {
+  auto &indices = mesh.getIndices();
+  if (indices.size() < 3) return 0;
+  vector<int> fifo(cacheSize, -1);
+  size_t next = 0, misses = 0;
+  for (auto index : indices) {
+    if (std::find(fifo.begin(), fifo.end(), int(index)) != fifo.end()) continue;
+    fifo[next++ % cacheSize] = index;
+    misses++;
+  }
+  return double(misses) / (indices.size() / 3);
+}
+
+void Benchmark::runMeshOrderBenchmark(const ofMesh &mesh, int maxLevel) {
+  if (mesh.getNumVertices() == 0) return;
+
+  // The same mesh in three orders
+  //
+  vector<pair<string, ofMesh>> meshes;
+  meshes.push_back(make_pair(string("as given"), mesh));
+
+  ofMesh shuffled = mesh;
+  MeshOrder scramble;
+  for (size_t i = 0; i < mesh.getNumVertices(); i++) scramble.vertices.push_back(i);
+  std::shuffle(scramble.vertices.begin(), scramble.vertices.end(), mt19937(235));
+  scramble.remap.resize(mesh.getNumVertices());
+  for (size_t i = 0; i < mesh.getNumVertices(); i++) scramble.remap[scramble.vertices[i]] = i;
+  for (auto index : mesh.getIndices()) scramble.indices.push_back(scramble.remap[index]);
+  reorderMesh(shuffled, scramble);
+  meshes.push_back(make_pair(string("shuffled"), shuffled));
+
+  ofMesh ordered = mesh;
+  auto start = steady_clock::now();
+  reorderMesh(ordered);
+  double orderMs = duration<double, milli>(steady_clock::now() - start).count();
+  meshes.push_back(make_pair(string("z-order"), ordered));
+
+  LOG_INFO("[bench] mesh order: " << mesh.getNumVertices() << " vertices reordered in " << orderMs << " ms");
+
+  Box bounds = meshBounds(mesh);
+  ofVec3f lo = toOf(bounds.min()), hi = toOf(bounds.max()), size = hi - lo;
+  mt19937 rng(235);
+  uniform_real_distribution<float> u(0, 1);
+  vector<Box> boxes;
+  for (int i = 0; i < NUM_ORDER_QUERIES; i++) {
+    ofVec3f corner = lo + size * ofVec3f(u(rng), u(rng), u(rng)) * 0.9f;
+    boxes.push_back(Box(toVector3(corner), toVector3(corner + size * 0.1f)));
+  }
+
+  for (auto &entry : meshes) {
+    const ofMesh &m = entry.second;
+    const ofVec3f *vertices = m.getVerticesPointer();
+
+    // Vertex fetches for drawing the triangles
+    //
+    CacheModel drawCache;
+    for (auto index : m.getIndices()) drawCache.access(index * sizeof(ofVec3f));
+
+    OctTree tree;
+    start = steady_clock::now();
+    tree.generate(m, maxLevel);
+    double buildMs = duration<double, milli>(steady_clock::now() - start).count();
+
+    // ... for visiting every leaf's points, as the queries do
+    //
+    vector<int> found;
+    tree.queryBox(bounds, found);
+    CacheModel leafCache;
+    for (int index : tree.order) leafCache.access(index * sizeof(ofVec3f));
+
+    // Box queries that read back the points they find
+    //
+    start = steady_clock::now();
+    ofVec3f sum;
+    size_t points = 0;
+    for (auto &box : boxes) {
+      points += tree.queryBox(box, found);
+      for (int index : found) sum += vertices[index];
+    }
+    double queryUs = duration<double, micro>(steady_clock::now() - start).count() / boxes.size();
+
+    LOG_INFO("[bench] mesh order " << entry.first << ": " << vertexCacheMissRatio(m) << " vertex cache misses per "
+                                   << "triangle, L1 misses " << drawCache.missRate() * 100 << "% drawing, "
+                                   << leafCache.missRate() * 100 << "% walking leaves");
+    LOG_INFO("[bench] mesh order " << entry.first << ": octree build " << buildMs << " ms, box query " << queryUs
+                                   << " us (" << points / boxes.size() << " points, sum " << sum.length() << ")");
+  }
+}
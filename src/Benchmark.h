@@ -0,0 +1,168 @@
+#pragma once
+//
+//  Benchmark.h
+//  martian-terrain
+//
+//  Benchmark harness for the terrain acceleration structures. Builds each
+//  index over the same mesh, casts the same batch of rays through it and
+//  logs build time, memory and ray throughput side by side.
+//
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "ray.h"
+#include "spatialindex.h"
+
+namespace Benchmark {
+
+using namespace std;
+using namespace sidmishraw_octtree;
+
+// Rays generated per run.
+//
+const int NUM_RAYS = 100000;
+
+// Time budget for casting rays through an index; slow indices stop early
+// and report the throughput of the rays they got through.
+//
+const double RAY_BUDGET_SECONDS = 2.0;
+
+// Measurements for one index.
+//
+struct IndexReport {
+  string name;
+  double buildMs;
+  size_t bytes;
+  double raysPerSec;
+  size_t rays;
+  size_t hits;
+
+  // Heap allocations made by the first build and by a rebuild over the
+  // same mesh (-1 when the index doesn't count them, see
+  // SpatialIndex::heapAllocations()), and the time it takes to tear the
+  // index down.
+  //
+  long buildAllocs;
+  double rebuildMs;
+  long rebuildAllocs;
+  double teardownMs;
+};
+
+// Picking-like rays: random origins above the terrain's bounds, pointing
+// down with a random tilt. The seed keeps runs comparable.
+//
+vector<Ray> terrainRays(const ofMesh& mesh, int n, unsigned seed = 235);
+
+// Builds the index over the mesh, rebuilds it and casts the rays through
+// it. The index is torn down before returning, so pass in the only
+// reference to it.
+//
+IndexReport measureIndex(shared_ptr<SpatialIndex> index, const ofMesh& mesh, int maxLevel, const vector<Ray>& rays);
+
+// Logs a report line.
+//
+void logReport(const IndexReport& report);
+
+// Runs the benchmark on every index kind and logs the reports.
+//
+void runIndexBenchmark(const ofMesh& mesh, int maxLevel);
+
+// Operations timed by the octree update benchmark, of each kind.
+//
+const int NUM_UPDATES = 1000;
+
+// Times incremental octree inserts, moves, removes and a local terrain
+// deformation against rebuilding the whole tree, and logs them.
+//
+void runOctreeUpdateBenchmark(const ofMesh& mesh, int maxLevel);
+
+// Picks cast by the lazy octree benchmark.
+//
+const int NUM_LAZY_PICKS = 1000;
+
+// Compares generating the octree eagerly and lazily: the startup time and
+// memory, then the memory after a burst of picks over a small region and
+// after expanding a strip across the terrain, and the time per pick.
+//
+void runLazyOctreeBenchmark(const ofMesh& mesh, int maxLevel);
+
+// Mouse moves in the drag of the drag picking benchmark.
+//
+const int NUM_DRAG_PICKS = 1000;
+
+// Times picking along a simulated mouse drag with the octree's full
+// search and with pick, which skips lighting up the nodes.
+//
+void runDragPickBenchmark(const ofMesh& mesh, int maxLevel);
+
+// Rays per vertex cast by the ambient occlusion benchmark.
+//
+const int NUM_OCCLUSION_RAYS = 16;
+
+// Bakes the terrain's ambient occlusion with 1, 2, 4, ... threads and logs
+// the rays per second and the speedup over one thread.
+//
+void runOcclusionBakeBenchmark(const ofMesh& mesh, int maxLevel);
+
+// Cursor rays picked by the terrain LOD benchmark.
+//
+const int NUM_LOD_PICKS = 1000;
+
+// Builds the terrain's levels of detail with 1, 2, 4, ... threads and logs
+// the time and the speedup over one thread. Then times picking the cursor
+// rays on the BVH of the full terrain and of hoverLevel, and logs how far
+// apart their hits are.
+//
+void runTerrainLodBenchmark(const ofMesh& mesh, int maxLevel, int hoverLevel);
+
+// Size of the frames rendered by the snapshot benchmark (the window's),
+// and the frames timed per run.
+//
+const int SNAPSHOT_BENCH_WIDTH = 1280;
+const int SNAPSHOT_BENCH_HEIGHT = 1024;
+const int NUM_SNAPSHOT_FRAMES = 3;
+
+// Ray traces a view across the terrain with 1, 2, 4, ... threads, tracing
+// packets and single rays, and logs the time per frame, the rays per
+// second and the speedup over one thread.
+//
+void runSnapshotBenchmark(const ofMesh& mesh, int maxLevel);
+
+// Rovers ticked by the fleet benchmark, and the ticks timed per thread
+// count.
+//
+const int NUM_FLEET_ROVERS = 1024;
+const int NUM_FLEET_TICKS = 10;
+
+// Times a fleet tick over the terrain with 1, 2, 4, ... threads and logs
+// the time per rover and the speedup over one thread.
+//
+void runFleetBenchmark(const ofMesh& mesh, int maxLevel);
+
+// Points in the linear octree build benchmark, many more than the terrain
+// has, so the sort dominates.
+//
+const int NUM_LINEAR_OCTREE_POINTS = 1 << 22;
+
+// Times the linear octree build stages over random points with 1, 2, 4,
+// ... threads and logs the points per second and the bytes moved.
+//
+void runLinearOctreeBuildBenchmark(int numPoints = NUM_LINEAR_OCTREE_POINTS);
+
+// Box queries timed by the mesh order benchmark.
+//
+const int NUM_ORDER_QUERIES = 1000;
+
+// Compares the mesh with its vertices as given, shuffled (as a careless
+// exporter might write them) and in the spatial order of meshorder.h. For
+// each it logs the vertex cache misses per triangle of the index buffer,
+// the simulated L1 misses fetching vertices for drawing and for walking
+// the octree's leaves, and the octree build and box query times.
+//
+void runMeshOrderBenchmark(const ofMesh& mesh, int maxLevel);
+}  // namespace Benchmark
@@ -0,0 +1,131 @@
+//
+//  Log.cpp
+//  martian-terrain
+//
+
+#include "Log.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+std::atomic<int> Logger::runtimeLevel(LOG_LEVEL_DEBUG);
+
+void Logger::setLevel(int level) { runtimeLevel.store(level, memory_order_relaxed); }
+
+namespace {
+
+// Bounded multi-producer ring (Vyukov's sequence-numbered queue). Any thread
+// can push, only the writer thread pops.
+//
+class LogRing {
+ public:
+  static const size_t CAPACITY = 1024;  // power of two
+
+  LogRing() : head(0), tail(0), dropped(0), bStop(false) {
+    for (size_t i = 0; i < CAPACITY; i++) slots[i].seq.store(i, memory_order_relaxed);
+    writer = thread(&LogRing::run, this);
+  }
+
+  ~LogRing() {
+    bStop.store(true, memory_order_release);
+    if (writer.joinable()) writer.join();
+  }
+
+  void push(int level, const char *text, size_t len) {
+    size_t pos = head.load(memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots[pos & (CAPACITY - 1)];
+      size_t seq = slot->seq.load(memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        dropped.fetch_add(1, memory_order_relaxed);  // full -- never block the caller
+        return;
+      } else {
+        pos = head.load(memory_order_relaxed);
+      }
+    }
+
+    slot->level = level;
+    slot->len = len < Logger::LINE_SIZE ? len : Logger::LINE_SIZE;
+    memcpy(slot->text, text, slot->len);
+    slot->seq.store(pos + 1, memory_order_release);
+  }
+
+ private:
+  struct Slot {
+    atomic<size_t> seq;
+    int level;
+    size_t len;
+    char text[Logger::LINE_SIZE];
+  };
+
+  static const char *prefix(int level) {
+    switch (level) {
+      case LOG_LEVEL_TRACE:
+        return "TRACE :: ";
+      case LOG_LEVEL_DEBUG:
+        return "DEBUG :: ";
+      case LOG_LEVEL_ERROR:
+        return "ERROR :: ";
+      default:
+        return "INFO :: ";
+    }
+  }
+
+  // Writes out everything published so far, returns the number of lines.
+  //
+  size_t drain() {
+    size_t n = 0;
+    while (true) {
+      Slot &slot = slots[tail & (CAPACITY - 1)];
+      if (slot.seq.load(memory_order_acquire) != tail + 1) break;
+
+      cout << prefix(slot.level);
+      cout.write(slot.text, slot.len);
+      cout << '\n';
+
+      slot.seq.store(tail + CAPACITY, memory_order_release);
+      tail++;
+      n++;
+    }
+
+    auto lost = dropped.exchange(0, memory_order_relaxed);
+    if (lost > 0) cout << "ERROR :: " << lost << " log lines dropped\n";
+
+    if (n > 0 || lost > 0) cout.flush();
+    return n;
+  }
+
+  void run() {
+    while (!bStop.load(memory_order_acquire)) {
+      if (drain() == 0) this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    drain();  // whatever was published before shutting down
+  }
+
+  Slot slots[CAPACITY];
+  atomic<size_t> head;
+  size_t tail;  // only touched by the writer thread
+  atomic<size_t> dropped;
+  atomic<bool> bStop;
+  thread writer;
+};
+
+LogRing &ring() {
+  static LogRing instance;
+  return instance;
+}
+}  // namespace
+
+void Logger::publish(int level, const char *text, size_t len) { ring().push(level, text, len); }
+
+Logger::Line::Line(int level) : level(level), os(&buf) {}
+
+Logger::Line::~Line() { publish(level, buf.text, buf.size()); }
@@ -0,0 +1,93 @@
+#pragma once
+//
+//  Log.h
+//  martian-terrain
+//
+//  Leveled logging that is cheap enough to leave in per-frame code.
+//
+//  - Lines below LOG_LEVEL_MIN (compile time, e.g. -DLOG_LEVEL_MIN=2 in
+//    PROJECT_DEFINES) are compiled out.
+//  - Lines below the runtime level (Logger::setLevel) are not formatted.
+//  - Formatting goes into a fixed stack buffer, which is pushed onto a
+//    lock-free ring. A background thread drains the ring and writes to the
+//    console, flushing once per batch instead of once per line.
+//
+//  Usage: LOG_DEBUG("Selected pt = " << selectedPoint);
+//
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+
+// Log levels, from the most to the least verbose.
+//
+enum LogLevel { LOG_LEVEL_TRACE = 0, LOG_LEVEL_DEBUG = 1, LOG_LEVEL_INFO = 2, LOG_LEVEL_ERROR = 3 };
+
+// Lines below this level are compiled out.
+//
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN LOG_LEVEL_TRACE
+#endif
+
+namespace Logger {
+
+// The longest line kept, longer lines are truncated.
+//
+const size_t LINE_SIZE = 240;
+
+// The runtime level, lines below it are skipped before formatting.
+//
+extern std::atomic<int> runtimeLevel;
+
+// Checks if a line at the given level would be logged.
+//
+inline bool isEnabled(int level) {
+  return level >= LOG_LEVEL_MIN && level >= runtimeLevel.load(std::memory_order_relaxed);
+}
+
+// Sets the runtime level.
+//
+void setLevel(int level);
+
+// Hands a formatted line over to the background writer. Never blocks;
+// the line is dropped (and counted) when the ring is full.
+//
+void publish(int level, const char* text, size_t len);
+
+// A single log line formatted into a fixed buffer, published when it goes
+// out of scope.
+//
+class Line {
+ public:
+  explicit Line(int level);
+  ~Line();
+
+  std::ostream& stream() { return os; }
+
+ private:
+  class Buffer : public std::streambuf {
+   public:
+    Buffer() { setp(text, text + LINE_SIZE); }
+    size_t size() const { return pptr() - pbase(); }
+    char text[LINE_SIZE];
+  };
+
+  int level;
+  Buffer buf;
+  std::ostream os;
+};
+}  // namespace Logger
+
+#define LOG_AT(level, expr)                     \
+  do {                                          \
+    if (Logger::isEnabled(level)) {             \
+      Logger::Line logLine_(level);             \
+      logLine_.stream() << expr;                \
+    }                                           \
+  } while (0)
+
+#define LOG_TRACE(expr) LOG_AT(LOG_LEVEL_TRACE, expr)
+#define LOG_DEBUG(expr) LOG_AT(LOG_LEVEL_DEBUG, expr)
+#define LOG_INFO(expr) LOG_AT(LOG_LEVEL_INFO, expr)
+#define LOG_ERROR(expr) LOG_AT(LOG_LEVEL_ERROR, expr)
@@ -0,0 +1,223 @@
+//
+//  Profiler.cpp
+//  martian-terrain
+//
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "ofMain.h"
+
+using namespace std;
+
+namespace {
+
+// Frames kept for the rolling statistics.
+//
+const size_t HISTORY = 240;
+
+struct Event {
+  int zone;
+  uint64_t start;
+  uint64_t end;
+};
+
+// Events of a single thread. The lock is only contended while endFrame()
+// collects the events.
+//
+struct ThreadBuffer {
+  mutex mtx;
+  vector<Event> events;
+  int tid;
+};
+
+// Rolling per frame totals of a zone, in microseconds.
+//
+struct ZoneHistory {
+  string name;
+  vector<uint64_t> samples;
+  size_t next = 0;
+
+  void push(uint64_t us) {
+    if (samples.size() < HISTORY)
+      samples.push_back(us);
+    else
+      samples[next] = us;
+    next = (next + 1) % HISTORY;
+  }
+};
+
+struct TraceEvent {
+  Event event;
+  int tid;
+};
+
+struct Registry {
+  mutex mtx;
+  vector<ZoneHistory> zones;
+  vector<shared_ptr<ThreadBuffer>> buffers;  // outlive their threads
+  bool bCapturing = false;
+  vector<TraceEvent> capture;
+  uint64_t lastFrame = 0;
+  int frameZone = -1;
+};
+
+Registry &registry() {
+  static Registry instance;
+  return instance;
+}
+
+const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+thread_local ThreadBuffer *localBuffer = nullptr;
+
+ThreadBuffer &threadBuffer() {
+  if (!localBuffer) {
+    auto &r = registry();
+    auto buffer = make_shared<ThreadBuffer>();
+    lock_guard<mutex> lock(r.mtx);
+    buffer->tid = (int)r.buffers.size();
+    r.buffers.push_back(buffer);
+    localBuffer = buffer.get();
+  }
+  return *localBuffer;
+}
+}  // namespace
+
+atomic<bool> Profiler::enabled(false);
+
+uint64_t Profiler::now() {
+  // +1 so that a valid timestamp is never 0, Scope uses 0 for "not timing"
+  //
+  return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+void Profiler::setEnabled(bool bEnabled) { enabled.store(bEnabled, memory_order_relaxed); }
+
+int Profiler::registerZone(const char *name) {
+  auto &r = registry();
+  lock_guard<mutex> lock(r.mtx);
+  for (size_t i = 0; i < r.zones.size(); i++) {
+    if (r.zones[i].name == name) return (int)i;
+  }
+  r.zones.push_back(ZoneHistory());
+  r.zones.back().name = name;
+  return (int)r.zones.size() - 1;
+}
+
+void Profiler::record(int zone, uint64_t start, uint64_t end) {
+  auto &buffer = threadBuffer();
+  lock_guard<mutex> lock(buffer.mtx);
+  buffer.events.push_back(Event{zone, start, end});
+}
+
+void Profiler::endFrame() {
+  auto &r = registry();
+  if (r.frameZone < 0) r.frameZone = registerZone("frame");
+
+  auto t = now();
+
+  lock_guard<mutex> lock(r.mtx);
+
+  vector<uint64_t> totals(r.zones.size(), 0);
+  vector<bool> hit(r.zones.size(), false);
+  vector<Event> events;
+
+  for (auto &buffer : r.buffers) {
+    {
+      lock_guard<mutex> bufferLock(buffer->mtx);
+      events.swap(buffer->events);
+    }
+    for (auto &e : events) {
+      totals[e.zone] += e.end - e.start;
+      hit[e.zone] = true;
+      if (r.bCapturing) r.capture.push_back(TraceEvent{e, buffer->tid});
+    }
+    events.clear();
+  }
+
+  // Zones that did not run this frame keep their history untouched, so the
+  // occasional ones (e.g. picking) aren't flattened to zero.
+  //
+  for (size_t i = 0; i < r.zones.size(); i++) {
+    if (hit[i]) r.zones[i].push(totals[i]);
+  }
+
+  if (r.lastFrame != 0 && isEnabled()) {
+    r.zones[r.frameZone].push(t - r.lastFrame);
+    if (r.bCapturing) r.capture.push_back(TraceEvent{Event{r.frameZone, r.lastFrame, t}, 0});
+  }
+  r.lastFrame = t;
+}
+
+void Profiler::drawOverlay(float x, float y) {
+  stringstream ss;
+  ss.setf(ios::fixed);
+  ss.precision(3);
+  ss << "zone                 min(ms)  avg(ms)  p99(ms)" << endl;
+
+  {
+    auto &r = registry();
+    lock_guard<mutex> lock(r.mtx);
+    for (auto &zone : r.zones) {
+      if (zone.samples.empty()) continue;
+
+      auto sorted = zone.samples;
+      sort(sorted.begin(), sorted.end());
+
+      uint64_t sum = 0;
+      for (auto s : sorted) sum += s;
+
+      auto p99 = sorted[min(sorted.size() - 1, (sorted.size() * 99) / 100)];
+
+      string name = zone.name;
+      name.resize(20, ' ');
+      ss << name << " " << setw(8) << sorted.front() / 1000.0 << " " << setw(8) << (sum / 1000.0) / sorted.size()
+         << " " << setw(8) << p99 / 1000.0 << endl;
+    }
+  }
+
+  ofDrawBitmapStringHighlight(ss.str(), x, y);
+}
+
+void Profiler::beginCapture() {
+  auto &r = registry();
+  lock_guard<mutex> lock(r.mtx);
+  r.capture.clear();
+  r.bCapturing = true;
+}
+
+bool Profiler::isCapturing() {
+  auto &r = registry();
+  lock_guard<mutex> lock(r.mtx);
+  return r.bCapturing;
+}
+
+string Profiler::endCapture() {
+  auto &r = registry();
+  lock_guard<mutex> lock(r.mtx);
+  r.bCapturing = false;
+
+  // Complete ("X") events, see the Trace Event Format document.
+  //
+  stringstream ss;
+  ss << "{\"traceEvents\":[";
+  for (size_t i = 0; i < r.capture.size(); i++) {
+    auto &t = r.capture[i];
+    if (i > 0) ss << ",";
+    ss << "\n{\"name\":\"" << r.zones[t.event.zone].name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t.tid
+       << ",\"ts\":" << t.event.start << ",\"dur\":" << t.event.end - t.event.start << "}";
+  }
+  ss << "\n],\"displayTimeUnit\":\"ms\"}";
+
+  r.capture.clear();
+  return ss.str();
+}
@@ -0,0 +1,88 @@
+#pragma once
+//
+//  Profiler.h
+//  martian-terrain
+//
+//  Scoped-zone frame profiler.
+//
+//  PROFILE_ZONE("name") times the enclosing scope. The zone id is resolved
+//  once per call site, and the timings go into a buffer owned by the calling
+//  thread. Profiler::endFrame() gathers the buffers once per frame into a
+//  rolling min/avg/p99 per zone, drawn by Profiler::drawOverlay(). While a
+//  capture is running, the raw events are also kept for Chrome trace export
+//  (chrome://tracing, Perfetto).
+//
+//  The zones cost a single relaxed load while the profiler is disabled, and
+//  nothing at all when compiled with PROFILER_DISABLED.
+//
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Profiler {
+
+using namespace std;
+
+// Microseconds since the profiler's epoch.
+//
+uint64_t now();
+
+// Registers a zone name, returns its id.
+//
+int registerZone(const char* name);
+
+// Records a finished zone into the calling thread's buffer.
+//
+void record(int zone, uint64_t start, uint64_t end);
+
+extern atomic<bool> enabled;
+
+inline bool isEnabled() { return enabled.load(memory_order_relaxed); }
+
+void setEnabled(bool bEnabled);
+
+// Closes the current frame: folds every thread's events into the rolling
+// statistics (and the capture, if one is running).
+//
+void endFrame();
+
+// Draws the per-zone min/avg/p99 table with its top left corner at (x, y).
+//
+void drawOverlay(float x, float y);
+
+// Starts keeping the raw events for exporting.
+//
+void beginCapture();
+
+// Stops the capture and returns it in the Chrome trace JSON format.
+//
+string endCapture();
+
+bool isCapturing();
+
+// Times the enclosing scope, see PROFILE_ZONE.
+//
+class Scope {
+ public:
+  explicit Scope(int zone) : zone(zone), start(isEnabled() ? now() : 0) {}
+  ~Scope() {
+    if (start != 0) record(zone, start, now());
+  }
+
+ private:
+  int zone;
+  uint64_t start;
+};
+}  // namespace Profiler
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifndef PROFILER_DISABLED
+#define PROFILE_ZONE(name)                                                                  \
+  static const int PROFILE_CONCAT(profileZone_, __LINE__) = Profiler::registerZone(name); \
+  Profiler::Scope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileZone_, __LINE__))
+#else
+#define PROFILE_ZONE(name)
+#endif
@@ -0,0 +1,160 @@
+//
+//  ThreadPool.cpp
+//  martian-terrain
+//
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// One loop handed to the workers.
+//
+struct Job {
+  const function<void(size_t, size_t)>* body;
+  size_t count;
+  size_t grain;
+  atomic<size_t> next;
+};
+
+// Set on the workers, and on the caller while it runs its share, so that
+// nested loops run inline instead of waiting on the pool.
+//
+thread_local bool bInsideLoop = false;
+
+// Set on threads that run their loops on the background pool.
+//
+thread_local bool bBackground = false;
+
+void runChunks(Job& job) {
+  for (;;) {
+    size_t begin = job.next.fetch_add(job.grain);
+    if (begin >= job.count) return;
+    (*job.body)(begin, std::min(job.count, begin + job.grain));
+  }
+}
+
+class Pool {
+ public:
+  explicit Pool(unsigned n) : job(nullptr), generation(0), pending(0), limit(0), bStop(false) {
+    for (unsigned i = 1; i < n; i++) workers.emplace_back(&Pool::work, this, i);
+  }
+
+  ~Pool() {
+    {
+      lock_guard<mutex> lock(m);
+      bStop = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+  }
+
+  unsigned size() const {
+    unsigned n = workers.size() + 1;
+    return limit > 0 ? std::min(limit.load(), n) : n;
+  }
+
+  void setLimit(unsigned threads) { limit = threads; }
+
+  void run(size_t count, size_t grain, const function<void(size_t, size_t)>& body) {
+    grain = std::max<size_t>(1, grain);
+    if (bInsideLoop || workers.empty() || size() == 1 || count <= grain) {
+      body(0, count);
+      return;
+    }
+
+    // One loop at a time; callers on other threads queue up here.
+    //
+    lock_guard<mutex> serial(callers);
+
+    Job current;
+    current.body = &body;
+    current.count = count;
+    current.grain = grain;
+    current.next = 0;
+
+    {
+      lock_guard<mutex> lock(m);
+      job = &current;
+      pending = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+
+    bInsideLoop = true;
+    runChunks(current);
+    bInsideLoop = false;
+
+    // Every worker checks in, even the ones that found nothing left, so
+    // none of them still holds the job once it goes out of scope.
+    //
+    unique_lock<mutex> lock(m);
+    done.wait(lock, [this]() { return pending == 0; });
+    job = nullptr;
+  }
+
+ private:
+  void work(unsigned id) {
+    bInsideLoop = true;
+    unsigned long seen = 0;
+    unique_lock<mutex> lock(m);
+    for (;;) {
+      wake.wait(lock, [&]() { return bStop || generation != seen; });
+      if (bStop) return;
+      seen = generation;
+      Job* current = job;
+
+      // Workers past the cap sit the loop out.
+      //
+      lock.unlock();
+      if (id < size()) runChunks(*current);
+      lock.lock();
+
+      if (--pending == 0) done.notify_one();
+    }
+  }
+
+  vector<thread> workers;
+  mutex m, callers;
+  condition_variable wake, done;
+  Job* job;
+  unsigned long generation;
+  size_t pending;
+  atomic<unsigned> limit;
+  bool bStop;
+};
+
+// The frame's loops run on every core. Background loops get half of them,
+// so that the frame's loops still find cores free while a load is baking.
+//
+Pool& foreground() {
+  static Pool instance(thread::hardware_concurrency());
+  return instance;
+}
+
+Pool& background() {
+  static Pool instance(std::max(2u, thread::hardware_concurrency() / 2));
+  return instance;
+}
+
+Pool& pool() { return bBackground ? background() : foreground(); }
+}  // namespace
+
+void ThreadPool::useBackgroundPool() { bBackground = true; }
+
+unsigned ThreadPool::size() { return pool().size(); }
+
+void ThreadPool::setConcurrency(unsigned threads) { pool().setLimit(threads); }
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const function<void(size_t, size_t)>& body) {
+  if (count == 0) return;
+  pool().run(count, grain, body);
+}
@@ -0,0 +1,43 @@
+#pragma once
+//
+//  ThreadPool.h
+//  martian-terrain
+//
+//  Persistent worker threads for per-frame parallel loops.
+//
+//  ThreadPool::parallelFor() splits [0, count) into chunks that the workers
+//  and the calling thread take off a shared counter until none are left.
+//  The workers are started on first use and sleep between loops, so a loop
+//  costs a wake up rather than a thread start, which matters when it runs
+//  every frame. Loops started from inside a loop body run inline.
+//
+//  Threads doing long background work (loading and baking assets) run
+//  their loops on a second pool of their own, so that the frame's loops
+//  neither wait behind them nor hold them up.
+//
+
+#include <cstddef>
+#include <functional>
+
+namespace ThreadPool {
+
+using namespace std;
+
+// Threads taking part in a loop, the calling thread included.
+//
+unsigned size();
+
+// Caps the threads taking part in the following loops of the calling
+// thread's pool (0 lifts the cap). Used to measure how the loops scale.
+//
+void setConcurrency(unsigned threads);
+
+// Runs body(begin, end) over [0, count) in chunks of grain items and
+// returns once all of them are done.
+//
+void parallelFor(size_t count, size_t grain, const function<void(size_t, size_t)>& body);
+
+// Runs the calling thread's loops on the background pool from now on.
+//
+void useBackgroundPool();
+}  // namespace ThreadPool
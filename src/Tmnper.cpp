@@ -7,10 +7,15 @@
 //
 
 #include "Tmnper.hpp"
+#include "AsyncSaver.hpp"
+#include "Log.h"
 #include "ofMain.h"
 
+#include <cstdio>
+
 /**
- * Saves the contents into a `.tmpr` file.
+ * Saves the contents into a `.tmpr` file. The contents are written into a
+ * scratch file first and renamed over the destination once complete.
  */
 using namespace std;
 bool Tmnper::saveIntoTmpr(string fileName, string contents, string extn) {
@@ -21,20 +26,28 @@ bool Tmnper::saveIntoTmpr(string fileName, string contents, string extn) {
   fileName = ofToDataPath(fileName);               // get the path to the enclosed dir -- prolly inside ../bin/data
   /* ------- Using openframework's filesystem utility -- wrapped over Boost ---  */
 
+  auto tmpName = partFileName(fileName);
+
   ofstream out;
 
   try {
-    out.open(fileName); /* --- open the file handle --- */
+    out.open(tmpName); /* --- open the file handle --- */
 
     out << contents << endl;
 
     if (out.is_open()) out.close(); /* ---- close the file handle------- */
 
-    return true;
+    if (!out) {
+      remove(tmpName.c_str()); /* ---- don't leave a half written file behind ---- */
+      return false;
+    }
+
+    return commitFile(tmpName, fileName);
 
   } catch (...) {
-    cout << "Failed to write the contents to disk -- tmpr file couldn't be created." << endl;
+    LOG_ERROR("Failed to write the contents to disk -- tmpr file couldn't be created.");
     if (out.is_open()) out.close();
+    remove(tmpName.c_str());
     return false;
   }
 }
@@ -65,7 +78,7 @@ string Tmnper::loadFromTmpr(string fileName, string extn) {
 
   } catch (...) {
     if (in.is_open()) in.close();
-    cout << "Couldn't load from the .tmpr file" << endl;
+    LOG_ERROR("Couldn't load from the .tmpr file");
     return string("");
   }
 }
@@ -34,24 +34,18 @@ bool rayIntersectPlane(const ofVec3f &rayPoint, const ofVec3f &raydir, const ofV
 //
 ofVec3f reflectVector(const ofVec3f &v, const ofVec3f &n) { return (v - 2 * v.dot(n) * n); }
 
-// Added by sidmishraw -----
-// Minimizes the vectors passed in and returns the vector with the minimum
-// of all the x, y, z coordinates.
-// For eg: if we pass in (1, 1, 0) and (1, 0, 1)
-// the minimized vector would be (1, 0, 0).
-//
-Vector3 minimize(const Vector3 &a, const Vector3 &b) {
-  return Vector3(a.x() <= b.x() ? a.x() : b.x(), a.y() <= b.y() ? a.y() : b.y(), a.z() <= b.z() ? a.z() : b.z());
+uint64_t fnv1a(const void *data, size_t bytes, uint64_t hash) {
+  auto p = (const unsigned char *)data;
+  for (size_t i = 0; i < bytes; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+  return hash;
 }
 
-// Added by sidmishraw -----
-// Maximizes the vectors passed in and returns the vector with the maximum
-// of all the x, y, z coordinates.
-// For eg: if we pass in (1, 1, 0) and (1, 0, 1)
-// the maximized vector would be (1, 1, 1).
-//
-Vector3 maximize(const Vector3 &a, const Vector3 &b) {
-  return Vector3(a.x() >= b.x() ? a.x() : b.x(), a.y() >= b.y() ? a.y() : b.y(), a.z() >= b.z() ? a.z() : b.z());
+uint64_t meshHash(const ofMesh &mesh) {
+  auto &vertices = mesh.getVertices();
+  auto &indices = mesh.getIndices();
+  uint64_t hash = fnv1a(vertices.data(), vertices.size() * sizeof(ofVec3f));
+  hash = fnv1a(indices.data(), indices.size() * sizeof(indices[0]), hash);
+  return hash;
 }
 
 // Added by sidmishraw ----
@@ -101,33 +95,20 @@ Box compose(Box &box1, Box &box2) {
 }
 
 void logBox(Box &box) {
-  cout << "Box --------" << endl;
-  cout << box.min().x() << ", " << box.min().y() << ", " << box.min().z() << endl;
-  cout << box.max().x() << ", " << box.max().y() << ", " << box.max().z() << endl;
-  cout << "------------" << endl;
+  LOG_DEBUG("Box -------- " << box.min().x() << ", " << box.min().y() << ", " << box.min().z() << " -> "
+                            << box.max().x() << ", " << box.max().y() << ", " << box.max().z());
 }
 
-void log(string msg, short int level) {
+void log(const string &msg, short int level) {
   switch (level) {
-    case 0: {
-      // debug mode
-      msg = "DEBUG :: " + msg;
-      break;
-    }
-    case 1: {
-      // info mode
-      msg = "INFO :: " + msg;
+    case 0:
+      LOG_DEBUG(msg);
       break;
-    }
-    case 2: {
-      // error mode
-      msg = "ERROR :: " + msg;
+    case 2:
+      LOG_ERROR(msg);
       break;
-    }
-    default: {
-      msg = "INFO :: " + msg;
+    default:
+      LOG_INFO(msg);
       break;
-    }
   }
-  cout << msg << endl;
 }
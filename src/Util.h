@@ -3,6 +3,7 @@
 
 #include "ofMain.h"
 
+#include "Log.h"
 #include "box.h"
 #include "ray.h"
 
@@ -16,6 +17,21 @@ ofVec3f reflectVector(const ofVec3f &v, const ofVec3f &normal);
 // Added by sidmishraw ----->
 //
 
+// Conversions between our Vector3 and openFrameworks' ofVec3f. Both are
+// 3 packed floats, so these compile down to plain copies.
+//
+inline ofVec3f toOf(const Vector3 &v) { return ofVec3f(v.x(), v.y(), v.z()); }
+inline Vector3 toVector3(const ofVec3f &v) { return Vector3(v.x, v.y, v.z); }
+
+// 64 bit FNV-1a hash of the bytes, continuing from hash.
+//
+uint64_t fnv1a(const void *data, size_t bytes, uint64_t hash = 14695981039346656037ull);
+
+// Hash of the mesh's vertices and indices (64 bit FNV-1a), used to tell
+// whether a cache file was made for this mesh.
+//
+uint64_t meshHash(const ofMesh &mesh);
+
 // Compose together Boxes to make a larger box bounding
 // all the smaller boxes.
 //
@@ -27,5 +43,8 @@ void logBox(Box &box);
 
 // -- added by sidmishraw
 // Logs the message to the console.
+// level: 0 - debug, 1 - info, 2 - error.
+// Prefer the LOG_* macros from Log.h, they skip formatting the message
+// when the level is disabled.
 //
-void log(string msg, short int level = 0);
+void log(const string &msg, short int level = 0);
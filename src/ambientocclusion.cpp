@@ -0,0 +1,216 @@
+//
+//  ambientocclusion.cpp
+//  martian-terrain
+//
+
+#include "ambientocclusion.h"
+#include "AsyncSaver.hpp"
+#include "Log.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include "bounds.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+// Header of the cache file, followed by count floats.
+//
+struct OcclusionHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t meshHash;
+  int32_t raysPerVertex;
+  float maxDistance;
+  uint32_t count;
+};
+
+static const char CACHE_MAGIC[4] = {'A', 'O', 'C', 'C'};
+static const uint32_t CACHE_VERSION = 1;
+
+// The mesh's normals, or area weighted ones from its triangles when it
+// has none.
+//
+static vector<ofVec3f> vertexNormals(const ofMesh &mesh) {
+  size_t n = mesh.getNumVertices();
+  if (mesh.getNumNormals() == n) return mesh.getNormals();
+
+  vector<ofVec3f> normals(n, ofVec3f(0, 0, 0));
+  auto &indices = mesh.getIndices();
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    ofVec3f a = mesh.getVertex(indices[t]), b = mesh.getVertex(indices[t + 1]), c = mesh.getVertex(indices[t + 2]);
+    ofVec3f area = (b - a).getCrossed(c - a);
+    for (int k = 0; k < 3; k++) normals[indices[t + k]] += area;
+  }
+  for (auto &normal : normals) {
+    // The terrain faces up; flip triangles wound the other way
+    //
+    if (normal.y < 0) normal = -normal;
+    normal = normal.lengthSquared() > 0 ? normal.getNormalized() : ofVec3f(0, 1, 0);
+  }
+  return normals;
+}
+
+// Cheap integer hash, for a repeatable angle per vertex.
+//
+static inline uint32_t hashIndex(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+AmbientOcclusion::AmbientOcclusion() : raysPerVertex(0), maxDistance(0), meshHash(0) { stats = {0, 0, 0}; }
+
+// The mesh's larger horizontal size.
+//
+static float horizontalExtent(const ofMesh &mesh) {
+  Box bounds = meshBounds(mesh);
+  return std::max(bounds.max().x() - bounds.min().x(), bounds.max().z() - bounds.min().z());
+}
+
+void AmbientOcclusion::bake(const ofMesh &mesh, const BVH &bvh, int rays, float distance) {
+  PROFILE_ZONE("ambient occlusion bake");
+  auto start = chrono::steady_clock::now();
+
+  size_t n = mesh.getNumVertices();
+  float extent = horizontalExtent(mesh);
+
+  raysPerVertex = std::max(rays, 1);
+  maxDistance = distance > 0 ? distance : extent / 10;
+  meshHash = ::meshHash(mesh);
+  occlusion.assign(n, 1);
+
+  // Rays start a little off the surface so they don't hit the triangles
+  // around their own vertex.
+  //
+  float offset = std::max(extent * 1e-4f, 1e-4f);
+  auto normals = vertexNormals(mesh);
+
+  // Cosine weighted directions around +Y on a golden angle spiral: equal
+  // areas of the disc below the hemisphere, lifted onto it.
+  //
+  const float goldenAngle = PI * (3 - sqrt(5.0f));
+  vector<float> radius(raysPerVertex), height(raysPerVertex);
+  for (int k = 0; k < raysPerVertex; k++) {
+    float u = (k + 0.5f) / raysPerVertex;
+    radius[k] = sqrt(u);
+    height[k] = sqrt(1 - u);
+  }
+
+  atomic<uint64_t> cast(0);
+  ThreadPool::parallelFor(n, GRAIN, [&](size_t begin, size_t end) {
+    uint64_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+      ofVec3f normal = normals[i];
+      ofVec3f tangent = (fabs(normal.x) < 0.9f ? ofVec3f(1, 0, 0) : ofVec3f(0, 0, 1)).getCrossed(normal);
+      tangent.normalize();
+      ofVec3f bitangent = normal.getCrossed(tangent);
+      ofVec3f origin = mesh.getVertex(i) + normal * offset;
+      float turn = hashIndex(i) * (TWO_PI / 4294967296.0f);
+
+      int open = 0;
+      for (int k = 0; k < raysPerVertex; k++) {
+        float phi = k * goldenAngle + turn;
+        ofVec3f direction = tangent * (radius[k] * cos(phi)) + bitangent * (radius[k] * sin(phi)) + normal * height[k];
+        Ray ray(toVector3(origin), toVector3(direction));
+        if (!bvh.occluded(ray, 0, maxDistance)) open++;
+      }
+      occlusion[i] = (float)open / raysPerVertex;
+      count += raysPerVertex;
+    }
+    cast += count;
+  });
+
+  stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  stats.rays = cast;
+  stats.threads = ThreadPool::size();
+  LOG_INFO("Ambient occlusion baked for " << n << " vertices, " << raysPerVertex << " rays each, in " << stats.ms
+                                          << " ms: " << stats.raysPerSecond() / 1e6 << " Mrays/s on "
+                                          << stats.threads << " threads");
+}
+
+void AmbientOcclusion::loadOrBake(const ofMesh &mesh, const BVH &bvh, const string &cacheFile, int rays,
+                                  float distance) {
+  // The settings bake() would use
+  //
+  rays = std::max(rays, 1);
+  if (distance <= 0) distance = horizontalExtent(mesh) / 10;
+
+  if (load(cacheFile, ::meshHash(mesh), rays, distance) && occlusion.size() == mesh.getNumVertices()) {
+    LOG_INFO("Ambient occlusion loaded from " << cacheFile);
+    return;
+  }
+
+  bake(mesh, bvh, rays, distance);
+  if (!save(cacheFile)) LOG_ERROR("Couldn't save the ambient occlusion to " << cacheFile);
+}
+
+bool AmbientOcclusion::save(const string &fileName) const {
+  auto path = ofToDataPath(fileName);
+  auto tmpName = Tmnper::partFileName(path);
+
+  // Zeroed first, so the padding goes to the file as zeros
+  //
+  OcclusionHeader header;
+  memset(&header, 0, sizeof(header));
+  copy(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic);
+  header.version = CACHE_VERSION;
+  header.meshHash = meshHash;
+  header.raysPerVertex = raysPerVertex;
+  header.maxDistance = maxDistance;
+  header.count = occlusion.size();
+
+  ofstream out(tmpName, ios::binary);
+  out.write((const char *)&header, sizeof(header));
+  out.write((const char *)occlusion.data(), occlusion.size() * sizeof(float));
+  out.close();
+
+  return out && Tmnper::commitFile(tmpName, path);
+}
+
+bool AmbientOcclusion::load(const string &fileName, uint64_t hash, int rays, float distance) {
+  ifstream in(ofToDataPath(fileName), ios::binary);
+  if (!in) return false;
+
+  OcclusionHeader header;
+  if (!in.read((char *)&header, sizeof(header))) return false;
+  if (!equal(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic) || header.version != CACHE_VERSION) return false;
+  if (header.meshHash != hash || header.raysPerVertex != rays || header.maxDistance != distance) return false;
+
+  vector<float> loaded(header.count);
+  if (!in.read((char *)loaded.data(), loaded.size() * sizeof(float))) return false;
+
+  meshHash = header.meshHash;
+  raysPerVertex = header.raysPerVertex;
+  maxDistance = header.maxDistance;
+  occlusion.swap(loaded);
+  return true;
+}
+
+void AmbientOcclusion::apply(SceneModel &model, int index, bool enable) const {
+  auto &part = model.parts[index];
+  if (!enable || occlusion.empty()) {
+    part.vbo.disableColors();
+    return;
+  }
+
+  // The lights take the vertex color as the material's, so it carries the
+  // diffuse color; a texture gets modulated by it.
+  //
+  ofFloatColor base = part.hasTexture() ? ofFloatColor(1, 1, 1) : part.material.getDiffuseColor();
+  vector<ofFloatColor> colors(occlusion.size());
+  for (size_t i = 0; i < occlusion.size(); i++) {
+    colors[i] = ofFloatColor(base.r * occlusion[i], base.g * occlusion[i], base.b * occlusion[i], base.a);
+  }
+  part.vbo.setColorData(colors.data(), colors.size(), GL_STATIC_DRAW);
+  part.vbo.enableColors();
+}
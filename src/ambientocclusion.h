@@ -0,0 +1,96 @@
+//
+//  ambientocclusion.h
+//  martian-terrain
+//
+
+#ifndef ambientocclusion_h
+#define ambientocclusion_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "bvh.h"
+#include "scenemodel.h"
+
+using namespace std;
+using namespace sidmishraw_octtree;
+
+//---------------------------------------------------------------
+// AmbientOcclusion bakes how open the sky is above every vertex of the
+// terrain: the cosine weighted fraction of the hemisphere around the
+// vertex normal that reaches maxDistance without hitting the terrain.
+// Crater floors and valley walls come out darker than ridges, which the
+// single light of the scene alone doesn't show.
+//
+// Every vertex casts raysPerVertex rays against the terrain BVH, spread
+// evenly over the hemisphere (a spiral turned by a different angle per
+// vertex, so neighbours don't band). The vertices are split across all
+// cores. Like the traversability map, the result is cached in a binary
+// file carrying the mesh's hash, so it is only baked again for a new
+// terrain.
+//
+class AmbientOcclusion {
+ public:
+  // Rays cast per vertex.
+  //
+  static const int DEFAULT_RAYS = 64;
+
+  // Vertices baked by a thread at a time.
+  //
+  static const int GRAIN = 64;
+
+  struct Stats {
+    double ms;
+    uint64_t rays;
+    unsigned threads;
+
+    double raysPerSecond() const { return ms > 0 ? rays / ms * 1000 : 0; }
+  };
+
+  AmbientOcclusion();
+
+  // ----------- OPERATIONS ------------------
+
+  // Bakes the occlusion of every vertex of the mesh, which the BVH was
+  // built over. Rays stop after maxDistance; with 0 it is a tenth of the
+  // mesh's larger horizontal size.
+  //
+  void bake(const ofMesh &mesh, const BVH &bvh, int raysPerVertex = DEFAULT_RAYS, float maxDistance = 0);
+
+  // Loads the occlusion from the cache file when it was baked for this
+  // mesh with these settings, bakes and saves it otherwise.
+  //
+  void loadOrBake(const ofMesh &mesh, const BVH &bvh, const string &cacheFile, int raysPerVertex = DEFAULT_RAYS,
+                  float maxDistance = 0);
+
+  // Binary cache. load() fails when the file was baked for another mesh,
+  // another number of rays or another ray length.
+  //
+  bool save(const string &fileName) const;
+  bool load(const string &fileName, uint64_t meshHash, int raysPerVertex, float maxDistance);
+
+  // Sets the model mesh's vertex colors to its material's diffuse color
+  // darkened by the occlusion, so drawFaces() shades with it, or (with
+  // enable false) takes them off again.
+  //
+  void apply(SceneModel &model, int index, bool enable = true) const;
+
+  bool isEmpty() const { return occlusion.empty(); }
+
+  // ----------- ATTRIBUTES -----------------
+
+  // Per vertex, 0 where every ray is blocked to 1 under open sky.
+  //
+  vector<float> occlusion;
+
+  int raysPerVertex;
+  float maxDistance;
+  uint64_t meshHash;
+
+  Stats stats;
+};
+
+#endif /* ambientocclusion_h */
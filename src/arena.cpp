@@ -0,0 +1,58 @@
+//
+//  arena.cpp
+//  martian-terrain
+//
+
+#include "arena.h"
+
+#include <cstdint>
+
+Arena::Arena(size_t blockSize)
+    : blockSize(blockSize), current(0), cursor(nullptr), end(nullptr), used(0), reserved(0), allocations(0) {}
+
+Arena::~Arena() { release(); }
+
+void *Arena::allocate(size_t bytes, size_t align) {
+  auto aligned = (char *)(((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1));
+  if (cursor == nullptr || aligned + bytes > end) {
+    nextBlock(bytes + align);
+    aligned = (char *)(((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1));
+  }
+  cursor = aligned + bytes;
+  used += bytes;
+  return aligned;
+}
+
+// Moves on to the next kept block that fits, or gets a new one.
+//
+void Arena::nextBlock(size_t bytes) {
+  size_t next = cursor == nullptr ? 0 : current + 1;
+  while (next < blocks.size() && blocks[next].size < bytes) next++;
+
+  if (next >= blocks.size()) {
+    size_t size = bytes > blockSize ? bytes : blockSize;
+    Block block = {(char *)::operator new(size), size};
+    allocations++;
+    reserved += size;
+    blocks.push_back(block);
+    next = blocks.size() - 1;
+  }
+
+  current = next;
+  cursor = blocks[current].data;
+  end = cursor + blocks[current].size;
+}
+
+void Arena::reset() {
+  current = 0;
+  cursor = nullptr;
+  end = nullptr;
+  used = 0;
+}
+
+void Arena::release() {
+  for (auto &block : blocks) ::operator delete(block.data);
+  blocks.clear();
+  reserved = 0;
+  reset();
+}
@@ -0,0 +1,92 @@
+//
+//  arena.h
+//  martian-terrain
+//
+
+#ifndef arena_h
+#define arena_h
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//---------------------------------------------------------------
+// Arena is a monotonic allocator: memory is handed out by bumping a cursor
+// through a few large blocks and is only ever given back all at once.
+//
+// Objects created in the arena never have their destructors run, so only
+// trivially destructible types may live in it. reset() rewinds the cursor
+// and keeps the blocks, so rebuilding a structure of the same size does
+// not touch the heap at all.
+//
+using namespace std;
+class Arena {
+ public:
+  // Size of the blocks requested from the heap; larger requests get a
+  // block of their own.
+  //
+  explicit Arena(size_t blockSize = 1 << 20);
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Returns uninitialized memory for bytes, aligned to align.
+  //
+  void* allocate(size_t bytes, size_t align = alignof(max_align_t));
+
+  // Creates a T in the arena.
+  //
+  template <class T, class... Args>
+  T* create(Args&&... args) {
+    static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Returns an uninitialized array of n T.
+  //
+  template <class T>
+  T* allocateArray(size_t n) {
+    static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+    return n == 0 ? nullptr : static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+  }
+
+  // Forgets everything allocated so far, keeping the blocks for reuse.
+  //
+  void reset();
+
+  // Frees all the blocks.
+  //
+  void release();
+
+  // Bytes handed out since the last reset.
+  //
+  size_t bytesUsed() const { return used; }
+
+  // Bytes held in blocks.
+  //
+  size_t bytesReserved() const { return reserved; }
+
+  // Number of heap allocations made since the arena was created.
+  //
+  size_t heapAllocations() const { return allocations; }
+
+ private:
+  struct Block {
+    char* data;
+    size_t size;
+  };
+
+  void nextBlock(size_t bytes);
+
+  size_t blockSize;
+  vector<Block> blocks;
+  size_t current;  // index of the block being filled
+  char* cursor;
+  char* end;
+  size_t used, reserved, allocations;
+};
+
+#endif /* arena_h */
@@ -0,0 +1,92 @@
+//
+//  assetloader.cpp
+//  martian-terrain
+//
+
+#include "assetloader.h"
+#include "Log.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+AssetLoader::AssetLoader() : bRunning(false), bStop(false) {
+  current = {"", "", 0, 0};
+  worker = thread(&AssetLoader::run, this);
+}
+
+AssetLoader::~AssetLoader() {
+  {
+    lock_guard<mutex> lock(mtx);
+    bStop = true;
+    jobs.clear();
+  }
+  cv.notify_one();
+  if (worker.joinable()) worker.join();
+}
+
+void AssetLoader::load(const string &name, Work work) {
+  {
+    lock_guard<mutex> lock(mtx);
+    jobs.emplace_back(name, move(work));
+  }
+  cv.notify_one();
+}
+
+int AssetLoader::poll() {
+  vector<Finish> steps;
+  {
+    lock_guard<mutex> lock(mtx);
+    steps.swap(finished);
+  }
+  for (auto &step : steps) step();
+
+  lock_guard<mutex> lock(mtx);
+  if (!bRunning && jobs.empty() && finished.empty()) current = {"", "", 0, 0};
+  return (int)steps.size();
+}
+
+AssetLoader::Progress AssetLoader::progress() const {
+  lock_guard<mutex> lock(mtx);
+  Progress p = current;
+  p.queued = jobs.size();
+  return p;
+}
+
+bool AssetLoader::isBusy() const {
+  lock_guard<mutex> lock(mtx);
+  return bRunning || !jobs.empty() || !finished.empty();
+}
+
+void AssetLoader::run() {
+  // Bakes and index builds shouldn't make the frame's loops wait
+  //
+  ThreadPool::useBackgroundPool();
+
+  while (true) {
+    pair<string, Work> job;
+    {
+      unique_lock<mutex> lock(mtx);
+      cv.wait(lock, [this] { return bStop || !jobs.empty(); });
+      if (bStop) return;
+      job = move(jobs.front());
+      jobs.pop_front();
+      current = {job.first, "", 0, 0};
+      bRunning = true;
+    }
+
+    auto start = ofGetElapsedTimeMillis();
+    Report report = [this](const string &step, float done) {
+      lock_guard<mutex> lock(mtx);
+      current.step = step;
+      current.done = done;
+    };
+    Finish finish = job.second(report);
+    LOG_INFO("Loaded " << job.first << " in the background in " << ofGetElapsedTimeMillis() - start << " ms");
+
+    lock_guard<mutex> lock(mtx);
+    current.step = "uploading";
+    current.done = 1;
+    if (finish) finished.push_back(move(finish));
+    bRunning = false;
+  }
+}
@@ -0,0 +1,82 @@
+//
+//  assetloader.h
+//  martian-terrain
+//
+
+#ifndef assetloader_h
+#define assetloader_h
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ofMain.h"
+
+using namespace std;
+
+//---------------------------------------------------------------
+// AssetLoader runs loading jobs on a background thread, one after the
+// other, so the app keeps drawing the scene it has while what is derived
+// from new assets is read from its caches or built.
+//
+// A job's work runs on the loader thread and returns what is left to do
+// on the GL thread: taking the new assets into the scene. poll() runs
+// those steps, once per frame, on the thread calling it. The work reports
+// how far it got, for the progress shown while loading.
+//
+class AssetLoader {
+ public:
+  // Reports the step a job is at and the fraction of it done.
+  //
+  using Report = function<void(const string &step, float done)>;
+  using Finish = function<void()>;
+  using Work = function<Finish(const Report &report)>;
+
+  struct Progress {
+    string job;   // empty when nothing is loading
+    string step;
+    float done;
+    size_t queued;  // jobs waiting behind it
+  };
+
+  AssetLoader();
+
+  // Lets the running job's work finish and drops the rest.
+  //
+  ~AssetLoader();
+
+  // ----------- OPERATIONS ------------------
+
+  // Queues a job. Its work must not touch what the GL thread uses; the
+  // step it returns (empty when there is nothing to do) may.
+  //
+  void load(const string &name, Work work);
+
+  // Runs the GL thread steps of the jobs done since the last call.
+  // Returns how many ran.
+  //
+  int poll();
+
+  Progress progress() const;
+
+  bool isBusy() const;
+
+ private:
+  void run();
+
+  thread worker;
+  mutable mutex mtx;
+  condition_variable cv;
+  deque<pair<string, Work>> jobs;
+  vector<Finish> finished;
+  Progress current;
+  bool bRunning;
+  bool bStop;
+};
+
+#endif /* assetloader_h */
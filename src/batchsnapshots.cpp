@@ -0,0 +1,83 @@
+//
+//  batchsnapshots.cpp
+//  martian-terrain
+//
+
+#include "batchsnapshots.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "ambientocclusion.h"
+#include "bvh.h"
+#include "meshorder.h"
+#include "scenemodel.h"
+#include "snapshot.h"
+
+#include <chrono>
+
+using namespace std;
+
+BatchSnapshots::BatchSnapshots(const string &terrain, const string &cache)
+    : terrainFile(terrain),
+      occlusionCache(cache),
+      bReorder(false),
+      bOcclusion(true),
+      maxLevel(5),
+      spacing(10),
+      eyeHeight(1),
+      fov(60),
+      width(640),
+      height(480) {}
+
+int BatchSnapshots::run(const vector<ofVec3f> &points, const string &prefix) {
+  PROFILE_ZONE("batch snapshots");
+  auto start = chrono::steady_clock::now();
+
+  if (points.size() < 2) {
+    LOG_ERROR("A path of at least two points is needed to render snapshots along it");
+    return 1;
+  }
+
+  ofMesh mesh;
+  if (!loadMesh(terrainFile, mesh)) {
+    LOG_ERROR("Couldn't load the terrain " << terrainFile);
+    return 1;
+  }
+  if (bReorder) reorderMesh(mesh);
+
+  BVH bvh;
+  bvh.generate(mesh, maxLevel);
+
+  AmbientOcclusion occlusion;
+  if (bOcclusion) occlusion.loadOrBake(mesh, bvh, occlusionCache);
+
+  ofPolyline path;
+  for (auto &p : points) path.curveTo(p);
+
+  // Encoded as they are rendered; a picture's threads are all busy with
+  // it, so there is no frame to overlap the encoding with
+  //
+  SnapshotRenderer renderer(bvh);
+  renderer.occlusion = bOcclusion ? &occlusion.occlusion : nullptr;
+  int failed = 0;
+  size_t count = renderer.renderAlongPath(path, spacing, eyeHeight, fov, width, height,
+                                          [&](size_t i, size_t, ofPixels &&pixels) {
+                                            string fileName = prefix + ofToString(i, 4, '0') + ".png";
+                                            if (!ofSaveImage(pixels, fileName)) {
+                                              LOG_ERROR("Couldn't save " << fileName);
+                                              failed++;
+                                            }
+                                          });
+
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  LOG_INFO(count - failed << " of " << count << " snapshots along the path saved in " << ms << " ms, "
+                          << (count == 0 ? 0 : renderer.stats.ms / count) << " ms per frame");
+  return failed == 0 ? 0 : 1;
+}
+
+bool BatchSnapshots::loadMesh(const string &fileName, ofMesh &mesh) {
+  PROFILE_ZONE("batch load mesh");
+  SceneModel model;
+  if (!model.read(fileName)) return false;
+  mesh = model.getMesh(0);
+  return mesh.getNumIndices() > 0;
+}
@@ -0,0 +1,56 @@
+//
+//  batchsnapshots.h
+//  martian-terrain
+//
+
+#ifndef batchsnapshots_h
+#define batchsnapshots_h
+
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+using namespace std;
+
+//---------------------------------------------------------------
+// BatchSnapshots renders the ray traced snapshots along a saved path with
+// no window and no GL context, e.g. on a build machine or over ssh (see
+// main.cpp).
+//
+// It reads the terrain mesh with SceneModel::read, which needs no GL
+// (only upload() does). Then it builds the terrain BVH, loads the
+// occlusion from its cache (or bakes it) and writes a PNG every spacing
+// along the path, as the app's 'M' key does.
+//
+class BatchSnapshots {
+ public:
+  BatchSnapshots(const string &terrainFile, const string &occlusionCache);
+
+  // ----------- OPERATIONS ------------------
+
+  // Renders the pictures along the path through the points into
+  // prefix0000.png, prefix0001.png, ... Returns the exit code for main().
+  //
+  int run(const vector<ofVec3f> &points, const string &prefix);
+
+  // ----------- ATTRIBUTES -----------------
+
+  string terrainFile;
+  string occlusionCache;
+
+  bool bReorder;     // put the mesh in spatial order first, as the app does
+  bool bOcclusion;   // darken the pictures with the baked occlusion
+  int maxLevel;      // of the BVH
+  float spacing;     // between pictures along the path
+  float eyeHeight;   // of the camera above the path
+  float fov;         // vertical, in degrees
+  int width, height;
+
+ private:
+  // Mesh 0 of the model file, or false when there is none.
+  //
+  static bool loadMesh(const string &fileName, ofMesh &mesh);
+};
+
+#endif /* batchsnapshots_h */
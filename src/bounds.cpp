@@ -0,0 +1,72 @@
+//
+//  bounds.cpp
+//  martian-terrain
+//
+
+#include "bounds.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// Reduces points [begin, end) into lo and hi.
+//
+static void reduceRange(const float *xyz, size_t begin, size_t end, Vector3A &outLo, Vector3A &outHi) {
+  // Locals, which the compiler keeps in registers
+  //
+  Vector3A lo = outLo, hi = outHi;
+  size_t i = begin;
+#ifdef VECTOR3_SSE
+  // A 4 wide load at a vertex picks up x, y, z and the next vertex's x in
+  // the last lane, which is zeroed; the last point of the whole array
+  // is left for the scalar tail so the load never reads past the end.
+  //
+  for (; i + 1 < end; i++) {
+    __m128 p = _mm_loadu_ps(xyz + 3 * i);
+    Vector3A v = fromSSE(_mm_shuffle_ps(p, _mm_unpackhi_ps(p, _mm_setzero_ps()), _MM_SHUFFLE(1, 0, 1, 0)));
+    lo = minimize(lo, v);
+    hi = maximize(hi, v);
+  }
+#endif
+  for (; i < end; i++) {
+    Vector3A v(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+    lo = minimize(lo, v);
+    hi = maximize(hi, v);
+  }
+  outLo = lo;
+  outHi = hi;
+}
+
+Box pointBounds(const float *xyz, size_t n) {
+  if (n == 0) return Box(Vector3(0, 0, 0), Vector3(0, 0, 0));
+
+  size_t chunks = n < PARALLEL_BOUNDS_THRESHOLD ? 1 : ThreadPool::size();
+
+  // Every chunk starts from the first point, so the partial bounds combine
+  // without special cases.
+  //
+  Vector3A first(xyz[0], xyz[1], xyz[2]);
+  vector<Vector3A> lo(chunks, first), hi(chunks, first);
+
+  size_t chunk = (n + chunks - 1) / chunks;
+  ThreadPool::parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      size_t from = std::min(n, t * chunk), to = std::min(n, from + chunk);
+      reduceRange(xyz, from, to, lo[t], hi[t]);
+    }
+  });
+
+  for (size_t t = 1; t < chunks; t++) {
+    lo[0] = minimize(lo[0], lo[t]);
+    hi[0] = maximize(hi[0], hi[t]);
+  }
+  return Box(lo[0].toVector3(), hi[0].toVector3());
+}
+
+Box meshBounds(const ofMesh &mesh) {
+  static_assert(sizeof(ofVec3f) == 3 * sizeof(float), "ofVec3f must be 3 packed floats");
+  auto &vertices = mesh.getVertices();
+  return pointBounds(vertices.empty() ? nullptr : &vertices[0].x, vertices.size());
+}
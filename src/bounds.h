@@ -0,0 +1,30 @@
+//
+//  bounds.h
+//  martian-terrain
+//
+
+#ifndef bounds_h
+#define bounds_h
+
+#include <cstddef>
+
+#include "ofMain.h"
+
+#include "box.h"
+
+// Vertex count above which the reduction is split across the thread pool.
+//
+const size_t PARALLEL_BOUNDS_THRESHOLD = 1 << 18;
+
+// Computes the axis aligned bounds of n points packed as x, y, z floats
+// (ofVec3f and Vector3 arrays both have this layout). Every axis updates
+// min and max independently. Large inputs are reduced in parallel, each
+// chunk with SIMD min/max on Vector3A. Returns an empty box at the origin when n is 0.
+//
+Box pointBounds(const float *xyz, size_t n);
+
+// Bounds of all the vertices in the mesh.
+//
+Box meshBounds(const ofMesh &mesh);
+
+#endif /* bounds_h */
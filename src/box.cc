@@ -13,19 +13,22 @@
  */
 
 bool Box::intersect(const Ray &r, float t0, float t1) const {
-  float tmin, tmax, tymin, tymax, tzmin, tzmax;
+  // Slab distances for all three axes up front, then a straight min/max
+  // reduction -- no early outs, so the compiler can keep it branch free.
+  //
+  float tmin = (parameters[r.sign(0)].x() - r.origin.x()) * r.inv_direction.x();
+  float tmax = (parameters[1 - r.sign(0)].x() - r.origin.x()) * r.inv_direction.x();
+  float tymin = (parameters[r.sign(1)].y() - r.origin.y()) * r.inv_direction.y();
+  float tymax = (parameters[1 - r.sign(1)].y() - r.origin.y()) * r.inv_direction.y();
+  float tzmin = (parameters[r.sign(2)].z() - r.origin.z()) * r.inv_direction.z();
+  float tzmax = (parameters[1 - r.sign(2)].z() - r.origin.z()) * r.inv_direction.z();
 
-  tmin = (parameters[r.sign[0]].x() - r.origin.x()) * r.inv_direction.x();
-  tmax = (parameters[1 - r.sign[0]].x() - r.origin.x()) * r.inv_direction.x();
-  tymin = (parameters[r.sign[1]].y() - r.origin.y()) * r.inv_direction.y();
-  tymax = (parameters[1 - r.sign[1]].y() - r.origin.y()) * r.inv_direction.y();
-  if ((tmin > tymax) || (tymin > tmax)) return false;
+  // Comparisons written so that a NaN slab (origin on the slab plane of an
+  // axis parallel ray) is ignored, like in the original test.
+  //
   if (tymin > tmin) tmin = tymin;
-  if (tymax < tmax) tmax = tymax;
-  tzmin = (parameters[r.sign[2]].z() - r.origin.z()) * r.inv_direction.z();
-  tzmax = (parameters[1 - r.sign[2]].z() - r.origin.z()) * r.inv_direction.z();
-  if ((tmin > tzmax) || (tzmin > tmax)) return false;
   if (tzmin > tmin) tmin = tzmin;
+  if (tymax < tmax) tmax = tymax;
   if (tzmax < tmax) tmax = tzmax;
-  return ((tmin < t1) && (tmax > t0));
+  return (tmin <= tmax) && (tmin < t1) && (tmax > t0);
 }
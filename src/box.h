@@ -17,20 +17,17 @@
 
 class Box {
  public:
-  Box() {}
-  Box(const Vector3 &min, const Vector3 &max) {
+  Box() = default;
+  Box(const Vector3 &min, const Vector3 &max) : parameters{min, max} {
     // assert(min < max);
-
-    parameters[0] = min;
-    parameters[1] = max;
   }
   // (t0, t1) is the interval for valid hits
   bool intersect(const Ray &, float t0, float t1) const;
 
   // corners
   Vector3 parameters[2];
-  Vector3 min() { return parameters[0]; }
-  Vector3 max() { return parameters[1]; }
+  const Vector3 &min() const { return parameters[0]; }
+  const Vector3 &max() const { return parameters[1]; }
 };
 
 #endif  // _BOX_H_
@@ -0,0 +1,542 @@
+//
+//  bvh.cpp
+//  martian-terrain
+//
+
+#include "bvh.h"
+#include "Profiler.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+
+using namespace sidmishraw_octtree;
+using namespace std;
+
+namespace {
+
+// Binary node used while building, collapsed into 4 wide nodes afterwards.
+//
+struct BuildNode {
+  Box box;
+  int left, right;  // children, -1 for leaves
+  int first, count;
+};
+
+// Per triangle data only needed during the build.
+//
+struct BuildPrim {
+  Box box;
+  Vector3 centroid;
+  uint32_t tri;
+};
+
+float surfaceArea(const Box &b) {
+  Vector3 d = b.max() - b.min();
+  return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+Box merge(const Box &a, const Box &b) { return Box(minimize(a.min(), b.min()), maximize(a.max(), b.max())); }
+
+Box emptyBox() { return Box(Vector3(FLT_MAX, FLT_MAX, FLT_MAX), Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX)); }
+
+class Builder {
+ public:
+  vector<BuildPrim> prims;
+  vector<BuildNode> nodes;
+
+  int build(int first, int count, int depth = 0) {
+    BuildNode node;
+    node.box = emptyBox();
+    Box centroids = emptyBox();
+    for (int i = first; i < first + count; i++) {
+      node.box = merge(node.box, prims[i].box);
+      centroids = merge(centroids, Box(prims[i].centroid, prims[i].centroid));
+    }
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+
+    int index = (int)nodes.size();
+    nodes.push_back(node);
+
+    if (count <= BVH::MAX_LEAF_SIZE || depth >= BVH::MAX_BUILD_DEPTH) return index;
+
+    // Binned SAH -- for each axis, bin the centroids and sweep the bins to
+    // find the cheapest split plane.
+    //
+    int bestAxis = -1, bestSplit = -1;
+    float bestCost = count * surfaceArea(node.box);  // cost of keeping a leaf
+
+    for (int axis = 0; axis < 3; axis++) {
+      float lo = centroids.min()[axis], hi = centroids.max()[axis];
+      if (hi - lo <= 0) continue;
+
+      Box binBox[BVH::SAH_BINS];
+      int binCount[BVH::SAH_BINS] = {0};
+      for (int b = 0; b < BVH::SAH_BINS; b++) binBox[b] = emptyBox();
+
+      float scale = BVH::SAH_BINS / (hi - lo);
+      for (int i = first; i < first + count; i++) {
+        int b = min(BVH::SAH_BINS - 1, (int)((prims[i].centroid[axis] - lo) * scale));
+        binCount[b]++;
+        binBox[b] = merge(binBox[b], prims[i].box);
+      }
+
+      // Right to left sweep for the right side areas, then left to right.
+      //
+      float rightArea[BVH::SAH_BINS];
+      int rightCount[BVH::SAH_BINS];
+      Box acc = emptyBox();
+      int n = 0;
+      for (int b = BVH::SAH_BINS - 1; b > 0; b--) {
+        acc = merge(acc, binBox[b]);
+        n += binCount[b];
+        rightArea[b] = n > 0 ? surfaceArea(acc) : 0;
+        rightCount[b] = n;
+      }
+
+      acc = emptyBox();
+      n = 0;
+      for (int b = 0; b < BVH::SAH_BINS - 1; b++) {
+        acc = merge(acc, binBox[b]);
+        n += binCount[b];
+        if (n == 0 || rightCount[b + 1] == 0) continue;
+        float cost = 0.125f * surfaceArea(node.box) + n * surfaceArea(acc) + rightCount[b + 1] * rightArea[b + 1];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = b;
+        }
+      }
+    }
+
+    if (bestAxis < 0) return index;  // no split is cheaper than the leaf
+
+    float lo = centroids.min()[bestAxis];
+    float scale = BVH::SAH_BINS / (centroids.max()[bestAxis] - lo);
+    auto mid = partition(prims.begin() + first, prims.begin() + first + count, [=](const BuildPrim &p) {
+      return min(BVH::SAH_BINS - 1, (int)((p.centroid[bestAxis] - lo) * scale)) <= bestSplit;
+    });
+    int leftCount = (int)(mid - (prims.begin() + first));
+
+    int left = build(first, leftCount, depth + 1);
+    int right = build(first + leftCount, count - leftCount, depth + 1);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+  }
+};
+
+// Collapses the binary node into the 4 wide node out[index], recursively.
+// Returns the levels of 4 wide nodes below it.
+//
+int collapse(const Builder &b, int binary, vector<BVH::Node> &out, int index) {
+  // Start from the two children and keep opening the inner child with the
+  // largest surface area until there are 4 slots.
+  //
+  vector<int> slots;
+  slots.push_back(b.nodes[binary].left);
+  slots.push_back(b.nodes[binary].right);
+  while (slots.size() < 4) {
+    int best = -1;
+    float bestArea = -1;
+    for (size_t i = 0; i < slots.size(); i++) {
+      auto &n = b.nodes[slots[i]];
+      if (n.left >= 0 && surfaceArea(n.box) > bestArea) {
+        bestArea = surfaceArea(n.box);
+        best = (int)i;
+      }
+    }
+    if (best < 0) break;
+    int opened = slots[best];
+    slots[best] = b.nodes[opened].left;
+    slots.push_back(b.nodes[opened].right);
+  }
+
+  int depth = 0;
+  for (int i = 0; i < 4; i++) {
+    BVH::Node &node = out[index];
+    if (i >= (int)slots.size()) {
+      // Empty slot -- an inverted box never passes the slab test.
+      //
+      node.minX[i] = node.minY[i] = node.minZ[i] = FLT_MAX;
+      node.maxX[i] = node.maxY[i] = node.maxZ[i] = -FLT_MAX;
+      node.child[i] = -1;
+      node.count[i] = 0;
+      continue;
+    }
+
+    auto &n = b.nodes[slots[i]];
+    node.minX[i] = n.box.min().x();
+    node.minY[i] = n.box.min().y();
+    node.minZ[i] = n.box.min().z();
+    node.maxX[i] = n.box.max().x();
+    node.maxY[i] = n.box.max().y();
+    node.maxZ[i] = n.box.max().z();
+
+    if (n.left < 0) {
+      node.child[i] = n.first;
+      node.count[i] = n.count;
+    } else {
+      int childIndex = (int)out.size();
+      out.push_back(BVH::Node());
+      out[index].child[i] = childIndex;
+      out[index].count[i] = 0;
+      depth = max(depth, 1 + collapse(b, slots[i], out, childIndex));
+    }
+  }
+  return depth;
+}
+
+// Moller-Trumbore ray/triangle test, t is the distance along the ray.
+//
+bool intersectTriangle(const BVH::Triangle &tri, const Ray &r, float &t) {
+  const float eps = 1e-9f;
+  Vector3 p = r.direction ^ tri.e2;
+  float det = tri.e1 * p;
+  if (fabs(det) < eps) return false;
+
+  float inv = 1 / det;
+  Vector3 s = r.origin - tri.v0;
+  float u = (s * p) * inv;
+  if (u < 0 || u > 1) return false;
+
+  Vector3 q = s ^ tri.e1;
+  float v = (r.direction * q) * inv;
+  if (v < 0 || u + v > 1) return false;
+
+  t = (tri.e2 * q) * inv;
+  return true;
+}
+
+// Slab test of the ray against the 4 boxes of a node. Sets bit i of the
+// result when box i is hit within (t0, t1), and its entry distance in tNear.
+// Written as a plain loop over the structure of arrays so that it compiles
+// to 4 wide SIMD.
+//
+int intersectNode(const BVH::Node &node, const Ray &r, float t0, float t1, float tNear[4]) {
+  const float *lo[3] = {node.minX, node.minY, node.minZ};
+  const float *hi[3] = {node.maxX, node.maxY, node.maxZ};
+  const float *nearX = r.sign(0) ? hi[0] : lo[0], *farX = r.sign(0) ? lo[0] : hi[0];
+  const float *nearY = r.sign(1) ? hi[1] : lo[1], *farY = r.sign(1) ? lo[1] : hi[1];
+  const float *nearZ = r.sign(2) ? hi[2] : lo[2], *farZ = r.sign(2) ? lo[2] : hi[2];
+
+  float ox = r.origin.x(), oy = r.origin.y(), oz = r.origin.z();
+  float ix = r.inv_direction.x(), iy = r.inv_direction.y(), iz = r.inv_direction.z();
+
+  // Start from (t0, t1) and narrow it axis by axis. A ray parallel to an
+  // axis starting exactly on a slab plane gives 0 * inf = NaN there; the
+  // comparisons are false for NaN, so that slab simply doesn't narrow it.
+  //
+  int mask = 0;
+  for (int i = 0; i < 4; i++) {
+    float tmin = t0, tmax = t1;
+    float txmin = (nearX[i] - ox) * ix;
+    float txmax = (farX[i] - ox) * ix;
+    float tymin = (nearY[i] - oy) * iy;
+    float tymax = (farY[i] - oy) * iy;
+    float tzmin = (nearZ[i] - oz) * iz;
+    float tzmax = (farZ[i] - oz) * iz;
+    if (txmin > tmin) tmin = txmin;
+    if (tymin > tmin) tmin = tymin;
+    if (tzmin > tmin) tmin = tzmin;
+    if (txmax < tmax) tmax = txmax;
+    if (tymax < tmax) tmax = tymax;
+    if (tzmax < tmax) tmax = tzmax;
+    tNear[i] = tmin;
+    mask |= (tmin <= tmax) << i;
+  }
+  return mask;
+}
+}  // namespace
+
+void BVH::generate(const ofMesh &mesh, int maxLevel) {
+  PROFILE_ZONE("bvh generate");
+
+  this->mesh = mesh;
+  MAX_DEPTH = maxLevel;
+  depth = 0;
+  nodes.clear();
+  triangles.clear();
+
+  auto &vertices = mesh.getVertices();
+  auto &indices = mesh.getIndices();
+  size_t numTris = indices.empty() ? vertices.size() / 3 : indices.size() / 3;
+
+  Builder builder;
+  builder.prims.reserve(numTris);
+  vector<Triangle> tris(numTris);
+  for (size_t i = 0; i < numTris; i++) {
+    uint32_t a = indices.empty() ? 3 * i : indices[3 * i];
+    uint32_t b = indices.empty() ? 3 * i + 1 : indices[3 * i + 1];
+    uint32_t c = indices.empty() ? 3 * i + 2 : indices[3 * i + 2];
+    Vector3 p0 = toVector3(vertices[a]), p1 = toVector3(vertices[b]), p2 = toVector3(vertices[c]);
+
+    tris[i].v0 = p0;
+    tris[i].e1 = p1 - p0;
+    tris[i].e2 = p2 - p0;
+    tris[i].index[0] = a;
+    tris[i].index[1] = b;
+    tris[i].index[2] = c;
+
+    BuildPrim prim;
+    prim.box = Box(minimize(p0, minimize(p1, p2)), maximize(p0, maximize(p1, p2)));
+    prim.centroid = (prim.box.min() + prim.box.max()) * 0.5f;
+    prim.tri = (uint32_t)i;
+    builder.prims.push_back(prim);
+  }
+
+  if (numTris == 0) return;
+
+  builder.build(0, (int)numTris);
+  bounds = builder.nodes[0].box;
+
+  // Leaves refer to ranges of the build order, store the triangles in it.
+  //
+  triangles.reserve(numTris);
+  for (auto &prim : builder.prims) triangles.push_back(tris[prim.tri]);
+
+  nodes.push_back(Node());
+  if (builder.nodes[0].left < 0) {
+    // The whole mesh fits a single leaf -- put it in the first slot.
+    //
+    Node &root = nodes[0];
+    for (int i = 0; i < 4; i++) {
+      root.minX[i] = root.minY[i] = root.minZ[i] = FLT_MAX;
+      root.maxX[i] = root.maxY[i] = root.maxZ[i] = -FLT_MAX;
+      root.child[i] = -1;
+      root.count[i] = 0;
+    }
+    root.minX[0] = bounds.min().x();
+    root.minY[0] = bounds.min().y();
+    root.minZ[0] = bounds.min().z();
+    root.maxX[0] = bounds.max().x();
+    root.maxY[0] = bounds.max().y();
+    root.maxZ[0] = bounds.max().z();
+    root.child[0] = 0;
+    root.count[0] = (int)numTris;
+  } else {
+    depth = collapse(builder, 0, nodes, 0);
+  }
+  assert(3 * depth + 1 <= STACK_SIZE);
+}
+
+int BVH::intersect(const Ray &r, float t0, float t1, float &t) const {
+  if (nodes.empty()) return -1;
+
+  int hit = -1;
+  float closest = t1;
+
+  int stack[STACK_SIZE];
+  int sp = 0;
+  stack[sp++] = 0;
+
+  while (sp > 0) {
+    const Node &node = nodes[stack[--sp]];
+
+    float tNear[4];
+    int mask = intersectNode(node, r, t0, closest, tNear);
+
+    // Visit the nearer children first: push them farthest first.
+    //
+    int order[4], n = 0;
+    for (int i = 0; i < 4; i++) {
+      if (mask & (1 << i)) order[n++] = i;
+    }
+    sort(order, order + n, [&tNear](int a, int b) { return tNear[a] > tNear[b]; });
+
+    for (int k = 0; k < n; k++) {
+      int i = order[k];
+      if (node.count[i] > 0) {
+        for (int j = node.child[i]; j < node.child[i] + node.count[i]; j++) {
+          float tt;
+          if (intersectTriangle(triangles[j], r, tt) && tt > t0 && tt < closest) {
+            closest = tt;
+            hit = j;
+          }
+        }
+      } else if (node.child[i] >= 0) {
+        stack[sp++] = node.child[i];
+      }
+    }
+  }
+
+  t = closest;
+  return hit;
+}
+
+void BVH::intersect(const Ray *rays, int n, float t0, float t1, int *hits, float *t) const {
+  n = std::min(n, MAX_PACKET);
+  for (int i = 0; i < n; i++) {
+    hits[i] = -1;
+    t[i] = t1;
+  }
+  if (nodes.empty()) return;
+
+  // A node goes on the stack with the range of rays [first, last) that
+  // hit its box: the rays outside it missed the box, so they miss
+  // everything below it too.
+  //
+  struct Entry {
+    int node;
+    int first, last;
+  };
+  Entry stack[STACK_SIZE];
+  int sp = 0;
+  stack[sp++] = {0, 0, n};
+
+  uint8_t masks[MAX_PACKET];
+  while (sp > 0) {
+    Entry entry = stack[--sp];
+    const Node &node = nodes[entry.node];
+
+    // Every ray against the 4 boxes, keeping for each box the range of
+    // rays and the nearest entry distance of the rays hitting it.
+    //
+    int first[4] = {n, n, n, n}, last[4] = {0, 0, 0, 0};
+    float nearest[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+    for (int r = entry.first; r < entry.last; r++) {
+      float tNear[4];
+      int mask = intersectNode(node, rays[r], t0, t[r], tNear);
+      masks[r] = (uint8_t)mask;
+      for (int i = 0; i < 4; i++) {
+        if (!(mask & (1 << i))) continue;
+        if (first[i] == n) first[i] = r;
+        last[i] = r + 1;
+        nearest[i] = std::min(nearest[i], tNear[i]);
+      }
+    }
+
+    // Nearer children first, as in the single ray intersect().
+    //
+    int order[4], count = 0;
+    for (int i = 0; i < 4; i++) {
+      if (first[i] < n) order[count++] = i;
+    }
+    sort(order, order + count, [&nearest](int a, int b) { return nearest[a] > nearest[b]; });
+
+    for (int k = 0; k < count; k++) {
+      int i = order[k];
+      if (node.count[i] > 0) {
+        for (int r = first[i]; r < last[i]; r++) {
+          if (!(masks[r] & (1 << i))) continue;
+          for (int j = node.child[i]; j < node.child[i] + node.count[i]; j++) {
+            float tt;
+            if (intersectTriangle(triangles[j], rays[r], tt) && tt > t0 && tt < t[r]) {
+              t[r] = tt;
+              hits[r] = j;
+            }
+          }
+        }
+      } else if (node.child[i] >= 0) {
+        stack[sp++] = {node.child[i], first[i], last[i]};
+      }
+    }
+  }
+}
+
+bool BVH::occluded(const Ray &r, float t0, float t1) const {
+  if (nodes.empty()) return false;
+
+  int stack[STACK_SIZE];
+  int sp = 0;
+  stack[sp++] = 0;
+
+  while (sp > 0) {
+    const Node &node = nodes[stack[--sp]];
+
+    float tNear[4];
+    int mask = intersectNode(node, r, t0, t1, tNear);
+
+    for (int i = 0; i < 4; i++) {
+      if (!(mask & (1 << i))) continue;
+      if (node.count[i] > 0) {
+        for (int j = node.child[i]; j < node.child[i] + node.count[i]; j++) {
+          float tt;
+          if (intersectTriangle(triangles[j], r, tt) && tt > t0 && tt < t1) return true;
+        }
+      } else if (node.child[i] >= 0) {
+        stack[sp++] = node.child[i];
+      }
+    }
+  }
+
+  return false;
+}
+
+void BVH::overlap(const Box &box, vector<int> &out) const {
+  if (nodes.empty()) return;
+
+  const Vector3 &lo = box.min(), &hi = box.max();
+
+  int stack[STACK_SIZE];
+  int sp = 0;
+  stack[sp++] = 0;
+
+  while (sp > 0) {
+    const Node &node = nodes[stack[--sp]];
+
+    for (int i = 0; i < 4; i++) {
+      if (node.child[i] < 0) continue;
+      if (node.minX[i] > hi.x() || node.maxX[i] < lo.x() || node.minY[i] > hi.y() || node.maxY[i] < lo.y() ||
+          node.minZ[i] > hi.z() || node.maxZ[i] < lo.z()) {
+        continue;
+      }
+      if (node.count[i] > 0) {
+        for (int j = node.child[i]; j < node.child[i] + node.count[i]; j++) out.push_back(j);
+      } else {
+        stack[sp++] = node.child[i];
+      }
+    }
+  }
+}
+
+shared_ptr<MaybePoint> BVH::search(const Ray &r, float t0, float t1) {
+  PROFILE_ZONE("bvh search");
+
+  auto p = make_shared<MaybePoint>();
+
+  // Only hits in front of the ray's origin count for picking.
+  //
+  float t;
+  int hit = intersect(r, max(t0, 0.0f), t1, t);
+  if (hit < 0) return p;
+
+  // Snap to the closest vertex of the hit triangle.
+  //
+  Vector3 point = r.origin + r.direction * t;
+  auto &tri = triangles[hit];
+  float best = FLT_MAX;
+  for (int i = 0; i < 3; i++) {
+    auto v = mesh.getVertex(tri.index[i]);
+    float d = (toVector3(v) - point).length();
+    if (d < best) {
+      best = d;
+      p->set(v);
+    }
+  }
+  return p;
+}
+
+void BVH::renderNode(int index, int depth) {
+  if (depth > MAX_DEPTH) return;
+
+  auto &node = nodes[index];
+  ofSetColor(ofColor::white);
+  for (int i = 0; i < 4; i++) {
+    if (node.child[i] < 0) continue;
+    Vector3 min(node.minX[i], node.minY[i], node.minZ[i]);
+    Vector3 max(node.maxX[i], node.maxY[i], node.maxZ[i]);
+    Vector3 size = max - min;
+    ofDrawBox(toOf(size / 2 + min), size.x(), size.y(), size.z());
+    if (node.count[i] == 0) renderNode(node.child[i], depth + 1);
+  }
+}
+
+void BVH::render() {
+  if (!nodes.empty()) renderNode(0, 0);
+}
+
+size_t BVH::memoryUsage() const { return nodes.capacity() * sizeof(Node) + triangles.capacity() * sizeof(Triangle); }
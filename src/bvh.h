@@ -0,0 +1,142 @@
+//
+//  bvh.h
+//  martian-terrain
+//
+
+#ifndef bvh_h
+#define bvh_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "box.h"
+#include "ray.h"
+#include "spatialindex.h"
+
+namespace sidmishraw_octtree {
+
+//---------------------------------------------------------------
+// BVH is a bounding volume hierarchy over the terrain's triangles, an
+// alternative to the OctTree for ray queries.
+//
+// It is built top down with the binned surface area heuristic, then the
+// binary tree is collapsed into 4 wide nodes whose child boxes are stored
+// as structure of arrays, so one node visit tests all four boxes at once.
+//
+// Unlike the OctTree, which only indexes vertices, the BVH finds the
+// closest triangle hit by the ray. search() then returns the vertex of
+// that triangle nearest to the hit point, so callers get the same snapped
+// vertices they get from the OctTree.
+//
+using namespace std;
+class BVH : public SpatialIndex {
+ public:
+  // The most triangles in a leaf.
+  //
+  static const int MAX_LEAF_SIZE = 4;
+
+  // Number of bins along an axis tried by the SAH build.
+  //
+  static const int SAH_BINS = 12;
+
+  // The deepest the build splits; the triangles still together there stay
+  // in one leaf, however many. It bounds the traversal stacks: a visit
+  // pops one node and pushes at most 4, so STACK_SIZE covers any tree.
+  //
+  static const int MAX_BUILD_DEPTH = 64;
+  static const int STACK_SIZE = 3 * MAX_BUILD_DEPTH + 1;
+
+  // A 4 wide node. For each of the 4 slots:
+  // count == 0 and child >= 0 - inner node, child is the node index
+  // count > 0                  - leaf, child is the first triangle index
+  // child < 0                  - empty slot
+  //
+  struct alignas(16) Node {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    int32_t child[4];
+    int32_t count[4];
+  };
+
+  // Triangle with its edges precomputed for the Moller-Trumbore test.
+  //
+  struct Triangle {
+    Vector3 v0, e1, e2;
+    uint32_t index[3];  // mesh vertex indices
+  };
+
+  // ----------- ATTRIBUTES -----------------
+
+  // Max depth to render.
+  //
+  int MAX_DEPTH;
+
+  // Root bounds.
+  //
+  Box bounds;
+
+  // Levels of 4 wide nodes below the root.
+  //
+  int depth;
+
+  // The 4 wide nodes, the root is nodes[0].
+  //
+  vector<Node> nodes;
+
+  // Triangles, ordered so that every leaf is a contiguous range.
+  //
+  vector<Triangle> triangles;
+
+  // The mesh for which this BVH is being generated.
+  //
+  ofMesh mesh;
+
+  // ----------- OPERATIONS ------------------
+
+  void generate(const ofMesh& mesh, int maxLevel) override;
+
+  void render() override;
+
+  shared_ptr<MaybePoint> search(const Ray& r, float t0, float t1) override;
+
+  size_t memoryUsage() const override;
+
+  string name() const override { return "bvh4"; }
+
+  // Finds the closest triangle hit by r within (t0, t1). Returns the index
+  // into triangles, or -1, and the hit distance in t.
+  //
+  int intersect(const Ray& r, float t0, float t1, float& t) const;
+
+  // The most rays traced together by the packet intersect().
+  //
+  static const int MAX_PACKET = 64;
+
+  // intersect() for a packet of n <= MAX_PACKET rays, which should be
+  // coherent (e.g. neighbouring camera rays): the packet walks the tree
+  // once, visiting the nodes any of its rays hits, instead of every ray
+  // walking it on its own. Fills hits[i] and t[i] for every ray like
+  // intersect() does.
+  //
+  void intersect(const Ray* rays, int n, float t0, float t1, int* hits, float* t) const;
+
+  // True when any triangle is hit within (t0, t1). Stops at the first hit
+  // found, so it is cheaper than intersect() for visibility queries.
+  //
+  bool occluded(const Ray& r, float t0, float t1) const;
+
+  // Appends the triangles whose leaf boxes overlap the box to out (indices
+  // into triangles). A broad phase: the triangles themselves may miss it.
+  //
+  void overlap(const Box& box, vector<int>& out) const;
+
+ private:
+  void renderNode(int node, int depth);
+};
+
+}  // namespace sidmishraw_octtree
+
+#endif /* bvh_h */
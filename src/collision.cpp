@@ -0,0 +1,126 @@
+//
+//  collision.cpp
+//  martian-terrain
+//
+
+#include "collision.h"
+#include "Profiler.h"
+#include "Util.h"
+
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+
+OrientedBox OrientedBox::fromBox(const Box &box, const ofMatrix4x4 &transform) {
+  ofVec3f lo = toOf(box.min()), hi = toOf(box.max());
+
+  ofVec3f origin = lo * transform;
+  ofVec3f edges[3] = {ofVec3f(hi.x, lo.y, lo.z) * transform - origin, ofVec3f(lo.x, hi.y, lo.z) * transform - origin,
+                      ofVec3f(lo.x, lo.y, hi.z) * transform - origin};
+
+  OrientedBox obb;
+  obb.center = (lo + hi) / 2 * transform;
+  for (int i = 0; i < 3; i++) {
+    float length = edges[i].length();
+    obb.half[i] = length / 2;
+    obb.axis[i] = length > 0 ? edges[i] / length : ofVec3f(i == 0, i == 1, i == 2);
+  }
+  return obb;
+}
+
+Box OrientedBox::bounds() const {
+  ofVec3f extent;
+  for (int k = 0; k < 3; k++) {
+    extent[k] = fabs(axis[0][k]) * half[0] + fabs(axis[1][k]) * half[1] + fabs(axis[2][k]) * half[2];
+  }
+  return Box(toVector3(center - extent), toVector3(center + extent));
+}
+
+// Projections of the triangle and the box onto axis don't overlap.
+//
+static bool separated(const OrientedBox &box, const ofVec3f v[3], const ofVec3f &axis) {
+  if (axis.lengthSquared() < 1e-12f) return false;  // parallel edges, covered by other axes
+
+  float p0 = v[0].dot(axis), p1 = v[1].dot(axis), p2 = v[2].dot(axis);
+  float r = box.half[0] * fabs(box.axis[0].dot(axis)) + box.half[1] * fabs(box.axis[1].dot(axis)) +
+            box.half[2] * fabs(box.axis[2].dot(axis));
+  return std::min(std::min(p0, p1), p2) > r || std::max(std::max(p0, p1), p2) < -r;
+}
+
+bool intersects(const OrientedBox &box, const ofVec3f &a, const ofVec3f &b, const ofVec3f &c) {
+  // In the box's frame of reference (origin at its center)
+  //
+  ofVec3f v[3] = {a - box.center, b - box.center, c - box.center};
+  ofVec3f e[3] = {v[1] - v[0], v[2] - v[1], v[0] - v[2]};
+
+  // 3 box faces, the triangle's plane and the 9 edge / edge axes
+  //
+  for (int i = 0; i < 3; i++) {
+    if (separated(box, v, box.axis[i])) return false;
+  }
+  if (separated(box, v, e[0].getCrossed(e[1]))) return false;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      if (separated(box, v, box.axis[i].getCrossed(e[j]))) return false;
+    }
+  }
+  return true;
+}
+
+int collide(const BVH &bvh, const OrientedBox &box, vector<int> &scratch, bool first) {
+  PROFILE_ZONE("collide");
+
+  scratch.clear();
+  bvh.overlap(box.bounds(), scratch);
+
+  auto &vertices = bvh.mesh.getVertices();
+  int hits = 0;
+  for (int index : scratch) {
+    auto &tri = bvh.triangles[index];
+    if (intersects(box, vertices[tri.index[0]], vertices[tri.index[1]], vertices[tri.index[2]])) {
+      hits++;
+      if (first) break;
+    }
+  }
+  return hits;
+}
+
+GroundContact solveGroundContact(const BVH &bvh, const Footprint &footprint, const ofVec3f &position,
+                                 const ofVec3f &heading, float probe) {
+  GroundContact contact;
+
+  ofVec3f forward(heading.x, 0, heading.z);
+  forward.normalize();
+  if (forward.lengthSquared() == 0) forward = ofVec3f(0, 0, -1);
+  ofVec3f left = ofVec3f(0, 1, 0).getCrossed(forward);
+
+  const float side[4] = {1, -1, 1, -1};  // left / right
+  const float ahead[4] = {1, 1, -1, -1};  // front / rear
+
+  ofVec3f down(0, -1, 0);
+  for (int i = 0; i < 4; i++) {
+    ofVec3f wheel = position + left * (side[i] * footprint.halfTrack) + forward * (ahead[i] * footprint.halfBase);
+
+    Ray ray(toVector3(ofVec3f(wheel.x, position.y + probe, wheel.z)), toVector3(down));
+    float t;
+    contact.grounded[i] = bvh.intersect(ray, 0, 2 * probe, t) >= 0;
+    wheel.y = contact.grounded[i] ? position.y + probe - t : position.y + footprint.bottom;
+    contact.wheels[i] = wheel;
+  }
+
+  auto &w = contact.wheels;
+
+  // Plane through the diagonals; for four points not on one plane this is
+  // the plane the rover rocks onto on average.
+  //
+  contact.normal = (w[0] - w[3]).getCrossed(w[1] - w[2]);
+  if (contact.normal.y < 0) contact.normal = -contact.normal;
+  contact.normal.normalize();
+
+  contact.height = (w[0].y + w[1].y + w[2].y + w[3].y) / 4;
+  contact.pitch = ofRadToDeg(atan2((w[0].y + w[1].y - w[2].y - w[3].y) / 2, 2 * footprint.halfBase));
+  contact.roll = ofRadToDeg(atan2((w[0].y + w[2].y - w[1].y - w[3].y) / 2, 2 * footprint.halfTrack));
+
+  return contact;
+}
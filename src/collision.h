@@ -0,0 +1,87 @@
+//
+//  collision.h
+//  martian-terrain
+//
+
+#ifndef collision_h
+#define collision_h
+
+#include <vector>
+
+#include "ofMain.h"
+
+#include "box.h"
+#include "bvh.h"
+
+using namespace std;
+using namespace sidmishraw_octtree;
+
+//---------------------------------------------------------------
+// OrientedBox is a box with arbitrary orientation: a center, three unit
+// axes and the half extents along them.
+//
+struct OrientedBox {
+  ofVec3f center;
+  ofVec3f axis[3];
+  float half[3];
+
+  // The model space box moved into world space by transform (in the
+  // openFrameworks row vector convention, v * transform).
+  //
+  static OrientedBox fromBox(const Box &box, const ofMatrix4x4 &transform);
+
+  // World space axis aligned bounds of the oriented box.
+  //
+  Box bounds() const;
+};
+
+// Separating axis test of an oriented box against the triangle (a, b, c).
+//
+bool intersects(const OrientedBox &box, const ofVec3f &a, const ofVec3f &b, const ofVec3f &c);
+
+// Checks the oriented box against the terrain: the BVH narrows the
+// triangles down to the ones near the box, each is then tested exactly.
+// Returns the number of triangles touched; with first set it stops at the
+// first one. scratch is reused between calls to keep this allocation free.
+//
+int collide(const BVH &bvh, const OrientedBox &box, vector<int> &scratch, bool first = true);
+
+//---------------------------------------------------------------
+// Where a four wheeled rover rests on the terrain.
+//
+// The footprint is the rectangle spanned by the wheels around the rover's
+// position: halfTrack to either side, halfBase to the front and back, and
+// bottom is the height of the wheels' bottom relative to the position
+// (negative when below it).
+//
+struct Footprint {
+  float halfTrack;
+  float halfBase;
+  float bottom;
+};
+
+struct GroundContact {
+  // Wheel contact points: front left, front right, rear left, rear right.
+  //
+  ofVec3f wheels[4];
+  bool grounded[4];
+
+  // Terrain plane under the rover, through the mean of the contacts.
+  //
+  ofVec3f normal;
+  float height;
+
+  // Degrees, nose up and left side up positive.
+  //
+  float pitch;
+  float roll;
+};
+
+// Drops the wheels of a rover at position, facing heading, onto the terrain
+// (rays cast down from probe above the position) and fits the plane they
+// rest on. Wheels that miss the terrain stay at the rover's height.
+//
+GroundContact solveGroundContact(const BVH &bvh, const Footprint &footprint, const ofVec3f &position,
+                                 const ofVec3f &heading, float probe = 10);
+
+#endif /* collision_h */
@@ -0,0 +1,273 @@
+//
+//  compactocttree.cpp
+//  martian-terrain
+//
+
+#include "compactocttree.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "Util.h"
+#include "bounds.h"
+
+#include <cfloat>
+
+using namespace sidmishraw_octtree;
+using namespace std;
+
+static_assert(sizeof(CompactOctTree::Node) == 8, "compact octree nodes are 8 bytes");
+
+static inline bool inside(const Box &box, const ofVec3f &p) {
+  auto &lo = box.min(), &hi = box.max();
+  return p.x >= lo.x() && p.x <= hi.x() && p.y >= lo.y() && p.y <= hi.y() && p.z >= lo.z() && p.z <= hi.z();
+}
+
+// The child for octant i: the children of the octants below it in the
+// mask come first.
+//
+static inline uint32_t childOf(const CompactOctTree::Node &node, int i) {
+  return node.first + __builtin_popcount(node.childMask & ((1u << i) - 1));
+}
+
+void CompactOctTree::generate(const ofMesh &mesh, int maxLevel) {
+  PROFILE_ZONE("compact octree generate");
+
+  MAX_DEPTH = maxLevel;
+  nodes.clear();
+  points.clear();
+  indices.clear();
+  thePoint.clear();
+
+  size_t n = mesh.getNumVertices();
+  if (n > MAX_POINTS) {
+    LOG_ERROR("Compact octree: " << n << " vertices, more than the " << MAX_POINTS << " it can hold");
+    n = 0;
+  }
+
+  bounds = meshBounds(mesh);
+  indices.resize(n);
+  for (uint32_t i = 0; i < n; i++) indices[i] = i;
+
+  nodes.push_back(Node());
+  subdivide(0, bounds, 0, n, 0, mesh);
+  nodes.shrink_to_fit();
+  vector<uint32_t>().swap(scratch);
+
+  points.resize(n);
+  for (size_t i = 0; i < n; i++) points[i] = mesh.getVertex(indices[i]);
+
+  LOG_DEBUG("Compact octree: " << nodes.size() << " nodes, " << memoryUsage() / 1024 << " KiB");
+}
+
+void CompactOctTree::subdivide(uint32_t node, const Box &box, uint32_t first, uint32_t count, int depth,
+                               const ofMesh &mesh) {
+  // Split like the OctTree does
+  //
+  if (count <= OctTree::LEAF_SIZE || depth >= OctTree::MAX_TREE_DEPTH) {
+    nodes[node].first = first;
+    nodes[node].childMask = 0;
+    nodes[node].count = count;
+    return;
+  }
+
+  Box b[8];
+  octants(box, b);
+
+  // Sort the points by octant; a point on a boundary goes with the first
+  // octant holding it.
+  //
+  scratch.resize(2 * count);
+  uint32_t *octant = scratch.data(), *sorted = scratch.data() + count;
+  uint32_t start[9] = {0};
+  for (uint32_t i = 0; i < count; i++) {
+    ofVec3f p = mesh.getVertex(indices[first + i]);
+    int o = 0;
+    while (o < 7 && !inside(b[o], p)) o++;
+    octant[i] = o;
+    start[o + 1]++;
+  }
+  for (int o = 0; o < 8; o++) start[o + 1] += start[o];
+  uint32_t next[8];
+  copy(start, start + 8, next);
+  for (uint32_t i = 0; i < count; i++) sorted[next[octant[i]]++] = indices[first + i];
+  copy(sorted, sorted + count, indices.begin() + first);
+
+  uint32_t mask = 0;
+  for (int o = 0; o < 8; o++) {
+    if (start[o + 1] > start[o]) mask |= 1u << o;
+  }
+  uint32_t firstChild = nodes.size();
+  nodes.resize(firstChild + __builtin_popcount(mask));
+  nodes[node].first = firstChild;
+  nodes[node].childMask = mask;
+  nodes[node].count = count;
+
+  for (int o = 0; o < 8; o++) {
+    if (mask & (1u << o)) {
+      subdivide(childOf(nodes[node], o), b[o], first + start[o], start[o + 1] - start[o], depth + 1, mesh);
+    }
+  }
+}
+
+void CompactOctTree::renderNode(uint32_t index, const Box &box, int depth) {
+  if (depth > MAX_DEPTH) return;
+
+  Vector3 size = box.max() - box.min();
+  ofDrawBox(toOf(size / 2 + box.min()), size.x(), size.y(), size.z());
+
+  auto node = nodes[index];
+  if (node.childMask == 0) return;
+  Box b[8];
+  octants(box, b);
+  for (int o = 0; o < 8; o++) {
+    if (node.childMask & (1u << o)) renderNode(childOf(node, o), b[o], depth + 1);
+  }
+}
+
+void CompactOctTree::render() {
+  ofSetColor(ofColor::white);
+  if (!nodes.empty() && nodes[0].count > 0) renderNode(0, bounds, 0);
+
+  if (thePoint.isPresent()) {
+    ofSetColor(ofColor::cyan);
+    ofDrawSphere(thePoint.get(), 0.25);
+  }
+}
+
+shared_ptr<MaybePoint> CompactOctTree::search(const Ray &r, float t0, float t1) {
+  PROFILE_ZONE("compact octree search");
+
+  thePoint.clear();
+  auto p = make_shared<MaybePoint>();
+  if (nodes.empty() || nodes[0].count == 0) return p;
+
+  ofVec3f origin = toOf(r.origin), direction = toOf(r.direction).getNormalized();
+  float best = FLT_MAX;
+  int bestPoint = -1;
+
+  // The boxes are worked out on the way down, so they go on the stack with
+  // the nodes. A node pushes at most 8 children.
+  //
+  struct Entry {
+    uint32_t node;
+    Box box;
+  };
+  Entry stack[8 * (OctTree::MAX_TREE_DEPTH + 1)];
+  int top = 0;
+  stack[top++] = {0, bounds};
+  while (top > 0) {
+    Entry entry = stack[--top];
+    if (!entry.box.intersect(r, t0, t1)) continue;
+
+    auto node = nodes[entry.node];
+    if (node.childMask == 0) {
+      // Squared distance of the points from the ray's line
+      //
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        ofVec3f v = points[i] - origin;
+        float along = v.dot(direction);
+        float d = v.lengthSquared() - along * along;
+        if (d < best) {
+          best = d;
+          bestPoint = i;
+        }
+      }
+      continue;
+    }
+
+    Box b[8];
+    octants(entry.box, b);
+    for (int o = 7; o >= 0; o--) {
+      if (node.childMask & (1u << o)) stack[top++] = {childOf(node, o), b[o]};
+    }
+  }
+
+  if (bestPoint >= 0) {
+    thePoint.set(points[bestPoint]);
+    p->set(points[bestPoint]);
+  }
+  return p;
+}
+
+size_t CompactOctTree::memoryUsage() const {
+  return nodes.capacity() * sizeof(Node) + points.capacity() * sizeof(ofVec3f) +
+         (indices.capacity() + scratch.capacity()) * sizeof(uint32_t);
+}
+
+// Appends the vertex indices of the points within the box below the node,
+// whose points start at first.
+//
+static void pointsInBox(const CompactOctTree &tree, uint32_t index, const Box &nodeBox, uint32_t first,
+                        const Box &box, vector<int> &out) {
+  auto node = tree.nodes[index];
+  auto &lo = box.min(), &hi = box.max();
+  auto &nodeLo = nodeBox.min(), &nodeHi = nodeBox.max();
+  if (nodeLo.x() > hi.x() || nodeHi.x() < lo.x() || nodeLo.y() > hi.y() || nodeHi.y() < lo.y() ||
+      nodeLo.z() > hi.z() || nodeHi.z() < lo.z()) {
+    return;
+  }
+
+  if (nodeLo.x() >= lo.x() && nodeHi.x() <= hi.x() && nodeLo.y() >= lo.y() && nodeHi.y() <= hi.y() &&
+      nodeLo.z() >= lo.z() && nodeHi.z() <= hi.z()) {
+    out.insert(out.end(), tree.indices.begin() + first, tree.indices.begin() + first + node.count);
+    return;
+  }
+
+  if (node.childMask == 0) {
+    for (uint32_t i = first; i < first + node.count; i++) {
+      if (inside(box, tree.points[i])) out.push_back(tree.indices[i]);
+    }
+    return;
+  }
+
+  Box b[8];
+  octants(nodeBox, b);
+  for (int o = 0; o < 8; o++) {
+    if (!(node.childMask & (1u << o))) continue;
+    uint32_t child = childOf(node, o);
+    pointsInBox(tree, child, b[o], first, box, out);
+    first += tree.nodes[child].count;
+  }
+}
+
+// Same for the frustum.
+//
+static void pointsInFrustum(const CompactOctTree &tree, uint32_t index, const Box &nodeBox, uint32_t first,
+                            const Frustum &frustum, vector<int> &out) {
+  auto node = tree.nodes[index];
+  auto overlap = frustum.classify(nodeBox);
+  if (overlap == Frustum::OUTSIDE) return;
+  if (overlap == Frustum::INSIDE) {
+    out.insert(out.end(), tree.indices.begin() + first, tree.indices.begin() + first + node.count);
+    return;
+  }
+
+  if (node.childMask == 0) {
+    for (uint32_t i = first; i < first + node.count; i++) {
+      if (frustum.contains(tree.points[i])) out.push_back(tree.indices[i]);
+    }
+    return;
+  }
+
+  Box b[8];
+  octants(nodeBox, b);
+  for (int o = 0; o < 8; o++) {
+    if (!(node.childMask & (1u << o))) continue;
+    uint32_t child = childOf(node, o);
+    pointsInFrustum(tree, child, b[o], first, frustum, out);
+    first += tree.nodes[child].count;
+  }
+}
+
+int CompactOctTree::queryBox(const Box &box, vector<int> &out) const {
+  PROFILE_ZONE("compact octree queryBox");
+  out.clear();
+  if (!nodes.empty() && nodes[0].count > 0) pointsInBox(*this, 0, bounds, 0, box, out);
+  return (int)out.size();
+}
+
+int CompactOctTree::queryFrustum(const Frustum &frustum, vector<int> &out) const {
+  PROFILE_ZONE("compact octree queryFrustum");
+  out.clear();
+  if (!nodes.empty() && nodes[0].count > 0) pointsInFrustum(*this, 0, bounds, 0, frustum, out);
+  return (int)out.size();
+}
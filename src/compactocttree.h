@@ -0,0 +1,114 @@
+//
+//  compactocttree.h
+//  martian-terrain
+//
+
+#ifndef compactocttree_h
+#define compactocttree_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "box.h"
+#include "frustum.h"
+#include "octtree.h"
+#include "ray.h"
+#include "spatialindex.h"
+
+namespace sidmishraw_octtree {
+
+//---------------------------------------------------------------
+// CompactOctTree is the OctTree's subdivision in 8 bytes per node, for
+// terrains too large for the OctTree to stay in cache (or in memory).
+//
+// The children of a node are always the octants of its box, so no node
+// stores a box: only the root's bounds are kept, and the boxes are worked
+// out from them on the way down. A node keeps a mask of the octants that
+// have points (empty ones are left out), where its children start and how
+// many points it holds. The children of a node are next to each other, so
+// the child for octant i is the one after the children for the octants
+// below i in the mask.
+//
+// The points are kept in depth first order, each once, and every subtree
+// holds a contiguous range of them. The tree is built once and doesn't
+// take updates; regenerate it after editing the mesh.
+//
+using namespace std;
+class CompactOctTree : public SpatialIndex {
+ public:
+  // Most points the tree can hold, bounded by the node's point count.
+  //
+  static const uint32_t MAX_POINTS = (1u << 24) - 1;
+
+  struct Node {
+    uint32_t first;          // first child, or first point for leaves
+    uint32_t childMask : 8;  // octants with children, 0 for leaves
+    uint32_t count : 24;     // points in the subtree
+  };
+
+  CompactOctTree() : MAX_DEPTH(0) {}
+
+  // ----------- ATTRIBUTES -----------------
+
+  // Max depth to render.
+  //
+  int MAX_DEPTH;
+
+  // The root's bounds.
+  //
+  Box bounds;
+
+  // The root is nodes[0].
+  //
+  vector<Node> nodes;
+
+  // The points in depth first order, and the vertex index each came from.
+  //
+  vector<ofVec3f> points;
+  vector<uint32_t> indices;
+
+  // The point selected and to render as a sphere's center.
+  //
+  MaybePoint thePoint;
+
+  // ----------- OPERATIONS ------------------
+
+  void generate(const ofMesh& mesh, int maxLevel) override;
+
+  void render() override;
+
+  // The vertex nearest to the ray among the leaves it passes through.
+  //
+  shared_ptr<MaybePoint> search(const Ray& r, float t0, float t1) override;
+
+  size_t memoryUsage() const override;
+
+  string name() const override { return "compact octree"; }
+
+  // Like the OctTree range queries: fill out with the vertex indices
+  // within the box or the frustum (in the tree's order) and return how
+  // many there are.
+  //
+  int queryBox(const Box& box, vector<int>& out) const;
+
+  int queryFrustum(const Frustum& frustum, vector<int>& out) const;
+
+ private:
+  // Makes node a leaf or gives it children for the points
+  // indices[first, first + count) within box.
+  //
+  void subdivide(uint32_t node, const Box& box, uint32_t first, uint32_t count, int depth, const ofMesh& mesh);
+
+  void renderNode(uint32_t node, const Box& box, int depth);
+
+  // Scratch for sorting a node's points into its octants.
+  //
+  vector<uint32_t> scratch;
+};
+
+}  // namespace sidmishraw_octtree
+
+#endif /* compactocttree_h */
@@ -0,0 +1,275 @@
+//
+//  fleet.cpp
+//  martian-terrain
+//
+
+#include "fleet.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+// Instanced rendering with the transforms in a uniform array: GLSL 1.20
+// with ARB_draw_instanced, so it runs on the legacy contexts the app is
+// created with. The lighting is a single fixed directional light, and a
+// textured mesh is its color times the texture, as the fixed pipeline
+// modulates them.
+//
+static const string FLEET_VERTEX_SHADER = R"(#version 120
+#extension GL_ARB_draw_instanced : require
+
+uniform mat4 instances[BATCH];
+uniform mat4 meshTransform;
+
+varying float shade;
+varying vec2 uv;
+
+void main() {
+  uv = gl_MultiTexCoord0.xy;
+  mat4 model = instances[gl_InstanceIDARB] * meshTransform;
+  vec3 normal = normalize(mat3(model) * gl_Normal);
+  shade = 0.3 + 0.7 * max(dot(normal, normalize(vec3(0.3, 1.0, 0.2))), 0.0);
+  gl_Position = gl_ModelViewProjectionMatrix * (model * gl_Vertex);
+}
+)";
+
+static const string FLEET_FRAGMENT_SHADER = R"(#version 120
+
+uniform vec4 color;
+uniform sampler2D tex;
+uniform float textured;
+
+varying float shade;
+varying vec2 uv;
+
+void main() {
+  vec4 c = textured > 0.5 ? color * texture2D(tex, uv) : color;
+  gl_FragColor = vec4(c.rgb * shade, c.a);
+}
+)";
+
+// Lanes the rovers are spread over, centered on the route.
+//
+static const int LANES = 5;
+
+RoverFleet::RoverFleet() : routeLength(0), bUser(false), bShaderTried(false) {
+  footprint = {0, 0, 0};
+  stats = {0, 0};
+}
+
+void RoverFleet::setModel(const SceneModel &model) {
+  meshes.clear();
+  meshTransforms.clear();
+  meshColors.clear();
+  meshTextures.clear();
+  for (auto &part : model.parts) {
+    meshes.push_back(ofVboMesh(part.mesh));
+    meshTransforms.push_back(part.matrix);
+    meshColors.push_back(part.material.getDiffuseColor());
+    meshTextures.push_back(part.hasTexture() ? model.textures[part.texture].texture : ofTexture());
+  }
+
+  // The model is scaled and flipped about Z; the rovers are then turned
+  // and tilted in world space.
+  //
+  auto scale = model.getScale();
+  modelBase = ofMatrix4x4::newScaleMatrix(scale.x, scale.y, scale.z) * ofMatrix4x4::newRotationMatrix(180, 0, 0, 1);
+}
+
+void RoverFleet::setRoute(const ofPolyline &path, float spacing) {
+  auto resampled = path.getResampledBySpacing(spacing);
+
+  route.clear();
+  routeDistance.clear();
+  routeLength = 0;
+  for (auto &p : resampled.getVertices()) {
+    if (!route.empty()) routeLength += route.back().distance(p);
+    route.push_back(p);
+    routeDistance.push_back(routeLength);
+  }
+}
+
+void RoverFleet::spawn(int count, float speed, float laneWidth) {
+  if (route.size() < 2 || count <= 0) return;
+
+  size_t first = size();
+  size_t n = first + count;
+  distance.resize(n);
+  this->speed.resize(n);
+  lane.resize(n);
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  yaw.resize(n);
+  pitch.resize(n);
+  roll.resize(n);
+  grounded.resize(n);
+  transforms.resize(n);
+
+  // Spread along the route, cycling through the lanes: the middle one,
+  // then alternately left and right of it.
+  //
+  for (size_t i = first; i < n; i++) {
+    int k = i - first;
+    int slot = i % LANES;
+    distance[i] = routeLength * k / count;
+    this->speed[i] = speed * ofRandom(0.8f, 1.2f);
+    lane[i] = laneWidth * ((slot + 1) / 2) * (slot % 2 ? 1 : -1);
+  }
+}
+
+void RoverFleet::placeUser(const ofVec3f &position, const ofVec3f &forward, const GroundContact &contact) {
+  if (!bUser) {
+    distance.insert(distance.begin(), 0);
+    speed.insert(speed.begin(), 0);
+    lane.insert(lane.begin(), 0);
+    x.insert(x.begin(), 0);
+    y.insert(y.begin(), 0);
+    z.insert(z.begin(), 0);
+    yaw.insert(yaw.begin(), 0);
+    pitch.insert(pitch.begin(), 0);
+    roll.insert(roll.begin(), 0);
+    grounded.insert(grounded.begin(), 0);
+    transforms.insert(transforms.begin(), ofMatrix4x4());
+    bUser = true;
+  }
+  place(0, position, forward, contact);
+}
+
+void RoverFleet::clear() {
+  size_t n = bUser ? 1 : 0;
+  distance.resize(n);
+  speed.resize(n);
+  lane.resize(n);
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  yaw.resize(n);
+  pitch.resize(n);
+  roll.resize(n);
+  grounded.resize(n);
+  transforms.resize(n);
+}
+
+void RoverFleet::sample(float d, ofVec3f &point, ofVec3f &direction) const {
+  size_t i = upper_bound(routeDistance.begin(), routeDistance.end(), d) - routeDistance.begin();
+  i = std::min(std::max<size_t>(i, 1), route.size() - 1);
+
+  auto &a = route[i - 1], &b = route[i];
+  float length = routeDistance[i] - routeDistance[i - 1];
+  float t = length > 0 ? ofClamp((d - routeDistance[i - 1]) / length, 0, 1) : 0;
+  point = a + (b - a) * t;
+
+  direction = ofVec3f(b.x - a.x, 0, b.z - a.z);
+  if (direction.lengthSquared() > 0)
+    direction.normalize();
+  else
+    direction = ofVec3f(0, 0, -1);
+}
+
+void RoverFleet::step(size_t i, const BVH &bvh, float dt) {
+  float d = fmod(distance[i] + speed[i] * dt, routeLength);
+  if (d < 0) d += routeLength;
+  distance[i] = d;
+
+  ofVec3f p, forward;
+  sample(d, p, forward);
+  p += ofVec3f(forward.z, 0, -forward.x) * lane[i];  // up x forward, to the left
+
+  place(i, p, forward, solveGroundContact(bvh, footprint, p, forward));
+}
+
+void RoverFleet::place(size_t i, ofVec3f p, const ofVec3f &forward, const GroundContact &contact) {
+  p.y = contact.height - footprint.bottom;
+
+  x[i] = p.x;
+  y[i] = p.y;
+  z[i] = p.z;
+  yaw[i] = ofRadToDeg(atan2(-forward.x, -forward.z));
+  pitch[i] = contact.pitch;
+  roll[i] = contact.roll;
+  grounded[i] = contact.grounded[0] && contact.grounded[1] && contact.grounded[2] && contact.grounded[3];
+
+  // Turned to the heading, tilted onto the ground plane, then moved into
+  // place.
+  //
+  ofMatrix4x4 tilt;
+  ofVec3f axis = ofVec3f(0, 1, 0).getCrossed(contact.normal);
+  float angle = ofRadToDeg(asin(ofClamp(axis.length(), 0, 1)));
+  if (angle > 1e-3f) tilt = ofMatrix4x4::newRotationMatrix(angle, axis.getNormalized());
+
+  transforms[i] = ofMatrix4x4::newRotationMatrix(yaw[i], 0, 1, 0) * tilt * ofMatrix4x4::newTranslationMatrix(p);
+}
+
+void RoverFleet::tick(const BVH &bvh, float dt) {
+  size_t first = bUser ? 1 : 0;
+  if (size() == first || route.size() < 2 || routeLength <= 0) return;
+
+  PROFILE_ZONE("fleet tick");
+  auto start = chrono::steady_clock::now();
+
+  ThreadPool::parallelFor(size() - first, GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = first + begin; i < first + end; i++) step(i, bvh, dt);
+  });
+
+  stats.tickMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  stats.threads = ThreadPool::size();
+}
+
+void RoverFleet::setupShader() {
+  bShaderTried = true;
+
+  string vertexShader = FLEET_VERTEX_SHADER;
+  ofStringReplace(vertexShader, "BATCH", ofToString(int(BATCH)));
+
+  if (!shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader) ||
+      !shader.setupShaderFromSource(GL_FRAGMENT_SHADER, FLEET_FRAGMENT_SHADER) || !shader.linkProgram()) {
+    LOG_INFO("Instanced rover shader unavailable, drawing the fleet one rover at a time");
+    shader.unload();
+  }
+}
+
+void RoverFleet::draw() { draw(transforms); }
+
+void RoverFleet::draw(const vector<ofMatrix4x4> &placements, ofPolyRenderMode mode) {
+  if (placements.empty() || meshes.empty()) return;
+
+  PROFILE_ZONE("fleet draw");
+  if (!bShaderTried) setupShader();
+
+  if (shader.isLoaded()) {
+    shader.begin();
+    for (size_t m = 0; m < meshes.size(); m++) {
+      auto &c = meshColors[m];
+      bool textured = meshTextures[m].isAllocated();
+      shader.setUniformMatrix4f("meshTransform", meshTransforms[m] * modelBase);
+      shader.setUniform4f("color", c.r, c.g, c.b, c.a);
+      shader.setUniform1f("textured", textured ? 1 : 0);
+      if (textured) shader.setUniformTexture("tex", meshTextures[m], 0);
+      for (size_t first = 0; first < placements.size(); first += BATCH) {
+        int count = std::min<size_t>(BATCH, placements.size() - first);
+        shader.setUniformMatrix4f("instances", placements[first], count);
+        meshes[m].drawInstanced(mode, count);
+      }
+    }
+    shader.end();
+  } else {
+    for (size_t i = 0; i < placements.size(); i++) {
+      for (size_t m = 0; m < meshes.size(); m++) {
+        bool textured = meshTextures[m].isAllocated();
+        ofPushMatrix();
+        ofMultMatrix(meshTransforms[m] * modelBase * placements[i]);
+        ofSetColor(meshColors[m]);
+        if (textured) meshTextures[m].bind();
+        meshes[m].draw(mode);
+        if (textured) meshTextures[m].unbind();
+        ofPopMatrix();
+      }
+    }
+  }
+}
@@ -0,0 +1,154 @@
+//
+//  fleet.h
+//  martian-terrain
+//
+
+#ifndef fleet_h
+#define fleet_h
+
+#include <vector>
+
+#include "ofMain.h"
+
+#include "bvh.h"
+#include "collision.h"
+#include "scenemodel.h"
+
+using namespace std;
+using namespace sidmishraw_octtree;
+
+//---------------------------------------------------------------
+// Many rovers driving along a route over the same terrain.
+//
+// The rover state is kept as one array per field, so a tick streams
+// through just the fields it touches. A tick updates the rovers in
+// parallel: each one moves along the route in its own lane and rests on
+// its wheels against the terrain BVH, which the tick only reads, so the
+// rovers need no locking and the cost splits evenly across cores.
+//
+// All the rovers share one copy of the rover model's meshes and textures
+// and are drawn with a draw call per mesh (per BATCH rovers), the
+// per-rover transforms going to the GPU as a uniform array.
+//
+// The user's rover, once placed, is slot 0. It is placed by placeUser()
+// from where it is driven along the path rather than moved along the
+// route by tick(), and is drawn and posed from its transform like the
+// others.
+//
+class RoverFleet {
+ public:
+  // Rovers drawn by one instanced draw call, bounded by the uniform space
+  // of the vertex shader.
+  //
+  static const int BATCH = 64;
+
+  // Rovers updated by a thread at a time.
+  //
+  static const int GRAIN = 16;
+
+  RoverFleet();
+
+  // Takes a copy of the model's meshes for drawing, and shares its
+  // textures. After the model's upload().
+  //
+  void setModel(const SceneModel &model);
+
+  // The model transform of a rover at a placement: the model's scale and
+  // flip, then the placement.
+  //
+  ofMatrix4x4 modelMatrix(const ofMatrix4x4 &placement) const { return modelBase * placement; }
+
+  // The rovers' wheels, for resting them on the terrain.
+  //
+  Footprint footprint;
+
+  // The path the rovers drive along, resampled every spacing units. The
+  // rovers keep their distance along it.
+  //
+  void setRoute(const ofPolyline &path, float spacing = 0.5f);
+
+  // Adds count rovers spread along the route, driving at around speed
+  // units per second in lanes laneWidth apart.
+  //
+  void spawn(int count, float speed, float laneWidth);
+
+  // Places the user's rover at position facing forward, resting on the
+  // contact, making room for it in slot 0 the first time.
+  //
+  void placeUser(const ofVec3f &position, const ofVec3f &forward, const GroundContact &contact);
+
+  // Removes the rovers spawned, keeping the user's.
+  //
+  void clear();
+
+  size_t size() const { return distance.size(); }
+  bool hasUser() const { return bUser; }
+
+  // Moves every rover but the user's dt seconds further along the route.
+  //
+  void tick(const BVH &bvh, float dt);
+
+  // Draws every rover, instanced when the GPU allows it; or draws the
+  // model at each of the placements, as transforms holds them.
+  //
+  void draw();
+  void draw(const vector<ofMatrix4x4> &placements, ofPolyRenderMode mode = OF_MESH_FILL);
+
+  struct Stats {
+    double tickMs;
+    unsigned threads;
+  } stats;
+
+  // Per rover state.
+  //
+  vector<float> distance;  // along the route
+  vector<float> speed;     // units per second
+  vector<float> lane;      // sideways offset from the route, left positive
+  vector<float> x, y, z;   // position, on the wheels
+  vector<float> yaw;       // degrees about Y from facing -Z
+  vector<float> pitch;     // degrees, nose up positive
+  vector<float> roll;      // degrees, left side up positive
+  vector<char> grounded;   // every wheel found the terrain
+
+  // Where each rover stands: its heading, tilt and position, without the
+  // model's own scale and flip. In the order they are drawn.
+  //
+  vector<ofMatrix4x4> transforms;
+
+ private:
+  // Point and flat unit direction of the route at distance d.
+  //
+  void sample(float d, ofVec3f &point, ofVec3f &direction) const;
+
+  // Moves rover i.
+  //
+  void step(size_t i, const BVH &bvh, float dt);
+
+  // Sets rover i's state and transform for standing at p facing forward,
+  // resting on the contact.
+  //
+  void place(size_t i, ofVec3f p, const ofVec3f &forward, const GroundContact &contact);
+
+  void setupShader();
+
+  vector<ofVec3f> route;
+  vector<float> routeDistance;  // at each route point
+  float routeLength;
+
+  // The model's meshes, their transforms inside the model, their colors
+  // and textures (unallocated for none), and the part of the model
+  // transform shared by every rover.
+  //
+  vector<ofVboMesh> meshes;
+  vector<ofMatrix4x4> meshTransforms;
+  vector<ofFloatColor> meshColors;
+  vector<ofTexture> meshTextures;
+  ofMatrix4x4 modelBase;
+
+  bool bUser;
+
+  ofShader shader;
+  bool bShaderTried;
+};
+
+#endif /* fleet_h */
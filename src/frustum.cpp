@@ -0,0 +1,74 @@
+//
+//  frustum.cpp
+//  martian-terrain
+//
+
+#include "frustum.h"
+#include "Util.h"
+
+// The plane through a, b and c, facing the inside point.
+//
+static Plane planeThrough(const ofVec3f &a, const ofVec3f &b, const ofVec3f &c, const ofVec3f &inside) {
+  Plane plane;
+  plane.normal = (b - a).getCrossed(c - a).getNormalized();
+  plane.d = -plane.normal.dot(a);
+  if (plane.distance(inside) < 0) {
+    plane.normal = -plane.normal;
+    plane.d = -plane.d;
+  }
+  return plane;
+}
+
+Frustum Frustum::fromScreenRect(const ofCamera &cam, const ofRectangle &rect, const ofRectangle &viewport) {
+  ofRectangle view = viewport.width > 0 ? viewport : ofGetCurrentViewport();
+
+  // The rectangle's corners on the near (depth -1) and the far (depth 1)
+  // plane: left top, right top, right bottom, left bottom.
+  //
+  float x[4] = {rect.x, rect.x + rect.width, rect.x + rect.width, rect.x};
+  float y[4] = {rect.y, rect.y, rect.y + rect.height, rect.y + rect.height};
+  ofVec3f n[4], f[4], center;
+  for (int i = 0; i < 4; i++) {
+    n[i] = cam.screenToWorld(ofVec3f(x[i], y[i], -1), view);
+    f[i] = cam.screenToWorld(ofVec3f(x[i], y[i], 1), view);
+    center += (n[i] + f[i]) / 8;
+  }
+
+  // Each plane is turned to face the center, so the winding of the
+  // corners (which flips with the rectangle's) doesn't matter.
+  //
+  Frustum frustum;
+  frustum.planes[0] = planeThrough(n[0], n[1], n[2], center);
+  frustum.planes[1] = planeThrough(f[0], f[1], f[2], center);
+  for (int i = 0; i < 4; i++) frustum.planes[2 + i] = planeThrough(n[i], n[(i + 1) % 4], f[i], center);
+  return frustum;
+}
+
+Frustum Frustum::fromCamera(const ofCamera &cam, const ofRectangle &viewport) {
+  ofRectangle view = viewport.width > 0 ? viewport : ofGetCurrentViewport();
+  return fromScreenRect(cam, view, view);
+}
+
+bool Frustum::contains(const ofVec3f &p) const {
+  for (auto &plane : planes) {
+    if (plane.distance(p) < 0) return false;
+  }
+  return true;
+}
+
+Frustum::Overlap Frustum::classify(const Box &box) const {
+  ofVec3f lo = toOf(box.min()), hi = toOf(box.max());
+
+  Overlap overlap = INSIDE;
+  for (auto &plane : planes) {
+    // The corners furthest along and against the plane's normal
+    //
+    ofVec3f far(plane.normal.x >= 0 ? hi.x : lo.x, plane.normal.y >= 0 ? hi.y : lo.y,
+                plane.normal.z >= 0 ? hi.z : lo.z);
+    ofVec3f near(plane.normal.x >= 0 ? lo.x : hi.x, plane.normal.y >= 0 ? lo.y : hi.y,
+                 plane.normal.z >= 0 ? lo.z : hi.z);
+    if (plane.distance(far) < 0) return OUTSIDE;
+    if (plane.distance(near) < 0) overlap = INTERSECTS;
+  }
+  return overlap;
+}
@@ -0,0 +1,52 @@
+//
+//  frustum.h
+//  martian-terrain
+//
+
+#ifndef frustum_h
+#define frustum_h
+
+#include "ofMain.h"
+
+#include "box.h"
+
+//---------------------------------------------------------------
+// A plane, the points p with normal.dot(p) + d >= 0 on its inner side.
+//
+struct Plane {
+  ofVec3f normal;
+  float d;
+
+  float distance(const ofVec3f &p) const { return normal.dot(p) + d; }
+};
+
+//---------------------------------------------------------------
+// Frustum is the convex volume inside six planes: near, far and the four
+// sides, seen through a camera or a rectangle on the screen.
+//
+struct Frustum {
+  Plane planes[6];
+
+  // How a box lies relative to the frustum.
+  //
+  enum Overlap { OUTSIDE, INTERSECTS, INSIDE };
+
+  // The volume seen by the camera through the rectangle of the viewport
+  // (in screen coordinates, y down), between its near and far planes.
+  //
+  static Frustum fromScreenRect(const ofCamera &cam, const ofRectangle &rect,
+                                const ofRectangle &viewport = ofRectangle());
+
+  // The camera's whole view.
+  //
+  static Frustum fromCamera(const ofCamera &cam, const ofRectangle &viewport = ofRectangle());
+
+  bool contains(const ofVec3f &p) const;
+
+  // Conservative: a box near a corner of the frustum may be reported as
+  // intersecting while it is outside.
+  //
+  Overlap classify(const Box &box) const;
+};
+
+#endif /* frustum_h */
@@ -0,0 +1,400 @@
+//
+//  linearoctree.cpp
+//  martian-terrain
+//
+
+#include "linearoctree.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include "bounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+
+using namespace sidmishraw_octtree;
+using namespace std;
+using namespace std::chrono;
+
+// Spreads the low 21 bits of x two bits apart: bit i moves to bit 3i.
+//
+static inline uint64_t spreadBits(uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+// The inverse of spreadBits.
+//
+static inline uint32_t compactBits(uint64_t x) {
+  x &= 0x1249249249249249ULL;
+  x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3ULL;
+  x = (x ^ (x >> 4)) & 0x100f00f00f00f00fULL;
+  x = (x ^ (x >> 8)) & 0x1f0000ff0000ffULL;
+  x = (x ^ (x >> 16)) & 0x1f00000000ffffULL;
+  x = (x ^ (x >> 32)) & 0x1fffff;
+  return (uint32_t)x;
+}
+
+// Levels (octal digits from the top) the two codes have in common.
+//
+static inline int commonLevels(uint64_t a, uint64_t b) {
+  if (a == b) return LinearOctree::LEVELS;
+  int highest = 63 - __builtin_clzll(a ^ b);
+  return (3 * LinearOctree::LEVELS - 1 - highest) / 3;
+}
+
+//---------------------------------------------------------------
+// LSD radix sort of the codes, carrying the point indices along, 11 bits
+// a pass (6 passes cover the 63 bits). The input is split into one chunk
+// per thread: every pass each chunk counts its digits, the counts are
+// turned into the chunk's offsets for every digit, and each chunk scatters
+// its keys. Passes where all the keys share the digit (the top bits of
+// clustered points) are skipped.
+//
+static void radixSort(vector<uint64_t> &keys, vector<uint32_t> &values) {
+  const int BITS = 11, RADIX = 1 << BITS, MASK = RADIX - 1, PASSES = 6;
+  size_t n = keys.size();
+
+  // Digit totals don't change between passes, count them all up front.
+  //
+  vector<size_t> totals(PASSES * RADIX, 0);
+  for (uint64_t key : keys) {
+    for (int pass = 0; pass < PASSES; pass++) totals[pass * RADIX + ((key >> (BITS * pass)) & MASK)]++;
+  }
+
+  size_t numChunks = n < LinearOctree::PARALLEL_SORT_THRESHOLD ? 1 : ThreadPool::size();
+  size_t chunkSize = (n + numChunks - 1) / numChunks;
+  vector<size_t> offsets(numChunks * RADIX);
+
+  vector<uint64_t> keysOut(n);
+  vector<uint32_t> valuesOut(n);
+
+  for (int pass = 0; pass < PASSES; pass++) {
+    int shift = BITS * pass;
+    auto total = totals.begin() + pass * RADIX;
+    if (*max_element(total, total + RADIX) == n) continue;
+
+    // Per chunk digit counts
+    //
+    ThreadPool::parallelFor(numChunks, 1, [&](size_t begin, size_t end) {
+      for (size_t chunk = begin; chunk < end; chunk++) {
+        size_t *count = &offsets[chunk * RADIX];
+        fill(count, count + RADIX, 0);
+        size_t last = min(n, (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < last; i++) count[(keys[i] >> shift) & MASK]++;
+      }
+    });
+
+    // ... into offsets: digit by digit, chunk by chunk within a digit, so
+    // the sort stays stable.
+    //
+    size_t sum = 0;
+    for (int digit = 0; digit < RADIX; digit++) {
+      for (size_t chunk = 0; chunk < numChunks; chunk++) {
+        size_t count = offsets[chunk * RADIX + digit];
+        offsets[chunk * RADIX + digit] = sum;
+        sum += count;
+      }
+    }
+
+    ThreadPool::parallelFor(numChunks, 1, [&](size_t begin, size_t end) {
+      for (size_t chunk = begin; chunk < end; chunk++) {
+        size_t *offset = &offsets[chunk * RADIX];
+        size_t last = min(n, (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < last; i++) {
+          size_t to = offset[(keys[i] >> shift) & MASK]++;
+          keysOut[to] = keys[i];
+          valuesOut[to] = values[i];
+        }
+      }
+    });
+
+    keys.swap(keysOut);
+    values.swap(valuesOut);
+  }
+}
+
+LinearOctree::LinearOctree() : MAX_DEPTH(0) { buildStats = {0, 0, 0}; }
+
+void LinearOctree::generate(const ofMesh &mesh, int maxLevel) {
+  MAX_DEPTH = maxLevel;
+  build(mesh.getVertices().data(), mesh.getNumVertices());
+}
+
+void LinearOctree::build(const ofVec3f *xyz, size_t n) {
+  PROFILE_ZONE("linear octree build");
+
+  nodes.clear();
+  points.clear();
+  indices.clear();
+  if (n == 0) return;
+
+  // Quantize into the bounds: step is the size of one of the 2^21 steps
+  // along each axis (never 0, so flat axes still quantize).
+  //
+  auto start = steady_clock::now();
+
+  Box bounds = pointBounds(&xyz[0].x, n);
+  origin = toOf(bounds.min());
+  ofVec3f extent = toOf(bounds.max()) - origin;
+  float steps = (float)(1 << LEVELS);
+  step = ofVec3f(max(extent.x, FLT_MIN), max(extent.y, FLT_MIN), max(extent.z, FLT_MIN)) / steps;
+
+  vector<uint64_t> codes(n);
+  indices.resize(n);
+  ThreadPool::parallelFor(n, 1 << 14, [&](size_t begin, size_t end) {
+    const float top = steps - 1;
+    for (size_t i = begin; i < end; i++) {
+      ofVec3f q = (xyz[i] - origin) / step;
+      uint64_t x = (uint64_t)min(max(q.x, 0.0f), top);
+      uint64_t y = (uint64_t)min(max(q.y, 0.0f), top);
+      uint64_t z = (uint64_t)min(max(q.z, 0.0f), top);
+      codes[i] = spreadBits(x) << 2 | spreadBits(y) << 1 | spreadBits(z);
+      indices[i] = (uint32_t)i;
+    }
+  });
+  buildStats.codesMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  start = steady_clock::now();
+  radixSort(codes, indices);
+
+  points.resize(n);
+  ThreadPool::parallelFor(n, 1 << 14, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) points[i] = xyz[indices[i]];
+  });
+  buildStats.sortMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  start = steady_clock::now();
+  buildHierarchy(codes);
+  buildStats.hierarchyMs = duration<double, milli>(steady_clock::now() - start).count();
+
+  LOG_DEBUG("Linear octree over " << n << " points: " << nodes.size() << " nodes; codes " << buildStats.codesMs
+                                  << " ms, sort " << buildStats.sortMs << " ms, hierarchy " << buildStats.hierarchyMs
+                                  << " ms");
+}
+
+// The cells with more than one point are the intervals of the sorted
+// codes over which neighbours share at least some number of levels, the
+// way suffix trees come out of LCP arrays. They are closed on a stack as
+// the shared levels drop, and written out in post order.
+//
+void LinearOctree::buildHierarchy(const vector<uint64_t> &codes) {
+  size_t n = codes.size();
+  nodes.reserve(n);
+
+  // Levels points i - 1 and i share, -1 past either end.
+  //
+  auto shared = [&](size_t i) { return i == 0 || i >= n ? -1 : commonLevels(codes[i - 1], codes[i]); };
+
+  // A leaf is the octant of its parent's cell that it falls in, so it has
+  // room around its points for rays to hit.
+  //
+  auto addNode = [&](uint32_t first, uint32_t count, uint32_t size, int level, bool isLeaf) {
+    level = min(level, (int)LEVELS);
+    Node node;
+    node.cell = level == 0 ? 0 : codes[first] & (~0ULL << (3 * (LEVELS - level)));
+    node.first = first;
+    node.count = count;
+    node.size = size;
+    node.level = (uint8_t)level;
+    node.isLeaf = isLeaf;
+    nodes.push_back(node);
+  };
+
+  // Open cells: their level, first point and first node of the subtree.
+  //
+  struct Open {
+    int level;
+    uint32_t first;
+    uint32_t firstNode;
+  };
+  vector<Open> open;
+  open.push_back({0, 0, 0});
+
+  int previous = -1;
+  for (size_t i = 1; i <= n; i++) {
+    int level = shared(i);
+
+    // Point i - 1 is a leaf under the deeper of the cells it shares with
+    // its neighbours.
+    //
+    addNode(i - 1, 1, 1, max(previous, level) + 1, true);
+    previous = level;
+    uint32_t lastFirst = i - 1, lastNode = nodes.size() - 1;
+
+    // Cells the next point is not in are done. Small ones collapse into a
+    // leaf, dropping their subtree.
+    //
+    while (!open.empty() && level < open.back().level) {
+      Open cell = open.back();
+      open.pop_back();
+      uint32_t count = i - cell.first;
+      int parent = open.empty() ? -1 : max(level, open.back().level);
+
+      if (count <= LEAF_SIZE || cell.level >= LEVELS) {
+        nodes.resize(cell.firstNode);
+        addNode(cell.first, count, 1, parent + 1, true);
+      } else {
+        addNode(cell.first, count, nodes.size() - cell.firstNode + 1, cell.level, false);
+      }
+      lastFirst = cell.first;
+      lastNode = cell.firstNode;
+    }
+
+    // A deeper cell starts with the last finished child.
+    //
+    if (!open.empty() && level > open.back().level) open.push_back({level, lastFirst, lastNode});
+  }
+}
+
+Box LinearOctree::cellBox(const Node &node) const {
+  uint64_t cell = node.cell;
+  float size = (float)(1u << (LEVELS - node.level));
+  ofVec3f min(compactBits(cell >> 2), compactBits(cell >> 1), compactBits(cell));
+  ofVec3f lo = origin + min * step;
+  ofVec3f hi = origin + (min + ofVec3f(size, size, size)) * step;
+  return Box(toVector3(lo), toVector3(hi));
+}
+
+void LinearOctree::renderNode(int index) {
+  auto &node = nodes[index];
+  if (node.level > MAX_DEPTH) return;
+
+  Box box = cellBox(node);
+  Vector3 size = box.max() - box.min();
+  ofDrawBox(toOf(size / 2 + box.min()), size.x(), size.y(), size.z());
+
+  if (node.isLeaf) return;
+  for (int child = index - 1; child > index - (int)node.size; child -= nodes[child].size) renderNode(child);
+}
+
+void LinearOctree::render() {
+  ofSetColor(ofColor::white);
+  if (!nodes.empty()) renderNode(nodes.size() - 1);
+}
+
+shared_ptr<MaybePoint> LinearOctree::search(const Ray &r, float t0, float t1) {
+  PROFILE_ZONE("linear octree search");
+
+  auto p = make_shared<MaybePoint>();
+  if (nodes.empty()) return p;
+
+  ofVec3f origin = toOf(r.origin), direction = toOf(r.direction).getNormalized();
+  float best = FLT_MAX;
+  int bestPoint = -1;
+
+  // A node has at most 8 children and the tree at most LEVELS + 1 levels.
+  //
+  int stack[8 * (LEVELS + 1)];
+  int top = 0;
+  stack[top++] = nodes.size() - 1;
+  while (top > 0) {
+    int index = stack[--top];
+    auto &node = nodes[index];
+    if (!cellBox(node).intersect(r, t0, t1)) continue;
+
+    if (node.isLeaf) {
+      // Squared distance of the points from the ray's line
+      //
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        ofVec3f v = points[i] - origin;
+        float along = v.dot(direction);
+        float d = v.lengthSquared() - along * along;
+        if (d < best) {
+          best = d;
+          bestPoint = i;
+        }
+      }
+      continue;
+    }
+    for (int child = index - 1; child > index - (int)node.size; child -= nodes[child].size) stack[top++] = child;
+  }
+
+  if (bestPoint >= 0) p->set(points[bestPoint]);
+  return p;
+}
+
+size_t LinearOctree::memoryUsage() const {
+  return nodes.capacity() * sizeof(Node) + points.capacity() * sizeof(ofVec3f) +
+         indices.capacity() * sizeof(uint32_t);
+}
+
+// Appends the node's vertex indices.
+//
+static void appendRange(const LinearOctree &tree, const LinearOctree::Node &node, vector<int> &out) {
+  out.insert(out.end(), tree.indices.begin() + node.first, tree.indices.begin() + node.first + node.count);
+}
+
+int LinearOctree::queryBox(const Box &box, vector<int> &out) const {
+  PROFILE_ZONE("linear octree queryBox");
+  out.clear();
+  if (nodes.empty()) return 0;
+
+  auto &lo = box.min(), &hi = box.max();
+  vector<int> stack(1, nodes.size() - 1);
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    auto &node = nodes[index];
+
+    Box cell = cellBox(node);
+    auto &cellLo = cell.min(), &cellHi = cell.max();
+    if (cellLo.x() > hi.x() || cellHi.x() < lo.x() || cellLo.y() > hi.y() || cellHi.y() < lo.y() ||
+        cellLo.z() > hi.z() || cellHi.z() < lo.z()) {
+      continue;
+    }
+
+    if (cellLo.x() >= lo.x() && cellHi.x() <= hi.x() && cellLo.y() >= lo.y() && cellHi.y() <= hi.y() &&
+        cellLo.z() >= lo.z() && cellHi.z() <= hi.z()) {
+      appendRange(*this, node, out);
+      continue;
+    }
+
+    if (node.isLeaf) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        auto &p = points[i];
+        if (p.x >= lo.x() && p.x <= hi.x() && p.y >= lo.y() && p.y <= hi.y() && p.z >= lo.z() && p.z <= hi.z())
+          out.push_back(indices[i]);
+      }
+      continue;
+    }
+    for (int child = index - 1; child > index - (int)node.size; child -= nodes[child].size) stack.push_back(child);
+  }
+  return (int)out.size();
+}
+
+int LinearOctree::queryFrustum(const Frustum &frustum, vector<int> &out) const {
+  PROFILE_ZONE("linear octree queryFrustum");
+  out.clear();
+  if (nodes.empty()) return 0;
+
+  vector<int> stack(1, nodes.size() - 1);
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    auto &node = nodes[index];
+
+    auto overlap = frustum.classify(cellBox(node));
+    if (overlap == Frustum::OUTSIDE) continue;
+    if (overlap == Frustum::INSIDE) {
+      appendRange(*this, node, out);
+      continue;
+    }
+
+    if (node.isLeaf) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        if (frustum.contains(points[i])) out.push_back(indices[i]);
+      }
+      continue;
+    }
+    for (int child = index - 1; child > index - (int)node.size; child -= nodes[child].size) stack.push_back(child);
+  }
+  return (int)out.size();
+}
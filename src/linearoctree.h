@@ -0,0 +1,135 @@
+//
+//  linearoctree.h
+//  martian-terrain
+//
+
+#ifndef linearoctree_h
+#define linearoctree_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "box.h"
+#include "frustum.h"
+#include "ray.h"
+#include "spatialindex.h"
+
+namespace sidmishraw_octtree {
+
+//---------------------------------------------------------------
+// LinearOctree is an octree over the terrain's vertices built bottom up
+// from Morton codes, an alternative to the pointer based OctTree.
+//
+// Every vertex is quantized to 21 bits per axis inside the mesh's bounds
+// and interleaved into a 63 bit Morton (Z-order) code. The codes are
+// sorted with a parallel LSD radix sort, which puts the points of every
+// octree cell next to each other. The number of leading octal digits two
+// neighbouring codes share is the depth of the smallest cell holding
+// both, so one pass over the sorted codes with a stack of open cells
+// yields the hierarchy. Only cells where the points branch become nodes,
+// and cells with LEAF_SIZE points or fewer become leaves.
+//
+// The points are kept in Z-order, so a node's points (and a whole
+// subtree's) are one contiguous range, near each other in memory.
+//
+using namespace std;
+class LinearOctree : public SpatialIndex {
+ public:
+  // Bits per axis of the quantized coordinates, and so the deepest level.
+  //
+  static const int LEVELS = 21;
+
+  // The most points a cell keeps as a leaf instead of branching.
+  //
+  static const int LEAF_SIZE = 8;
+
+  // Points above which the codes are sorted in parallel.
+  //
+  static const size_t PARALLEL_SORT_THRESHOLD = 1 << 16;
+
+  // A node, stored in post order: the root is the last node, and the
+  // subtree of a node is the size nodes ending at it.
+  //
+  struct Node {
+    uint64_t cell;   // Morton code of the cell's min corner
+    uint32_t first;  // the node's points are points[first, first + count)
+    uint32_t count;
+    uint32_t size;  // nodes in the subtree, this one included
+    uint8_t level;  // depth of the cell, the root's is 0
+    bool isLeaf;
+  };
+
+  // Time spent in each build stage.
+  //
+  struct BuildStats {
+    double codesMs;
+    double sortMs;
+    double hierarchyMs;
+  };
+
+  LinearOctree();
+
+  // ----------- ATTRIBUTES -----------------
+
+  // Max depth to render.
+  //
+  int MAX_DEPTH;
+
+  vector<Node> nodes;
+
+  // The points in Z-order, and the vertex index each one came from.
+  //
+  vector<ofVec3f> points;
+  vector<uint32_t> indices;
+
+  // Min corner of the quantization grid and the size of one step along
+  // each axis.
+  //
+  ofVec3f origin, step;
+
+  BuildStats buildStats;
+
+  // ----------- OPERATIONS ------------------
+
+  void generate(const ofMesh& mesh, int maxLevel) override;
+
+  // Builds the tree over n points.
+  //
+  void build(const ofVec3f* xyz, size_t n);
+
+  void render() override;
+
+  // The vertex nearest to the ray among the leaves it passes through.
+  //
+  shared_ptr<MaybePoint> search(const Ray& r, float t0, float t1) override;
+
+  size_t memoryUsage() const override;
+
+  string name() const override { return "linear octree"; }
+
+  // The bounds of the node's cell.
+  //
+  Box cellBox(const Node& node) const;
+
+  // Like the OctTree range queries: fill out with the vertex indices
+  // within the box or the frustum (in Z-order) and return how many there
+  // are. Subtrees entirely inside are copied over as their point range.
+  //
+  int queryBox(const Box& box, vector<int>& out) const;
+
+  int queryFrustum(const Frustum& frustum, vector<int>& out) const;
+
+ private:
+  // Builds the nodes from the sorted codes.
+  //
+  void buildHierarchy(const vector<uint64_t>& codes);
+
+  void renderNode(int index);
+};
+
+}  // namespace sidmishraw_octtree
+
+#endif /* linearoctree_h */
@@ -1,8 +1,31 @@
 #include "ofApp.h"
 #include "ofMain.h"
 
+#include "batchsnapshots.h"
+
 //========================================================================
-int main() {
+int main(int argc, char *argv[]) {
+  // martian-terrain --snapshots <path.mars> [prefix] renders the snapshots
+  // along a saved path into PNGs and exits, without opening a window.
+  // The files given are relative to the current directory.
+  //
+  if (argc >= 3 && string(argv[1]) == "--snapshots") {
+    string pathFile = ofFilePath::getAbsolutePath(argv[2], false);
+    string prefix = argc >= 4 ? ofFilePath::getAbsolutePath(argv[3], false)
+                              : "Snapshot_" + ofGetTimestampString("%Y_%m_%d_%H_%M_%S") + "_";
+    ofInit();
+
+    BatchSnapshots batch(TERRAIN_MODEL, OCCLUSION_CACHE);
+    batch.bReorder = REORDER_TERRAIN;
+    batch.maxLevel = MAX_LEVEL;
+    batch.spacing = SNAPSHOT_SPACING;
+    batch.eyeHeight = DEFAULT_EYE_HEIGHT;
+    batch.fov = CAMERA_FOV;
+    batch.width = SNAPSHOT_WIDTH;
+    batch.height = SNAPSHOT_HEIGHT;
+    return batch.run(ofApp::parsePathPoints(Tmnper::loadFromTmpr(pathFile, FILE_EXT)), prefix);
+  }
+
   ofSetupOpenGL(1280, 1024, OF_WINDOW);  // <-------- setup the GL context
 
   // this kicks off the running of my app
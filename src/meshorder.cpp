@@ -0,0 +1,79 @@
+//
+//  meshorder.cpp
+//  martian-terrain
+//
+
+#include "meshorder.h"
+#include "Profiler.h"
+#include "linearoctree.h"
+
+#include <algorithm>
+
+using namespace sidmishraw_octtree;
+
+// Moves the first order.size() elements of data into the order: element i
+// becomes the old element order[i]. The vector overload leaves data of
+// another size (e.g. a mesh without colors) as it is.
+//
+template <typename T>
+static void permute(T *data, const vector<uint32_t> &order) {
+  vector<T> old(data, data + order.size());
+  for (size_t i = 0; i < order.size(); i++) data[i] = old[order[i]];
+}
+
+template <typename T>
+static void permute(vector<T> &data, const vector<uint32_t> &order) {
+  if (data.size() == order.size()) permute(data.data(), order);
+}
+
+MeshOrder spatialOrder(const ofMesh &mesh) {
+  PROFILE_ZONE("spatialOrder");
+
+  MeshOrder order;
+  size_t n = mesh.getNumVertices();
+  auto &indices = mesh.getIndices();
+  if (n == 0 || indices.empty()) {
+    for (size_t i = 0; i < n; i++) order.vertices.push_back(i);
+    order.remap = order.vertices;
+    order.indices = indices;
+    return order;
+  }
+
+  LinearOctree tree;
+  tree.build(mesh.getVerticesPointer(), n);
+  order.vertices.swap(tree.indices);
+  order.remap.resize(n);
+  for (size_t i = 0; i < n; i++) order.remap[order.vertices[i]] = i;
+
+  order.indices.resize(indices.size());
+  if (indices.size() % 3 != 0) {
+    for (size_t i = 0; i < indices.size(); i++) order.indices[i] = order.remap[indices[i]];
+    return order;
+  }
+
+  // Counting sort of the triangles by their lowest new vertex index; ties
+  // keep the order they came in.
+  //
+  size_t numTriangles = indices.size() / 3;
+  vector<uint32_t> key(numTriangles), start(n + 1, 0);
+  for (size_t t = 0; t < numTriangles; t++) {
+    key[t] = min(order.remap[indices[3 * t]], min(order.remap[indices[3 * t + 1]], order.remap[indices[3 * t + 2]]));
+    start[key[t] + 1]++;
+  }
+  for (size_t i = 0; i < n; i++) start[i + 1] += start[i];
+  for (size_t t = 0; t < numTriangles; t++) {
+    size_t slot = 3 * start[key[t]]++;
+    for (int k = 0; k < 3; k++) order.indices[slot + k] = order.remap[indices[3 * t + k]];
+  }
+  return order;
+}
+
+void reorderMesh(ofMesh &mesh, const MeshOrder &order) {
+  permute(mesh.getVertices(), order.vertices);
+  permute(mesh.getNormals(), order.vertices);
+  permute(mesh.getColors(), order.vertices);
+  permute(mesh.getTexCoords(), order.vertices);
+  mesh.getIndices() = order.indices;
+}
+
+void reorderMesh(ofMesh &mesh) { reorderMesh(mesh, spatialOrder(mesh)); }
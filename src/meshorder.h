@@ -0,0 +1,51 @@
+//
+//  meshorder.h
+//  martian-terrain
+//
+
+#ifndef meshorder_h
+#define meshorder_h
+
+#include <cstdint>
+#include <vector>
+
+#include "ofMain.h"
+
+using namespace std;
+
+//---------------------------------------------------------------
+// A new order for a mesh's vertices and triangles along a space filling
+// curve, so vertices near each other in space are near each other in
+// memory.
+//
+// Meshes come with their vertices in whatever order the exporter wrote
+// them. The octree leaves and the picking code then fetch vertices from
+// all over the vertex array. Reordered, the vertices of a cell sit close
+// together, and so do the triangles around them, which also helps the
+// GPU's vertex cache.
+//
+// The vertices take the Z-order of the LinearOctree over them. The
+// triangles are sorted by their lowest new vertex index, so they follow
+// the same curve and reuse the vertices just fetched.
+//
+struct MeshOrder {
+  vector<uint32_t> vertices;    // vertices[new index] = old index
+  vector<uint32_t> remap;       // remap[old index] = new index
+  vector<ofIndexType> indices;  // the triangles in their new order, new vertex indices
+};
+
+// The spatial order of the mesh. Meshes without indices keep their order,
+// their triangles are implied by it.
+//
+MeshOrder spatialOrder(const ofMesh &mesh);
+
+// Moves the mesh's vertices, normals, colors and texture coordinates into
+// the order, and replaces its indices.
+//
+void reorderMesh(ofMesh &mesh, const MeshOrder &order);
+
+// Reorders the mesh spatially.
+//
+void reorderMesh(ofMesh &mesh);
+
+#endif /* meshorder_h */
@@ -6,14 +6,16 @@
 //
 
 #include "octtree.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "bounds.h"
+
+#include <atomic>
+#include <cfloat>
 
 using namespace sidmishraw_octtree;
 using namespace std;
 
-// Converts from a Vector3 instance to ofVec3f.
-//
-ofVec3f convert(const Vector3 &p) { return ofVec3f(p.x(), p.y(), p.z()); }
-
 // Checks if a point p is within the bounds defined by min and max.
 //
 bool isWithinBounds(Vector3 min, Vector3 max, ofVec3f p) {
@@ -23,62 +25,67 @@ bool isWithinBounds(Vector3 min, Vector3 max, ofVec3f p) {
   return false;
 }
 
-// Computes the mesh bounds.
-//
-vector<Vector3> meshBounds(const ofMesh &mesh) {
-  int n = mesh.getNumVertices();
-
-  ofVec3f v = mesh.getVertex(0);
-  ofVec3f max = v;
-  ofVec3f min = v;
-
-  for (int i = 1; i < n; i++) {
-    ofVec3f v = mesh.getVertex(i);
-
-    if (v.x > max.x)
-      max.x = v.x;
-    else if (v.x < min.x)
-      min.x = v.x;
-
-    if (v.y > max.y)
-      max.y = v.y;
-    else if (v.y < min.y)
-      min.y = v.y;
-
-    if (v.z > max.z)
-      max.z = v.z;
-    else if (v.z < min.z)
-      min.z = v.z;
-  }
-
-  vector<Vector3> bounds;
-  bounds.push_back(Vector3(min.x, min.y, min.z));
-  bounds.push_back(Vector3(max.x, max.y, max.z));
-
-  return bounds;
-}
-
 //--------------- OCTTREENODE - STARTS -----------------------------------------
 //
 //
-OctTreeNode::OctTreeNode(Vector3 min, Vector3 max, int d, weak_ptr<OctTree> tree, vector<int> indices) {
+OctTreeNode::OctTreeNode(const Vector3 &min, const Vector3 &max, int d, OctTree *tree, const int *indices,
+                         int count) {
   box = Box(min, max);
-  isLeaf = false;
+  isLeaf = true;  // holding all its points until it splits
+  expanded = false;
   depth = d;
   shouldLightUp = false;
+  first = last = 0;
+  octTree = tree;
+  children = nullptr;
+  numChildren = 0;
 
-  // Get the shared_ptr instance of octtree if it still exists.
+  // Check in the points within this node's bounds into its
+  // pointIndices list.
   //
-  octTree = tree.lock();
+  auto &scratch = octTree->scratch;
+  scratch.clear();
+  for (int i = 0; i < count; i++) {
+    if (isWithinBounds(min, max, octTree->mesh.getVertex(indices[i]))) scratch.push_back(indices[i]);
+  }
 
-  // Check in the points within this node's bounds into its
-  // pointIndices vector.
+  numPoints = (int)scratch.size();
+  capacity = numPoints;
+  pointIndices = octTree->arena.allocateArray<int>(numPoints);
+  copy(scratch.begin(), scratch.end(), pointIndices);
+}
+
+OctTreeNode::OctTreeNode(const OctTreeNode &other)
+    : octTree(other.octTree),
+      box(other.box),
+      pointIndices(other.pointIndices),
+      numPoints(other.numPoints),
+      capacity(other.capacity),
+      children(other.children),
+      numChildren(other.numChildren),
+      isLeaf(other.isLeaf),
+      expanded(other.isExpanded()),
+      depth(other.depth),
+      shouldLightUp(other.shouldLightUp),
+      first(other.first),
+      last(other.last) {}
+
+void sidmishraw_octtree::octants(const Box &box, Box b[8]) {
+  Vector3 min = box.parameters[0];
+  Vector3 max = box.parameters[1];
+  Vector3 center = (max - min) / 2 + min;
+
+  // The octants share the parent's faces exactly (rather than adding half
+  // the size to the center), so points on the max faces stay in a child.
   //
-  if (octTree) {
-    for_each(indices.begin(), indices.end(), [this, &min, &max](int index) {
-      auto vertex = octTree->mesh.getVertex(index);
-      if (isWithinBounds(min, max, vertex)) this->pointIndices.push_back(index);
-    });
+  float x[3] = {min.x(), center.x(), max.x()};
+  float y[3] = {min.y(), center.y(), max.y()};
+  float z[3] = {min.z(), center.z(), max.z()};
+  int xs[4] = {0, 1, 1, 0};
+  int zs[4] = {0, 0, 1, 1};
+  for (int i = 0; i < 8; i++) {
+    int xi = xs[i % 4], yi = i / 4, zi = zs[i % 4];
+    b[i] = Box(Vector3(x[xi], y[yi], z[zi]), Vector3(x[xi + 1], y[yi + 1], z[zi + 1]));
   }
 }
 
@@ -86,55 +93,147 @@ void OctTreeNode::subdivide() {
   // if (depth > octTree->MAX_DEPTH) return; // bail out after reaching max
   // depth
 
+  split();
+  if (octTree->bLazy) return;
+
+  for (int i = 0; i < numChildren; i++) children[i].subdivide();
+}
+
+bool OctTreeNode::isExpanded() const { return expanded.load(memory_order_acquire); }
+
+bool OctTreeNode::expand() {
+  if (isExpanded()) return false;
+
+  lock_guard<mutex> lock(octTree->expandMutex);
+  if (expanded) return false;
+  split();
+  return true;
+}
+
+void OctTreeNode::split() {
+  // The node's points have moved (or will move) into the children
+  //
+  octTree->bOrderDirty = true;
+
   // no more points left to make children
   //
-  if (this->pointIndices.size() <= 1) {
+  if (numPoints <= OctTree::LEAF_SIZE || depth >= OctTree::MAX_TREE_DEPTH) {
     isLeaf = true;
+    expanded.store(true, memory_order_release);
     return;
   }
 
-  // cout << "subdividing --- " << depth << " size = " <<
-  // this->pointIndices.size() << endl;
+  // Children bounds
+  //
+  Box b[8];
+  octants(box, b);
 
-  Vector3 min = box.parameters[0];
-  Vector3 max = box.parameters[1];
+  // Generate children, all 8 in one arena allocation
+  //
+  children = octTree->arena.allocateArray<OctTreeNode>(8);
+  numChildren = 8;
+  isLeaf = false;
+  for (int i = 0; i < 8; i++) {
+    new (&children[i]) OctTreeNode(b[i].min(), b[i].max(), depth + 1, octTree, pointIndices, numPoints);
+  }
 
-  Vector3 size = max - min;
-  Vector3 center = size / 2 + min;
+  // The children have the points now, this node only keeps the count.
+  //
+  pointIndices = nullptr;
+  capacity = 0;
+
+  // Published last, a thread that sees the node expanded sees it whole
+  //
+  expanded.store(true, memory_order_release);
+}
 
-  float xDist = (max.x() - min.x()) / 2;
-  float yDist = (max.y() - min.y()) / 2;
-  float zDist = (max.z() - min.z()) / 2;
+void OctTreeNode::append(int index) {
+  if (numPoints == capacity) {
+    int grown = capacity < 2 ? 4 : 2 * capacity;
+    int *list = octTree->arena.allocateArray<int>(grown);
+    copy(pointIndices, pointIndices + numPoints, list);
+    pointIndices = list;
+    capacity = grown;
+  }
+  pointIndices[numPoints++] = index;
+}
 
-  Vector3 h = Vector3(0, yDist, 0);
+void OctTreeNode::insert(int index, const ofVec3f &p) {
+  if (isLeaf) {
+    append(index);
+    if (numPoints > OctTree::LEAF_SIZE && isExpanded()) subdivide();
+    return;
+  }
 
-  // Generate children
+  // Points on a boundary between children go into all of them, as in
+  // generate().
   //
-  shared_ptr<OctTreeNode> n[8];
-  n[0] = make_shared<OctTreeNode>(min, center, depth + 1, octTree, this->pointIndices);
-  n[1] = make_shared<OctTreeNode>(n[0]->box.min() + Vector3(xDist, 0, 0), n[0]->box.max() + Vector3(xDist, 0, 0),
-                                  depth + 1, octTree, this->pointIndices);
-  n[2] = make_shared<OctTreeNode>(n[1]->box.min() + Vector3(0, 0, zDist), n[1]->box.max() + Vector3(0, 0, zDist),
-                                  depth + 1, octTree, this->pointIndices);
-  n[3] = make_shared<OctTreeNode>(n[2]->box.min() + Vector3(-xDist, 0, 0), n[2]->box.max() + Vector3(-xDist, 0, 0),
-                                  depth + 1, octTree, this->pointIndices);
-  for (int i = 4; i < 8; i++) {
-    n[i] = make_shared<OctTreeNode>(n[i - 4]->box.min() + h, n[i - 4]->box.max() + h, depth + 1, octTree,
-                                    this->pointIndices);
+  numPoints++;
+  for (int i = 0; i < numChildren; i++) {
+    if (isWithinBounds(children[i].box.min(), children[i].box.max(), p)) children[i].insert(index, p);
+  }
+}
+
+bool OctTreeNode::remove(int index, const ofVec3f &p) {
+  if (isLeaf) {
+    for (int i = 0; i < numPoints; i++) {
+      if (pointIndices[i] == index) {
+        pointIndices[i] = pointIndices[--numPoints];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool found = false;
+  for (int i = 0; i < numChildren; i++) {
+    if (isWithinBounds(children[i].box.min(), children[i].box.max(), p)) found |= children[i].remove(index, p);
   }
+  if (!found) return false;
 
-  for (int i = 0; i < 8; i++) children.push_back(n[i]);
+  numPoints--;
+  if (numPoints <= OctTree::LEAF_SIZE) merge();
+  return true;
+}
 
-  // cout << "my children = " << children.size() << endl;
+void OctTreeNode::collect(vector<int> &out) const {
+  if (isLeaf) {
+    out.insert(out.end(), pointIndices, pointIndices + numPoints);
+    return;
+  }
+  for (int i = 0; i < numChildren; i++) children[i].collect(out);
+}
 
-  for_each(children.begin(), children.end(), [](shared_ptr<OctTreeNode> child) { child->subdivide(); });
+void OctTreeNode::merge() {
+  // Boundary points are in more than one child, keep them once.
+  //
+  auto &scratch = octTree->scratch;
+  scratch.clear();
+  collect(scratch);
+  sort(scratch.begin(), scratch.end());
+  scratch.erase(unique(scratch.begin(), scratch.end()), scratch.end());
+
+  numPoints = (int)scratch.size();
+  capacity = numPoints;
+  pointIndices = octTree->arena.allocateArray<int>(numPoints);
+  copy(scratch.begin(), scratch.end(), pointIndices);
+
+  children = nullptr;
+  numChildren = 0;
+  isLeaf = true;
+  expanded = true;
+}
+
+void OctTreeNode::deepen(int levels) {
+  depth += levels;
+  for (int i = 0; i < numChildren; i++) children[i].deepen(levels);
 }
 
 // render the octree node as a box
 //
 void OctTreeNode::render() {
   if (depth > octTree->MAX_DEPTH) return;  // bail out after reaching max depth.
-  if (pointIndices.size() < 1) return;     // don't render empty nodes
+  if (numPoints < 1) return;               // don't render empty nodes
 
   // max, min bounds using the Box class for ray intersection testing.
   //
@@ -144,7 +243,7 @@ void OctTreeNode::render() {
   Vector3 size = max - min;
   Vector3 center = size / 2 + min;
 
-  ofVec3f p = ofVec3f(center.x(), center.y(), center.z());
+  ofVec3f p = toOf(center);
 
   float w = size.x();
   float h = size.y();
@@ -159,7 +258,7 @@ void OctTreeNode::render() {
 
   // Render children recursively.
   //
-  for_each(children.begin(), children.end(), [](shared_ptr<OctTreeNode> child) { child->render(); });
+  for (int i = 0; i < numChildren; i++) children[i].render();
 }
 
 // Check if the ray intersects a node. If it intersects,
@@ -172,24 +271,21 @@ void OctTreeNode::intersects(const Ray &r, float t0, float t1) {
 
   // Sparse box, don't light up
   //
-  if (pointIndices.size() < 1)
+  if (numPoints < 1)
     shouldLightUp = false;
   else if (shouldLightUp) {
+    expand();
     if (isLeaf) {
       octTree->thePoint.set(octTree->mesh.getVertex(pointIndices[0]));
-
-      //      log("-----");
-      //      log("Nbr of indices = " + ofToString(pointIndices.size()));
     } else {
-      for_each(children.begin(), children.end(),
-               [&r, t0, t1](shared_ptr<OctTreeNode> child) { child->intersects(r, t0, t1); });
+      for (int i = 0; i < numChildren; i++) children[i].intersects(r, t0, t1);
     }
   }
 }
 
 void OctTreeNode::clearSelection() {
   shouldLightUp = false;
-  for_each(children.begin(), children.end(), [](shared_ptr<OctTreeNode> child) { child->clearSelection(); });
+  for (int i = 0; i < numChildren; i++) children[i].clearSelection();
 }
 
 //
@@ -201,15 +297,22 @@ void OctTreeNode::clearSelection() {
 //
 
 void OctTree::generate(const ofMesh &mesh, int maxLevel) {
+  PROFILE_ZONE("octtree generate");
+
   this->mesh = mesh;
   MAX_DEPTH = maxLevel;
 
-  vector<int> indices;
-  for (int i = 0; i < mesh.getVertices().size(); i++) indices.push_back(i);
+  // Drop the previous tree in one go, its memory is reused below.
+  //
+  arena.reset();
+
+  vector<int> indices(mesh.getNumVertices());
+  for (int i = 0; i < (int)indices.size(); i++) indices[i] = i;
 
-  vector<Vector3> bounds = meshBounds(mesh);
-  root = make_shared<OctTreeNode>(bounds[0], bounds[1], 0, shared_from_this(), indices);
-  root->subdivide();
+  Box bounds = meshBounds(mesh);
+  root = arena.create<OctTreeNode>(bounds.min(), bounds.max(), 0, this, indices.data(), (int)indices.size());
+  if (!bLazy) root->subdivide();
+  bOrderDirty = true;
 }
 
 void OctTree::render() {
@@ -220,6 +323,8 @@ void OctTree::render() {
 }
 
 shared_ptr<MaybePoint> OctTree::search(const Ray &r, float t0, float t1) {
+  PROFILE_ZONE("octtree search");
+
   root->clearSelection();
   thePoint.clear();
 
@@ -234,6 +339,293 @@ shared_ptr<MaybePoint> OctTree::search(const Ray &r, float t0, float t1) {
   return p;
 }
 
+// Same walk as OctTreeNode::intersects, without lighting up the nodes.
+//
+static void pickLeaf(OctTreeNode &node, const Ray &r, float t0, float t1, int &index) {
+  if (node.numPoints < 1 || !node.box.intersect(r, t0, t1)) return;
+
+  node.expand();
+  if (node.isLeaf) {
+    index = node.pointIndices[0];
+  } else {
+    for (int i = 0; i < node.numChildren; i++) pickLeaf(node.children[i], r, t0, t1, index);
+  }
+}
+
+shared_ptr<MaybePoint> OctTree::pick(const Ray &r, float t0, float t1) {
+  PROFILE_ZONE("octtree pick");
+
+  auto p = make_shared<MaybePoint>();
+  if (!root) return p;
+
+  int index = -1;
+  pickLeaf(*root, r, t0, t1, index);
+  if (index >= 0) {
+    thePoint.set(mesh.getVertex(index));
+    p->set(thePoint.get());
+  }
+  return p;
+}
+
+int OctTree::insert(const ofVec3f &p) {
+  PROFILE_ZONE("octtree insert");
+  if (!root) return -1;
+
+  int index = mesh.getNumVertices();
+  mesh.addVertex(p);
+
+  growRoot(p);
+  root->insert(index, p);
+  bOrderDirty = true;
+  return index;
+}
+
+bool OctTree::remove(int index) {
+  PROFILE_ZONE("octtree remove");
+  if (!root || index < 0 || index >= (int)mesh.getNumVertices()) return false;
+
+  bOrderDirty = true;
+  return root->remove(index, mesh.getVertex(index));
+}
+
+bool OctTree::update(int index, const ofVec3f &p) {
+  if (!remove(index)) return false;
+
+  mesh.setVertex(index, p);
+  growRoot(p);
+  root->insert(index, p);
+  return true;
+}
+
+// Collects the points of the leaves overlapping the XZ rectangle.
+//
+static void pointsNear(const OctTreeNode &node, const ofVec3f &lo, const ofVec3f &hi, vector<int> &out) {
+  if (node.numPoints == 0) return;
+  if (node.box.min().x() > hi.x || node.box.max().x() < lo.x || node.box.min().z() > hi.z ||
+      node.box.max().z() < lo.z) {
+    return;
+  }
+  if (node.isLeaf) {
+    out.insert(out.end(), node.pointIndices, node.pointIndices + node.numPoints);
+    return;
+  }
+  for (int i = 0; i < node.numChildren; i++) pointsNear(node.children[i], lo, hi, out);
+}
+
+int OctTree::deform(const ofVec3f &center, float radius, float height) {
+  PROFILE_ZONE("octtree deform");
+  if (!root || radius <= 0) return 0;
+
+  vector<int> near;
+  pointsNear(*root, center - ofVec3f(radius, 0, radius), center + ofVec3f(radius, 0, radius), near);
+  sort(near.begin(), near.end());
+  near.erase(unique(near.begin(), near.end()), near.end());
+
+  int moved = 0;
+  for (int index : near) {
+    ofVec3f v = mesh.getVertex(index);
+    float d2 = ((v.x - center.x) * (v.x - center.x) + (v.z - center.z) * (v.z - center.z)) / (radius * radius);
+    if (d2 >= 1) continue;
+
+    float falloff = (1 - d2) * (1 - d2);
+    update(index, v + ofVec3f(0, height * falloff, 0));
+    moved++;
+  }
+  return moved;
+}
+
+// Expands the nodes overlapping the XZ rectangle down to the leaves and
+// returns how many split.
+//
+static int expandNear(OctTreeNode &node, const ofVec3f &lo, const ofVec3f &hi) {
+  if (node.numPoints == 0) return 0;
+  if (node.box.min().x() > hi.x || node.box.max().x() < lo.x || node.box.min().z() > hi.z ||
+      node.box.max().z() < lo.z) {
+    return 0;
+  }
+
+  int split = node.expand() ? 1 : 0;
+  if (node.isLeaf) return split;
+  for (int i = 0; i < node.numChildren; i++) split += expandNear(node.children[i], lo, hi);
+  return split;
+}
+
+int OctTree::expandAround(const vector<ofVec3f> &points, float radius) {
+  PROFILE_ZONE("octtree expandAround");
+  if (!root || points.empty()) return 0;
+
+  atomic<int> split(0);
+  ofVec3f reach(radius, 0, radius);
+  ThreadPool::parallelFor(points.size(), 1, [&](size_t begin, size_t end) {
+    int count = 0;
+    for (size_t i = begin; i < end; i++) count += expandNear(*root, points[i] - reach, points[i] + reach);
+    split += count;
+  });
+  return split;
+}
+
+// Lists the points of the leaves below node in order, each once, and
+// records the range each node covers.
+//
+static void orderPoints(OctTreeNode &node, vector<int> &order, vector<char> &listed) {
+  node.first = (int)order.size();
+  if (node.isLeaf) {
+    for (int i = 0; i < node.numPoints; i++) {
+      int index = node.pointIndices[i];
+      if (listed[index]) continue;
+      listed[index] = 1;
+      order.push_back(index);
+    }
+  } else {
+    for (int i = 0; i < node.numChildren; i++) orderPoints(node.children[i], order, listed);
+  }
+  node.last = (int)order.size();
+}
+
+void OctTree::updateOrder() {
+  if (!bOrderDirty || !root) return;
+  PROFILE_ZONE("octtree order");
+
+  vector<char> listed(mesh.getNumVertices(), 0);
+  order.clear();
+  order.reserve(mesh.getNumVertices());
+  orderPoints(*root, order, listed);
+  bOrderDirty = false;
+}
+
+// Appends the points of the node within the box: its whole range when the
+// node is inside it.
+//
+static void pointsInBox(const OctTreeNode &node, const Box &box, const vector<int> &order, vector<int> &out) {
+  if (node.first == node.last) return;
+
+  auto &lo = box.min(), &hi = box.max();
+  auto &nodeLo = node.box.min(), &nodeHi = node.box.max();
+  if (nodeLo.x() > hi.x() || nodeHi.x() < lo.x() || nodeLo.y() > hi.y() || nodeHi.y() < lo.y() ||
+      nodeLo.z() > hi.z() || nodeHi.z() < lo.z()) {
+    return;
+  }
+
+  if (nodeLo.x() >= lo.x() && nodeHi.x() <= hi.x() && nodeLo.y() >= lo.y() && nodeHi.y() <= hi.y() &&
+      nodeLo.z() >= lo.z() && nodeHi.z() <= hi.z()) {
+    out.insert(out.end(), order.begin() + node.first, order.begin() + node.last);
+    return;
+  }
+
+  if (node.isLeaf) {
+    auto &mesh = node.octTree->mesh;
+    for (int i = node.first; i < node.last; i++) {
+      if (isWithinBounds(lo, hi, mesh.getVertex(order[i]))) out.push_back(order[i]);
+    }
+    return;
+  }
+  for (int i = 0; i < node.numChildren; i++) pointsInBox(node.children[i], box, order, out);
+}
+
+// Same for the frustum.
+//
+static void pointsInFrustum(const OctTreeNode &node, const Frustum &frustum, const vector<int> &order,
+                            vector<int> &out) {
+  if (node.first == node.last) return;
+
+  auto overlap = frustum.classify(node.box);
+  if (overlap == Frustum::OUTSIDE) return;
+  if (overlap == Frustum::INSIDE) {
+    out.insert(out.end(), order.begin() + node.first, order.begin() + node.last);
+    return;
+  }
+
+  if (node.isLeaf) {
+    auto &mesh = node.octTree->mesh;
+    for (int i = node.first; i < node.last; i++) {
+      if (frustum.contains(mesh.getVertex(order[i]))) out.push_back(order[i]);
+    }
+    return;
+  }
+  for (int i = 0; i < node.numChildren; i++) pointsInFrustum(node.children[i], frustum, order, out);
+}
+
+int OctTree::queryBox(const Box &box, vector<int> &out) {
+  PROFILE_ZONE("octtree queryBox");
+  updateOrder();
+  out.clear();
+  if (root) pointsInBox(*root, box, order, out);
+  return (int)out.size();
+}
+
+int OctTree::queryFrustum(const Frustum &frustum, vector<int> &out) {
+  PROFILE_ZONE("octtree queryFrustum");
+  updateOrder();
+  out.clear();
+  if (root) pointsInFrustum(*root, frustum, order, out);
+  return (int)out.size();
+}
+
+void OctTree::trianglesOf(const vector<int> &vertices, vector<int> &triangles) const {
+  triangles.clear();
+  if (vertices.empty()) return;
+
+  vector<char> selected(mesh.getNumVertices(), 0);
+  for (int vertex : vertices) selected[vertex] = 1;
+
+  // Meshes without indices list the triangles' vertices in order.
+  //
+  bool indexed = mesh.getNumIndices() > 0;
+  int numTriangles = (indexed ? mesh.getNumIndices() : mesh.getNumVertices()) / 3;
+  for (int t = 0; t < numTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      if (selected[indexed ? mesh.getIndex(3 * t + k) : 3 * t + k]) {
+        triangles.push_back(t);
+        break;
+      }
+    }
+  }
+}
+
+void OctTree::growRoot(const ofVec3f &p) {
+  while (!isWithinBounds(root->box.min(), root->box.max(), p)) {
+    Vector3 lo = root->box.min(), hi = root->box.max();
+
+    // Double the box towards p on every axis; the old root becomes the
+    // octant on the side away from p.
+    //
+    bool backX = p.x < lo.x(), backY = p.y < lo.y(), backZ = p.z < lo.z();
+    Vector3 size(std::max(hi.x() - lo.x(), 1e-3f), std::max(hi.y() - lo.y(), 1e-3f),
+                 std::max(hi.z() - lo.z(), 1e-3f));
+    Vector3 min(backX ? lo.x() - size.x() : lo.x(), backY ? lo.y() - size.y() : lo.y(),
+                backZ ? lo.z() - size.z() : lo.z());
+    Vector3 max = min + size * 2;
+
+    int octant = (backY ? 4 : 0) + (backX ? (backZ ? 2 : 1) : (backZ ? 3 : 0));
+
+    root->deepen(1);
+    OctTreeNode *grown = arena.create<OctTreeNode>(min, max, 0, this, nullptr, 0);
+
+    Box b[8];
+    octants(grown->box, b);
+    grown->children = arena.allocateArray<OctTreeNode>(8);
+    grown->numChildren = 8;
+    grown->isLeaf = false;
+    grown->expanded = true;
+    for (int i = 0; i < 8; i++) {
+      if (i == octant) {
+        new (&grown->children[i]) OctTreeNode(*root);
+      } else {
+        new (&grown->children[i]) OctTreeNode(b[i].min(), b[i].max(), 1, this, nullptr, 0);
+        grown->children[i].subdivide();  // empty, becomes a leaf
+      }
+    }
+    grown->numPoints = root->numPoints;
+    root = grown;
+
+    LOG_DEBUG("Octtree root grown to " << toOf(min) << " - " << toOf(max));
+  }
+}
+
+size_t OctTree::memoryUsage() const {
+  return arena.bytesReserved() + (scratch.capacity() + order.capacity()) * sizeof(int);
+}
+
 //
 //
 // ---------------- OCTTREE - ENDS-- -------------------------------------------
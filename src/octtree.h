@@ -8,102 +8,93 @@
 #ifndef octtree_h
 #define octtree_h
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "ofMain.h"
 
 #include "Util.h"
+#include "arena.h"
 #include "box.h"
+#include "frustum.h"
 #include "ray.h"
+#include "spatialindex.h"
 
 // The sidmishraw_octtree namespace contains all the OctTree related
 // utilities.
 //
 namespace sidmishraw_octtree {
 
-// The maybe type for optional values
-//
-class MaybePoint {
-  bool bPresent;
-  ofVec3f point;
-
- public:
-  // Create maybe without a point
-  //
-  MaybePoint() { bPresent = false; }
-
-  // Create Maybe with a point.
-  //
-  MaybePoint(ofVec3f p) {
-    bPresent = true;
-    point = point;
-  }
-
-  // Checks if there is a point. True means a point was found,
-  // else false.
-  //
-  bool isPresent() { return this->bPresent; }
-
-  // Clears the contents of this maybe container, signifying that
-  // the current value is no longer valid.
-  //
-  void clear() { this->bPresent = false; }
-
-  // Returns the point that is present.
-  //
-  ofVec3f get() { return this->point; }
-
-  // Places a point in the maybe
-  //
-  void set(ofVec3f p) {
-    bPresent = true;
-    point = p;
-  }
-};
-
 class OctTree;  // forward declaring OctTree class
 
+// Splits the box into its 8 octants, in the order the children are kept:
+// the min corner one, then around the lower half (+x, +x+z, +z), then the
+// same 4 in the upper half.
+//
+void octants(const Box& box, Box b[8]);
+
 //---------------------------------------------------------------
 // OctTreeNode is a node in the OctTree data structure.
 //
+// Nodes and their index lists live in the OctTree's arena, so a node holds
+// plain pointers into it and is never destroyed on its own.
+//
 using namespace std;
-class OctTreeNode : public enable_shared_from_this<OctTreeNode> {
+class OctTreeNode {
  public:
   // Creates a new OctTreeNode for the given:
   // min bound,
   // max bound,
   // depth at which this OctTreeNode is present at,
   // the octtree that this node belongs to, and
-  // the indices of the vertices belonging to it.
+  // the indices of the vertices that may belong to it (only the ones
+  // within the bounds are kept).
   //
-  OctTreeNode(Vector3 min, Vector3 max, int d, weak_ptr<OctTree> tree, vector<int> indices);
+  OctTreeNode(const Vector3& min, const Vector3& max, int d, OctTree* tree, const int* indices, int count);
+
+  // Copies the node; the copy shares its children and index list. Used to
+  // move the root under a grown one.
+  //
+  OctTreeNode(const OctTreeNode& other);
 
   // ----------- ATTRIBUTES -----------------
 
   // The octtree to which this node belongs
   //
-  shared_ptr<OctTree> octTree;
+  OctTree* octTree;
 
   // The box that represents the octtree node.
   //
   Box box;
 
-  // Indices of the points that belong to this node.
+  // Indices of the points that belong to this node. Only leaves keep the
+  // list (capacity is its allocated length), inner nodes keep the count.
   //
-  vector<int> pointIndices;
+  int* pointIndices;
+  int numPoints;
+  int capacity;
 
-  // The children of this node. The leaf node has no children.
-  // Hence, all the children will be NULL pointers.
+  // The children of this node, 8 of them next to each other in the arena.
+  // The leaf node has no children, this is a NULL pointer then.
   // To save myself this trouble, I'll add in a boolean flag
   // to denote if this node is a leaf node.
   //
-  vector<shared_ptr<OctTreeNode>> children;
+  OctTreeNode* children;
+  int numChildren;
 
   // This flag indicates if the node is a leaf or not.
   //
   bool isLeaf;
 
+  // Whether the node has been split (or found small enough to stay a
+  // leaf). A lazy octtree's nodes start out as leaves holding all their
+  // points and split when a search first reaches them. Read it through
+  // isExpanded(), another thread may be expanding the node.
+  //
+  atomic<bool> expanded;
+
   // Depth this node belongs to.
   //
   int depth;
@@ -113,16 +104,31 @@ class OctTreeNode : public enable_shared_from_this<OctTreeNode> {
   //
   bool shouldLightUp;
 
+  // The node's points are order[first, last) of the octtree's order list,
+  // while that is up to date.
+  //
+  int first;
+  int last;
+
   // ----------- OPERATIONS ------------------
 
   // Draws the OctTreeNode.
   //
   void render();
 
-  // Subdivides this node to generate children nodes.
+  // Subdivides this node to generate children nodes, and them in turn
+  // unless the octtree is lazy.
   //
   void subdivide();
 
+  bool isExpanded() const;
+
+  // Splits the node if it hasn't been yet. Safe to call from several
+  // threads at once: the first one splits, the others wait for it.
+  // Returns whether this call split it.
+  //
+  bool expand();
+
   // Checks if the ray r intersects this node.
   //
   void intersects(const Ray& r, float t0, float t1);
@@ -130,14 +136,50 @@ class OctTreeNode : public enable_shared_from_this<OctTreeNode> {
   // Clears the shouldLightUp bit.
   //
   void clearSelection();
+
+  // Adds the point p (vertex index) to this node and the children it falls
+  // in, splitting leaves that get too full. A node not yet expanded just
+  // takes the point into its list, it splits when a search reaches it.
+  //
+  void insert(int index, const ofVec3f& p);
+
+  // Removes the point p (vertex index) from this node and its children,
+  // merging nodes left with few enough points back into leaves. Returns
+  // false when the point wasn't in this node.
+  //
+  bool remove(int index, const ofVec3f& p);
+
+  // Adds depth to the depth of this node and all of its children.
+  //
+  void deepen(int levels);
+
+ private:
+  // Appends to the leaf's list, growing it in the arena when full.
+  //
+  void append(int index);
+
+  // Gives the node its 8 children, or makes it a leaf when it is small
+  // enough, and marks it expanded.
+  //
+  void split();
+
+  // Turns this node back into a leaf with the points of its children.
+  //
+  void merge();
+
+  // The points of all the leaves below this node.
+  //
+  void collect(vector<int>& out) const;
 };
 
 //---------------------------------------------------------------
 // OctTree is a data structure for fast ray intersection testing.
 //
 using namespace std;
-class OctTree : public enable_shared_from_this<OctTree> {
+class OctTree : public SpatialIndex {
  public:
+  OctTree() : root(nullptr), bLazy(false), bOrderDirty(true) {}
+
   // ----------- ATTRIBUTES -----------------
 
   // Max depth to render.
@@ -154,21 +196,145 @@ class OctTree : public enable_shared_from_this<OctTree> {
 
   // The root node of the octtree.
   //
-  shared_ptr<OctTreeNode> root;
+  OctTreeNode* root;
+
+  // Storage for the nodes and their index lists. Regenerating rewinds it,
+  // so a rebuild reuses the memory of the previous tree.
+  //
+  Arena arena;
+
+  // Lazy octtrees only make the root in generate(), the nodes below split
+  // when a search or expandAround() first gets to them. Startup
+  // then costs a pass over the vertices and memory grows with the parts
+  // of the terrain looked at. Set it before generate().
+  //
+  bool bLazy;
+
+  // Held while a node of a lazy octtree splits: the arena and scratch
+  // aren't thread safe.
+  //
+  // A node's expanded flag only ever goes from false to true, under this
+  // mutex, and is published with a release store once the children are
+  // complete; isExpanded() reads it with an acquire load. Until then the
+  // node is a leaf holding all of its points, which inserts, removes and
+  // deforms update in place without splitting it. Searches may expand
+  // nodes from several threads at once, edits run on one thread and never
+  // alongside them.
+  //
+  mutex expandMutex;
+
+  // Scratch list used while filtering a node's points, before they are
+  // copied into the arena.
+  //
+  vector<int> scratch;
+
+  // A leaf splits when it holds more than LEAF_SIZE points, and a node
+  // left with LEAF_SIZE or fewer merges back into a leaf. Below
+  // MAX_TREE_DEPTH leaves don't split at all, so points at the same spot
+  // can share a leaf.
+  //
+  static const int LEAF_SIZE = 1;
+  static const int MAX_TREE_DEPTH = 24;
 
   // ----------- OPERATIONS ------------------
 
   // Generates this OctTree from the given mesh.
   //
-  void generate(const ofMesh& mesh, int maxLevel);
+  void generate(const ofMesh& mesh, int maxLevel) override;
 
   // Renders this OctTree.
   //
-  void render();
+  void render() override;
 
   // Searches the point of intersection given the ray.
   //
-  shared_ptr<MaybePoint> search(const Ray& r, float t0, float t1);
+  shared_ptr<MaybePoint> search(const Ray& r, float t0, float t1) override;
+
+  // Bytes held by the arena and the lists.
+  //
+  size_t memoryUsage() const override;
+
+  // Blocks the arena has taken from the heap.
+  //
+  long heapAllocations() const override { return (long)arena.heapAllocations(); }
+
+  string name() const override { return "octree"; }
+
+  // ----------- INCREMENTAL UPDATES ---------
+
+  // These change the tree after generate() without rebuilding it: only the
+  // nodes on the way down to the leaves holding the point are touched.
+  // Memory given up by shrinking nodes stays in the arena until the next
+  // generate().
+
+  // Adds a point (a rover, a marker, ...) and returns its vertex index. The
+  // root grows to take in points outside of it.
+  //
+  int insert(const ofVec3f& p);
+
+  // Removes the point with the vertex index; false when it isn't in the
+  // tree.
+  //
+  bool remove(int index);
+
+  // Moves the point with the vertex index to p.
+  //
+  bool update(int index, const ofVec3f& p);
+
+  // Raises (or, with a negative height, lowers) the vertices within radius
+  // of center on the XZ plane, with a smooth falloff towards the edge.
+  // Returns the number of vertices moved.
+  //
+  int deform(const ofVec3f& center, float radius, float height);
+
+  // Expands the nodes of a lazy octtree within radius of the points on
+  // the XZ plane down to their leaves, the points split between threads,
+  // so searches there find the tree ready. Returns the nodes split.
+  //
+  int expandAround(const vector<ofVec3f>& points, float radius);
+
+  // ----------- DRAG PICKING ----------------
+
+  // Finds the same point as search() without lighting up the nodes on the
+  // way, so it skips the sweep over the whole tree that clears their flags
+  // first; meant for the picks of a mouse drag.
+  //
+  shared_ptr<MaybePoint> pick(const Ray& r, float t0, float t1);
+
+  // ----------- RANGE QUERIES ---------------
+
+  // The vertex indices leaf by leaf in depth first order, each once (a
+  // point on the boundary of two leaves goes with the first), so the
+  // points below a node are the range order[node.first, node.last). The
+  // first query after the tree changes rebuilds it.
+  //
+  vector<int> order;
+
+  // These fill out with the vertex indices within the box or the frustum,
+  // each once, in the tree's order, and return how many there are. Nodes
+  // entirely inside are copied over as their whole range, with no test per
+  // point; only the leaves on the boundary test their points.
+
+  int queryBox(const Box& box, vector<int>& out);
+
+  int queryFrustum(const Frustum& frustum, vector<int>& out);
+
+  // Fills triangles with the indices of the mesh triangles that have a
+  // vertex among the vertices, e.g. the result of a query.
+  //
+  void trianglesOf(const vector<int>& vertices, vector<int>& triangles) const;
+
+ private:
+  friend class OctTreeNode;
+
+  // Doubles the root towards p until p is inside of it.
+  //
+  void growRoot(const ofVec3f& p);
+
+  // Rebuilds order and the nodes' ranges when the tree has changed.
+  //
+  void updateOrder();
+  bool bOrderDirty;
 };
 
 };  // namespace sidmishraw_octtree
@@ -23,11 +23,13 @@
 //  Date:           May 9, 2018
 
 #include "ofApp.h"
+#include "Benchmark.h"
 #include "Util.h"
 #include "ofxGui.h"
 
 #include <time.h>     // for timestamping
 #include <algorithm>  // for algorithms
+#include <cfloat>     // for FLT_MAX
 #include <chrono>     // for logging time taken for execution.
 #include <iostream>   // for io
 #include <regex>      // for file extension matching
@@ -37,11 +39,6 @@ using namespace std;
 using namespace sidmishraw_octtree;
 using namespace std::chrono;
 
-// added by sidmishraw ---
-// Maximum allowable depth at the moment.
-//
-const int MAX_LEVEL = 5;
-
 // added by sidmishraw ---
 // Performs the initial setup for the 4 cameras
 //
@@ -49,7 +46,7 @@ void setupCameras(ofEasyCam *cams) {
   for (int i = 0; i < 5; i++) {
     cams[i].setDistance(10);
     cams[i].setNearClip(.1);
-    cams[i].setFov(65.5);
+    cams[i].setFov(CAMERA_FOV);
     ofSetVerticalSync(true);
     cams[i].disableMouseInput();
   }
@@ -62,21 +59,33 @@ void setupCameras(ofEasyCam *cams) {
 void ofApp::setup() {
   bWireframe = false;
   bDisplayPoints = false;
+  bShowProfiler = false;
+  bShowTraversability = false;
+  bShowViewshed = false;
+  bShowOcclusion = true;
+  bTerrainLod = true;
+  textureCache.bCompress = COMPRESS_TEXTURES;
+  bHoverPoint = false;
+  bRoverColliding = false;
+  bPlanStartSet = false;
+  bBanding = false;
   bAltKeyDown = false;
   bCtrlKeyDown = false;
 
   // -- added by sidmishraw
   //
   pct = 0;
+  pathTick = roverTick = 0;
   selectedPtIndex = -1;
-  roverHeadingAngle = 0;  // 0 degrees - initially
   aniSelectedIndex = -1;  // initially the selected index is -1, so we start from beginning of the path
 
   tglVelSlider = false;
+  saveStatusTime = 0;
 
   // -- by default the terrain is deselected and rover is selected
   bTerrainSelected = false;
 
+  bTerrainLoaded = false;
   bRoverLoaded = false;
   bRoverSelected = false;  // true;
 
@@ -85,7 +94,6 @@ void ofApp::setup() {
   // camera setup
   //
   cameraIndex = 0;  // default camera set to world camera
-  bPanned = false;
 
   setupCameras(cams);
 
@@ -93,17 +101,10 @@ void ofApp::setup() {
   //
   initLightingAndMaterials();
 
-  mars.loadModel("geo/mars-low-v2.obj");
-  mars.setScaleNormalization(false);
-
-  boundingBoxT = meshBounds(mars.getMesh(0));
-
-  cout << "Mesh count - terrain = " << mars.getMeshCount() << endl;
-
-  // Octtree for terrain
+  // What is derived from the terrain is built while the app is already
+  // drawing
   //
-  octtreeT = make_shared<OctTree>();
-  octtreeT->generate(mars.getMesh(0), MAX_LEVEL);
+  loadTerrain(TERRAIN_MODEL);
 
   // adding GUI slider
   //
@@ -115,18 +116,19 @@ void ofApp::setup() {
 // Update the cameras
 //
 void ofApp::updateCams() {
-  if (bRoverLoaded) {
+  if (roverPlaced()) {
     // Rover's position
     //
-    auto rpos = rover.getPosition();
+    auto rpos = roverPosition();
 
     // rover's max bound's point - relative to rover
     // Since the scene max is in Rover's object space
     // I need to multiply it with the model matrix to bring it
     // into world space.
     //
-    auto rmax = rover.getSceneMax() * rover.getModelMatrix();
-    auto rmin = rover.getSceneMin() * rover.getModelMatrix();
+    auto model = roverMatrix();
+    auto rmax = roverModel.getSceneMax() * model;
+    auto rmin = roverModel.getSceneMin() * model;
 
     // Driver's view
     // POV of the rover's driver - front
@@ -137,7 +139,7 @@ void ofApp::updateCams() {
     // tracks the rover from a fixed point -- highest point of the
     // terrain's bounding box.
     //
-    auto trackingPoint = mars.getSceneMax();
+    auto trackingPoint = mars->getSceneMax();
     cams[2].setPosition(trackingPoint);
     cams[2].lookAt(rpos);     // tracking camera looks at the rover
     cams[2].setTarget(rpos);  // tracking camera orbits around the rover
@@ -157,11 +159,12 @@ void ofApp::updateCams() {
     //    cams[4].setPosition(ofVec3f(rpos.x, rmax.y, rmin.z));
     cams[4].setPosition(ofVec3f((rmax.x + rmin.x) / 2.0f, rmax.y, (rmax.z + rmin.z) / 2.0f));
 
-    if (!bPanned) {
-      cams[1].pan(180);  // look forward
-      cams[4].pan(0);    // always look back -- rear
-      bPanned = true;
-    }
+    // the front camera looks the way the rover is heading, the rear one
+    // the other way
+    //
+    auto heading = simulation.latest().roverHeading;
+    cams[1].lookAt(cams[1].getPosition() + heading);
+    cams[4].lookAt(cams[4].getPosition() - heading);
   }
 }
 
@@ -169,18 +172,14 @@ void ofApp::updateCams() {
 // Move the rover along the path
 //
 void ofApp::moveRover() {
-  // Rover animation mode
-  //
-  if (mode != ROVER_ANIMATION_MODE || pct >= 1) return;
-  if (nextPtIndex == pathPoints.size()) nextPtIndex = 0;
+  PROFILE_ZONE("moveRover");
 
-  // rover's current and next position
+  // The simulation placed the rover since the last frame
   //
-  auto p = rover.getPosition();  // current posn
-  ofVec3f s(p.x, 0, p.z);        // get the projection on XZ plane
-
-  auto roverPos = thePath.getPointAtPercent(pct);  // next posn
-  ofVec3f n(roverPos.x, 0, roverPos.z);            // get the projection on XZ plane
+  auto &state = simulation.latest();
+  if (!roverPlaced() || state.roverTick == roverTick) return;
+  roverTick = state.roverTick;
+  if (nextPtIndex == pathPoints.size()) nextPtIndex = 0;
 
   // -- didn't work as expected -- need to position the
   // cameras in the middle
@@ -193,68 +192,66 @@ void ofApp::moveRover() {
 
   nextPtIndex++;  // may not be needed -- NOTE
 
-  // Set the new position of the rover along the path
-  //
-  rover.setPosition(roverPos.x, roverPos.y, roverPos.z);
-
-  // compute the direction of motion
-  //
-  auto dirn = (n - s).normalize();            // the path heading vector
-  auto c = roverOrientation;                  // find the cross product
-  c.cross(dirn);                              // get the normal (cross-product)
-  auto theta = roverOrientation.angle(dirn);  // get the rotation angle
-
-  theta = c.y > 0 ? theta : -theta;  // sign depending upon the cross product
-
-  if (isnan(theta)) return;
-
-  // rotate the rover -- initial
-  //
-  rover.setRotation(rotCount, theta, 0, 1, 0);
-  rotCount++;
-
-  // pan the cameras along the Y axis
+  // the simulation posed it, resting on its wheels; what it hits is
+  // checked here
   //
-  cams[1].pan(theta);
-  cams[4].pan(theta);
+  checkRoverCollisions();
 
-  // rotations
-  //
-  roverHeadingAngle = theta;
-  roverOrientation = dirn;
+  LOG_TRACE("Rover at " << roverPosition() << " heading " << state.roverHeading << " pct = " << state.roverPct);
 }
 
 //--------------------------------------------------------------
 // incrementally update scene (animation)
 //
 void ofApp::update() {
+  // --- a frame is update() + draw(), close the previous one
+  Profiler::endFrame();
+
+  PROFILE_ZONE("update");
+
+  // --- report saves finished in the background
+  pollSaves();
+
+  // --- take in the assets loaded in the background
+  loader.poll();
+
+  // --- the latest the simulation published
+  auto &state = simulation.acquire();
+
   // --- update cameras
   updateCams();
 
-  if (pathPoints.size() >= 2) {
-    moveRover();
-  }
+  if (!bTerrainLoaded) return;
 
-  //  log("Rover's position " + ofToString(rover.getPosition()));
+  // --- terrain chunks at the levels of detail the camera needs
+  if (bTerrainLod && terrainLod.select(cams[cameraIndex], ofGetHeight(), LOD_PIXEL_ERROR, lodSelection)) {
+    terrainLod.apply(*mars, 0, lodSelection);
+  }
 
-  if (mode == PATH_CREATION_MODE || mode == PATH_EDIT_MODE) {
-    // -- update the path (curve on surface) made by user
-    //
-    thePath.clear();
-    for_each(pathPoints.begin(), pathPoints.end(), [this](ofVec3f pt) { this->thePath.curveTo(pt); });
+  // -- the simulation rebuilds the path (curve on surface) made by user
+  // when its points change, and the rover follows it at the slider's speed
+  //
+  if (pathPoints != simulatedPathPoints) {
+    simulatedPathPoints = pathPoints;
+    simulation.setPath(pathPoints);
   }
+  if (state.path && state.pathTick != pathTick) {
+    thePath = *state.path;
+    pathTick = state.pathTick;
+  }
+  simulation.setRoverSpeed(0.001f * velSlider);
+
+  moveRover();
 
   // Update the percantage of path covered
   //
-  pct = nextPct();
+  pct = state.roverPct;
 
   // loop back to starting point to restart the animation
   //
   //  if (pct >= 1) {
   //    pct = 0;
   //    nextPtIndex = 1;
-  //    roverHeadingAngle = 0;
-  //    roverOrientation = ofVec3f(0, 0, 1);  // +ve Z axis
   //  }
 }
 
@@ -278,68 +275,21 @@ void ofApp::playAnimation() {
   //
   pct = 0;
   nextPtIndex = 1;
-  roverHeadingAngle = 0;
-  roverOrientation = ofVec3f(0, 0, -1);  // positive Z axis - blue color line
-  rover.resetAllAnimations();
-  rotCount = 0;     // reset the rotation count
-  bPanned = false;  // reset the panning to make the front cam look forward
-
-  cams[1].reset();
-  cams[4].reset();
-
-  // reset all the rotations on the rover before next loop
-  //
-  for (int i = 0; i < rover.getNumRotations(); i++) {
-    rover.setRotation(i, 0, 0, 1, 0);
-  }
 
   if (pathPoints.size() > 1) {
     auto startPct = (aniSelectedIndex < 0) ? 0.0f : ((1.0 / pathPoints.size()) * aniSelectedIndex);
     pct = startPct;
 
-    log("Start % = " + ofToString(startPct), 1);
-
-    auto strtPt = thePath.getPointAtPercent(startPct);
-    log("Start pt = " + ofToString(strtPt), 1);
-
-    ofVec3f s(strtPt.x, 0, strtPt.z);  // keeping the start point on the XZ plane, Y is the normal
+    LOG_INFO("Start % = " << startPct);
 
-    //    log("Initial s = " + ofToString(s));
-
-    // Set the rover's position to the start of the path
+    // the simulation puts the rover at the start, facing along the path
+    // and resting on its wheels, and drives it on from there when animating
     //
-    rover.setPosition(strtPt.x, strtPt.y, strtPt.z);
+    simulation.startRover(startPct, mode == ROVER_ANIMATION_MODE);
 
-    // -- added by sidmishraw
-    // To rotate the rover along the Y axis
-    // I'll only consider the cooridinates of the X and Z axes when computing
-    // the angle of rotation.
-    //
-    auto nxtPt = thePath.getPointAtPercent(nextPct());  // next point to compute the alignment
-    ofVec3f n(nxtPt.x, 0, nxtPt.z);                     // keeping the point on the XZ plane, Y axis is the normal
-
-    // Compute the new orientation of the rover
-    //
-    auto dirn = (n - s).normalize();            // the path heading vector
-    auto c = roverOrientation;                  // find the cross product
-    c.cross(dirn);                              // get the normal (cross-product)
-    auto theta = roverOrientation.angle(dirn);  // get the rotation angle
-
-    theta = c.y > 0 ? theta : -theta;  // sign depending upon the cross product
-
-    if (isnan(theta)) return;
-
-    // rotate the rover -- initial
-    //
-    rover.setRotation(rotCount, theta, 0, 1, 0);
-    rotCount++;
-
-    // history of rover's orientation and angle
-    //
-    roverHeadingAngle = theta;
-    roverOrientation = dirn;
+    LOG_INFO("Start pt = " << thePath.getPointAtPercent(startPct));
   } else {
-    log("Not enough points in the path.", 1);
+    LOG_INFO("Not enough points in the path.");
   }
 }
 
@@ -367,31 +317,40 @@ void ofApp::drawBoundingBoxT() {
 // Draws the bounding box around rover
 //
 void ofApp::drawBoundingBoxR() {
-  if (bRoverLoaded) {
-    auto roverMx = rover.getModelMatrix();
+  if (roverPlaced()) {
+    auto roverMx = roverMatrix();
     ofPushMatrix();
     ofMultMatrix(roverMx);
     ofNoFill();
-    ofSetColor(255, 100, 100);
+    if (bRoverColliding)
+      ofSetColor(ofColor::red);  // the body hits the terrain
+    else
+      ofSetColor(255, 100, 100);
     drawBox(boundingBoxR);
     ofPopMatrix();
 
     // -- draw the bounding boxes for rover's components
+    // -- the ones touching the terrain in red
     //
-    for_each(roverCBBoxes.begin(), roverCBBoxes.end(), [this, &roverMx](Box box) {
+    for (size_t i = 0; i < roverCBBoxes.size(); i++) {
       ofPushMatrix();
       ofNoFill();
-      ofSetColor(0, 244, 33);
-      ofMultMatrix(rover.getModelMatrix());
+      if (i < roverComponentHits.size() && roverComponentHits[i])
+        ofSetColor(ofColor::red);
+      else
+        ofSetColor(0, 244, 33);
+      ofMultMatrix(roverMx);
       ofRotate(-90, 1, 0, 0);  // rotate 180 degrees about X axis
-      drawBox(box);
+      drawBox(roverCBBoxes[i]);
       ofPopMatrix();
-    });
+    }
   }
 }
 
 //--------------------------------------------------------------
 void ofApp::draw() {
+  PROFILE_ZONE("draw");
+
   ofBackground(ofColor::black);
 
   ofEnableSmoothing();  // moved here by sidmishraw for conflicts with ofxGui
@@ -405,14 +364,14 @@ void ofApp::draw() {
 
     ofDisableLighting();
     ofSetColor(ofColor::slateGray);
-    mars.drawWireframe();
+    mars->drawWireframe();
 
     if (bRoverLoaded) {
-      rover.drawWireframe();
+      fleet.draw(simulation.latest().fleet, OF_MESH_WIREFRAME);
 
-      if (bRoverSelected) {
+      if (bRoverSelected && roverPlaced()) {
         drawBoundingBoxR();
-        drawAxis(rover.getPosition());
+        drawAxis(roverPosition());
       }
     }
 
@@ -422,14 +381,14 @@ void ofApp::draw() {
     }
   } else {
     ofEnableLighting();  // shaded mode
-    mars.drawFaces();
+    mars->drawFaces();
 
     if (bRoverLoaded) {
-      rover.drawFaces();
+      fleet.draw(simulation.latest().fleet);
 
-      if (bRoverSelected) {
+      if (bRoverSelected && roverPlaced()) {
         drawBoundingBoxR();
-        drawAxis(rover.getPosition());
+        drawAxis(roverPosition());
         ofNoFill();
         ofSetColor(ofColor::pink);
       }
@@ -441,10 +400,21 @@ void ofApp::draw() {
     }
   }
 
+  if (bShowTraversability) traversability.draw();
+
+  if (regionOverlay.getNumVertices() > 0) {  // the rubber band selection
+    ofDisableLighting();
+    glPointSize(3);
+    ofSetColor(ofColor::orange);
+    regionOverlay.drawVertices();
+  }
+
+  if (bShowViewshed && viewshed) viewshed->draw();
+
   if (bDisplayPoints) {  // display points as an option
     glPointSize(3);
     ofSetColor(ofColor::green);
-    mars.drawVertices();
+    mars->drawVertices();
   }
 
   // highlight selected point (draw sphere around selected point)
@@ -457,6 +427,14 @@ void ofApp::draw() {
     });
   }
 
+  // the terrain under the mouse, where a click would put a point
+  //
+  if (bHoverPoint && (mode == PATH_CREATION_MODE || mode == PATH_PLANNING_MODE)) {
+    ofSetColor(ofColor::yellow);
+    ofNoFill();
+    ofDrawSphere(hoverPoint, 0.11);
+  }
+
   if (mode == PATH_EDIT_MODE) {
     // The dragged point
     //
@@ -496,6 +474,14 @@ void ofApp::draw() {
     ofDrawSphere(aniStartPt, 0.30);
   }
 
+  if (mode == PATH_PLANNING_MODE && bPlanStartSet) {
+    // The start of the path being planned
+    //
+    ofSetColor(ofColor::green);
+    ofNoFill();
+    ofDrawSphere(planStart, 0.30);
+  }
+
   thePath.draw();
 
   //  for (int i = 0; i < 5; i++) {
@@ -538,9 +524,33 @@ void ofApp::draw() {
   ofDisableSmoothing();  // moved here by sidmishraw for conflicts with ofxGui
   ofDisableDepthTest();  // moved here by sidmishraw for conflicts with ofxGui
 
+  // -- the rubber band being dragged
+  //
+  if (bBanding) {
+    ofNoFill();
+    ofSetColor(ofColor::orange);
+    ofDrawRectangle(bandStart.x, bandStart.y, bandEnd.x - bandStart.x, bandEnd.y - bandStart.y);
+  }
+
   // -- added by sidmishraw for drawing the slider
   //
   if (tglVelSlider) gui.draw();
+
+  if (loader.isBusy()) drawLoadingProgress();
+
+  // Show the outcome of the last save for a few seconds
+  //
+  if (saveStatus.length() > 0 && ofGetElapsedTimef() - saveStatusTime < 3.0f) {
+    ofSetColor(ofColor::white);
+    ofDrawBitmapString(saveStatus, 10, ofGetHeight() - 10);
+  }
+
+  // -- frame profiler, next to the slider panel when that is shown
+  //
+  if (bShowProfiler) {
+    float x = tglVelSlider ? gui.getPosition().x + gui.getWidth() + 10 : 10;
+    Profiler::drawOverlay(x, 20);
+  }
 }
 
 //
@@ -570,6 +580,10 @@ void ofApp::drawAxis(ofVec3f location) {
 }
 
 void ofApp::keyPressed(int key) {
+  // Until the terrain is in, only the cameras can be switched and moved
+  //
+  if (!bTerrainLoaded && !(key >= '1' && key <= '5') && key != OF_KEY_ALT) return;
+
   switch (key) {
     case '1': {
       // camera 0
@@ -603,18 +617,12 @@ void ofApp::keyPressed(int key) {
     }
 
     case OF_KEY_UP: {
-      if (bRoverLoaded) {
-        roverPos.x += 0.25;
-        rover.setPosition(roverPos.x, roverPos.y, roverPos.z);
-      }
+      if (roverPlaced()) simulation.placeRover(roverPosition() + ofVec3f(0.25, 0, 0));
       break;
     }
 
     case OF_KEY_DOWN: {
-      if (bRoverLoaded) {
-        roverPos.x -= 0.25;
-        rover.setPosition(roverPos.x, roverPos.y, roverPos.z);
-      }
+      if (roverPlaced()) simulation.placeRover(roverPosition() - ofVec3f(0.25, 0, 0));
       break;
     }
 
@@ -638,6 +646,139 @@ void ofApp::keyPressed(int key) {
       break;
     }
 
+    case 'o': {
+      // toggle the frame profiler and its overlay
+      //
+      bShowProfiler = !bShowProfiler;
+      Profiler::setEnabled(bShowProfiler || Profiler::isCapturing());
+      break;
+    }
+
+    case 'O': {
+      // start / stop a profiler capture for chrome://tracing
+      //
+      toggleProfilerCapture();
+      break;
+    }
+
+    case 'i': {
+      // cycle the picking index through the octtree, the linear octree,
+      // the compact octree and the BVH
+      //
+      switchTerrainIndex();
+      break;
+    }
+
+    case 'a': {
+      // Path planning mode toggle -- click the start, then the goal
+      //
+      mode = (mode == PATH_PLANNING_MODE) ? NORMAL : PATH_PLANNING_MODE;
+      bPlanStartSet = false;
+      break;
+    }
+
+    case 'x': {
+      // rubber band selection of the terrain
+      //
+      mode = (mode == REGION_SELECTION_MODE) ? NORMAL : REGION_SELECTION_MODE;
+      bBanding = false;
+      break;
+    }
+
+    case 'l': {
+      // toggle the viewshed of the driver's / rear camera
+      //
+      bShowViewshed = !bShowViewshed;
+      if (bShowViewshed) computeViewshed();
+      break;
+    }
+
+    case 'L': {
+      // camera coverage along the path -- saved as an image
+      //
+      computePathCoverage();
+      break;
+    }
+
+    case 'g': {
+      // toggle the traversability grid overlay
+      //
+      bShowTraversability = !bShowTraversability;
+      break;
+    }
+
+    case 'k': {
+      // toggle the baked ambient occlusion on the terrain
+      //
+      bShowOcclusion = !bShowOcclusion;
+      occlusion.apply(*mars, 0, bShowOcclusion);
+      break;
+    }
+
+    case 'e': {
+      // toggle the terrain's levels of detail (off draws every triangle)
+      //
+      bTerrainLod = !bTerrainLod;
+      lodSelection.clear();
+      if (!bTerrainLod) terrainLod.apply(*mars, 0, lodSelection);
+      break;
+    }
+
+    case 'm': {
+      // ray traced picture from the current camera
+      //
+      saveSnapshot();
+      break;
+    }
+
+    case 'M': {
+      // ray traced pictures from the driver's camera along the path
+      //
+      saveSnapshotsAlongPath();
+      break;
+    }
+
+    case 'n': {
+      // add rovers to the fleet driving along the path
+      //
+      spawnFleet();
+      break;
+    }
+
+    case '[':
+    case ']': {
+      // run the simulation slower / faster, back down to real time
+      //
+      float multiple = simulation.getSpeed() * (key == ']' ? 2 : 0.5f);
+      simulation.setSpeed(ofClamp(multiple, 1, MAX_SIMULATION_SPEED));
+      LOG_INFO("Simulation at " << simulation.getSpeed() << "x real time, tick "
+                                << simulation.latest().tickMs << " ms");
+      break;
+    }
+
+    case 'N': {
+      // remove the fleet
+      //
+      simulation.clearFleet();
+      break;
+    }
+
+    case 'B': {
+      // benchmark the terrain indices -- results go to the log
+      //
+      Benchmark::runIndexBenchmark(mars->getMesh(0), MAX_LEVEL);
+      Benchmark::runOctreeUpdateBenchmark(mars->getMesh(0), MAX_LEVEL);
+      Benchmark::runLazyOctreeBenchmark(mars->getMesh(0), MAX_LEVEL);
+      Benchmark::runDragPickBenchmark(mars->getMesh(0), MAX_LEVEL);
+      Benchmark::runOcclusionBakeBenchmark(mars->getMesh(0), MAX_LEVEL);
+      Benchmark::runTerrainLodBenchmark(mars->getMesh(0), MAX_LEVEL, HOVER_LOD);
+      Benchmark::runSnapshotBenchmark(mars->getMesh(0), MAX_LEVEL);
+      Benchmark::runFleetBenchmark(mars->getMesh(0), MAX_LEVEL);
+      Benchmark::runLinearOctreeBuildBenchmark();
+      Benchmark::runMeshOrderBenchmark(mars->getMesh(0), MAX_LEVEL);
+      break;
+    }
+
     case 'P': {
       // Point selection mode toggle for free camera retarget
       //
@@ -779,7 +920,18 @@ void ofApp::keyReleased(int key) {
 }
 
 //--------------------------------------------------------------
-void ofApp::mouseMoved(int x, int y) {}
+void ofApp::mouseMoved(int x, int y) {
+  if (!bTerrainLoaded || !hoverBvh) return;
+
+  // The terrain under the mouse, on the coarse level: near enough to show
+  // where a click lands, for a fraction of a full pick
+  //
+  ofVec3f rayPoint = cams[cameraIndex].screenToWorld(ofVec3f(x, y));
+  ofVec3f rayDir = (rayPoint - cams[cameraIndex].getPosition()).getNormalized();
+  float t;
+  bHoverPoint = hoverBvh->intersect(Ray(toVector3(rayPoint), toVector3(rayDir)), 0, FLT_MAX, t) >= 0;
+  if (bHoverPoint) hoverPoint = rayPoint + rayDir * t;
+}
 
 // -- added by sidmishraw --
 // Checks if the rover was selected with the mouse click by
@@ -789,11 +941,12 @@ void ofApp::mouseMoved(int x, int y) {}
 bool ofApp::roverSelected(const ofVec3f &mousePoint) {
   bool hit = false;
 
-  ofVec3f rayPoint = cams[cameraIndex].screenToWorld(mousePoint) * rover.getModelMatrix().getInverse();
-  ofVec3f rayDir = rayPoint - (cams[cameraIndex].getPosition() * rover.getModelMatrix().getInverse());
+  auto inverse = roverMatrix().getInverse();
+  ofVec3f rayPoint = cams[cameraIndex].screenToWorld(mousePoint) * inverse;
+  ofVec3f rayDir = rayPoint - (cams[cameraIndex].getPosition() * inverse);
   rayDir.normalize();
 
-  Ray ray = Ray(Vector3(rayPoint.x, rayPoint.y, rayPoint.z), Vector3(rayDir.x, rayDir.y, rayDir.z));
+  Ray ray = Ray(toVector3(rayPoint), toVector3(rayDir));
 
   for_each(roverCBBoxes.begin(), roverCBBoxes.end(), [this, &hit, &ray](Box b) {
     if (b.intersect(ray, -100, 100)) {
@@ -810,24 +963,36 @@ bool ofApp::roverSelected(const ofVec3f &mousePoint) {
 
 //--------------------------------------------------------------
 void ofApp::mousePressed(int x, int y, int button) {
+  PROFILE_ZONE("mousePressed");
+
+  if (!bTerrainLoaded) return;
+
   bMouseDown = true;
   mousePoint = ofVec3f(mouseX, mouseY);  // added by sidmishraw for drawing ray
 
+  // -- the rubber band starts here, the rest of the picking is skipped
+  //
+  if (mode == REGION_SELECTION_MODE) {
+    bandStart = bandEnd = ofVec2f(x, y);
+    bBanding = true;
+    return;
+  }
+
   ofVec3f mouse(mouseX, mouseY);
   ofVec3f rayPoint = cams[cameraIndex].screenToWorld(mouse);
   ofVec3f rayDir = rayPoint - cams[cameraIndex].getPosition();
   rayDir.normalize();
-  Ray ray = Ray(Vector3(rayPoint.x, rayPoint.y, rayPoint.z), Vector3(rayDir.x, rayDir.y, rayDir.z));
+  Ray ray = Ray(toVector3(rayPoint), toVector3(rayDir));
 
-  if (bRoverLoaded && roverSelected(mouse)) {
+  if (roverPlaced() && roverSelected(mouse)) {
     bRoverSelected = true;
     bTerrainSelected = false;
 
     auto rmx = boundingBoxR.max();
     auto rmi = boundingBoxR.min();
     auto c = (rmx + rmi) / 2.0;
-    selectedPoint = ofVec3f(c.x(), c.y(), c.z()) * rover.getModelMatrix();
-    log("Center - rover - bb = " + ofToString(selectedPoint));
+    selectedPoint = toOf(c) * roverMatrix();
+    LOG_DEBUG("Center - rover - bb = " << selectedPoint);
 
   } else if (boundingBoxT.intersect(ray, -100, 100)) {
     bTerrainSelected = true;
@@ -838,10 +1003,26 @@ void ofApp::mousePressed(int x, int y, int button) {
     if (mode == PATH_CREATION_MODE) {
       // Adding points to path
       //
-      auto maybePt = octtreeT->search(ray, -100, 100);  // fetch the point from octtree
+      auto maybePt = terrainIndex->search(ray, -100, 100);  // fetch the point from the terrain index
       if (maybePt->isPresent()) {
         auto pt = maybePt->get();
         pathPoints.push_back(pt);
+        if (!traversability.isTraversable(pt.x, pt.z)) LOG_INFO("Path point " << pt << " is not traversable");
+      }
+    }
+
+    // -- Start and goal for the path planner
+    //
+    if (mode == PATH_PLANNING_MODE) {
+      auto maybePt = terrainIndex->search(ray, -100, 100);  // fetch the point from the terrain index
+      if (maybePt->isPresent()) {
+        if (!bPlanStartSet) {
+          planStart = maybePt->get();
+          bPlanStartSet = true;
+        } else {
+          planPath(planStart, maybePt->get());
+          bPlanStartSet = false;
+        }
       }
     }
 
@@ -850,7 +1031,7 @@ void ofApp::mousePressed(int x, int y, int button) {
     if (mode == PATH_EDIT_MODE) {
       // Editing a point on the path
       //
-      auto maybePt = octtreeT->search(ray, -100, 100);  // fetch the point from octtree
+      auto maybePt = terrainIndex->search(ray, -100, 100);  // fetch the point from the terrain index
       if (maybePt->isPresent()) {
         auto pt = maybePt->get();
         auto loc = find(pathPoints.begin(), pathPoints.end(), pt);
@@ -858,8 +1039,8 @@ void ofApp::mousePressed(int x, int y, int button) {
         if (loc != pathPoints.end()) {
           selectedPoint = pt;
           selectedPtIndex = loc - pathPoints.begin();
-          log("Selected pt = " + ofToString(selectedPoint));
-          log("Selected pt index = " + ofToString(selectedPtIndex));
+          LOG_DEBUG("Selected pt = " << selectedPoint);
+          LOG_DEBUG("Selected pt index = " << selectedPtIndex);
         }
       }
     }
@@ -867,7 +1048,7 @@ void ofApp::mousePressed(int x, int y, int button) {
     // -- Select the point for beginning the animation
     //
     if (mode == ANIMATION_BEGIN_SELECTION_MODE) {
-      auto maybePt = octtreeT->search(ray, -100, 100);  // fetch the point from octtree
+      auto maybePt = terrainIndex->search(ray, -100, 100);  // fetch the point from the terrain index
       if (maybePt->isPresent()) {
         auto pt = maybePt->get();
         auto loc = find(pathPoints.begin(), pathPoints.end(), pt);
@@ -875,14 +1056,14 @@ void ofApp::mousePressed(int x, int y, int button) {
         if (loc != pathPoints.end()) {
           aniStartPt = pt;
           aniSelectedIndex = loc - pathPoints.begin();
-          log("Selected start point for animation = " + ofToString(aniStartPt));
-          log("Selected start index for animation = " + ofToString(aniSelectedIndex));
+          LOG_DEBUG("Selected start point for animation = " << aniStartPt);
+          LOG_DEBUG("Selected start index for animation = " << aniSelectedIndex);
         }
       } else {
         aniStartPt = pathPoints[0];  // path starts from the beginning
         pct = 0;                     // reset the pct
         aniSelectedIndex = -1;       // selected point not on path
-        log("Selected start index has been reset.");
+        LOG_DEBUG("Selected start index has been reset.");
       }
     }
 
@@ -891,11 +1072,11 @@ void ofApp::mousePressed(int x, int y, int button) {
     if (mode == POINT_SELECTION_MODE) {
       // Select the point for camera retargetting
       //
-      auto maybePt = octtreeT->search(ray, -100, 100);  // fetch the point from octtree
+      auto maybePt = terrainIndex->search(ray, -100, 100);  // fetch the point from the terrain index
       if (maybePt->isPresent()) {
         auto pt = maybePt->get();
         selectedPoint = pt;
-        log("Selected pt for camera retarget = " + ofToString(selectedPoint));
+        LOG_DEBUG("Selected pt for camera retarget = " << selectedPoint);
       }
     }
   } else {
@@ -915,7 +1096,7 @@ void ofApp::drawBox(const Box &box) {
   Vector3 size = max - min;
   Vector3 center = size / 2 + min;
 
-  ofVec3f p = ofVec3f(center.x(), center.y(), center.z());
+  ofVec3f p = toOf(center);
 
   float w = size.x();
   float h = size.y();
@@ -924,41 +1105,6 @@ void ofApp::drawBox(const Box &box) {
   ofDrawBox(p, w, h, d);
 }
 
-// return a Mesh Bounding Box for the entire Mesh
-//
-Box ofApp::meshBounds(const ofMesh &mesh) {
-  int n = mesh.getNumVertices();
-
-  ofVec3f v = mesh.getVertex(0);
-
-  ofVec3f max = v;
-  ofVec3f min = v;
-
-  for (int i = 1; i < n; i++) {
-    ofVec3f v = mesh.getVertex(i);
-
-    if (v.x > max.x)
-      max.x = v.x;
-    else if (v.x < min.x)
-      min.x = v.x;
-
-    if (v.y > max.y)
-      max.y = v.y;
-    else if (v.y < min.y)
-      min.y = v.y;
-
-    if (v.z > max.z)
-      max.z = v.z;
-    else if (v.z < min.z)
-      min.z = v.z;
-  }
-
-  auto minB = Vector3(min.x, min.y, min.z);
-  auto maxB = Vector3(max.x, max.y, max.z);
-
-  return Box(minB, maxB);
-}
-
 //  Subdivide a Box into eight(8) equal size boxes, return them in boxList;
 //
 void ofApp::subDivideBox8(const Box &box, vector<Box> &boxList) {
@@ -995,19 +1141,25 @@ void ofApp::subDivideBox8(const Box &box, vector<Box> &boxList) {
 
 //--------------------------------------------------------------
 void ofApp::mouseDragged(int x, int y, int button) {
+  if (!bTerrainLoaded) return;
+
   mousePoint = ofVec3f(mouseX, mouseY);  // added by sidmishraw for drawing ray
+
+  if (bBanding) bandEnd = ofVec2f(x, y);
   ofVec3f mouse(mouseX, mouseY);
   ofVec3f rayPoint = cams[cameraIndex].screenToWorld(mouse);
   ofVec3f rayDir = rayPoint - cams[cameraIndex].getPosition();
   rayDir.normalize();
-  Ray ray = Ray(Vector3(rayPoint.x, rayPoint.y, rayPoint.z), Vector3(rayDir.x, rayDir.y, rayDir.z));
+  Ray ray = Ray(toVector3(rayPoint), toVector3(rayDir));
 
   // -- Points selection to edit the path
   //
   if (mode == PATH_EDIT_MODE) {
-    // Editing a point on the path
+    // Editing a point on the path. The octtree's pick skips lighting up
+    // its nodes, which costs a sweep over the whole tree on every move.
     //
-    auto maybePt = octtreeT->search(ray, -100, 100);  // fetch the point from octtree
+    auto maybePt = terrainIndex == octtreeT ? octtreeT->pick(ray, -100, 100)
+                                            : terrainIndex->search(ray, -100, 100);
     if (maybePt->isPresent()) {
       auto pt = maybePt->get();
       selectedPoint = pt;
@@ -1019,7 +1171,14 @@ void ofApp::mouseDragged(int x, int y, int button) {
 
 //--------------------------------------------------------------
 void ofApp::mouseReleased(int x, int y, int button) {
+  if (!bTerrainLoaded) return;
+
   bMouseDown = false;
+  if (bBanding) {
+    bandEnd = ofVec2f(x, y);
+    bBanding = false;
+    selectRegion();
+  }
   if (mode == PATH_EDIT_MODE) {
     if (selectedPtIndex > -1) {
       pathPoints[selectedPtIndex] = selectedPoint;  // replace with new point
@@ -1033,7 +1192,7 @@ void ofApp::mouseReleased(int x, int y, int button) {
 //  if a point is selected, return true, else return false;
 //
 bool ofApp::doPointSelection() {
-  ofMesh mesh = mars.getMesh(0);
+  ofMesh mesh = mars->getMesh(0);
   int n = mesh.getNumVertices();
   float nearestDistance = 0;
   int nearestIndex = 0;
@@ -1086,12 +1245,12 @@ void ofApp::setCameraTarget() {
     // If the rover is selected, camera will retarget to the center of the
     // rover.
     //
-    if (bRoverSelected) {
+    if (bRoverSelected && roverPlaced()) {
       auto rmx = boundingBoxR.max();
       auto rmi = boundingBoxR.min();
       auto c = (rmx + rmi) / 2.0;
-      selectedPoint = ofVec3f(c.x(), c.y(), c.z()) * rover.getModelMatrix();
-      log("Center - rover - bb = " + ofToString(selectedPoint));
+      selectedPoint = toOf(c) * roverMatrix();
+      LOG_DEBUG("Center - rover - bb = " << selectedPoint);
     }
     cams[0].setTarget(selectedPoint);
   }
@@ -1139,13 +1298,51 @@ void ofApp::initLightingAndMaterials() {
   glShadeModel(GL_SMOOTH);
 }
 
+// Only the framebuffer read happens here, the PNG encoding and the
+// write are handed over to the save worker.
+//
 void ofApp::savePicture() {
   ofImage picture;
 
   picture.grabScreen(0, 0, ofGetWidth(), ofGetHeight());
-  picture.save("screenshot.png");
+  saver.savePixels(move(picture.getPixels()), "screenshot.png");
+
+  LOG_INFO("picture queued for saving");
+}
+
+// Start a profiler capture, or stop the running one and save it as
+// a Chrome trace.
+//
+void ofApp::toggleProfilerCapture() {
+  if (!Profiler::isCapturing()) {
+    Profiler::beginCapture();
+    Profiler::setEnabled(true);
+    LOG_INFO("Profiler capture started");
+    return;
+  }
+
+  auto trace = Profiler::endCapture();
+  Profiler::setEnabled(bShowProfiler);
+
+  auto fileName = "ProfileTrace_" + ofGetTimestampString("%Y_%m_%d_%H_%M_%S") + ".json";
+  LOG_INFO("Saving profiler capture at " << fileName);
+  saver.saveText(trace, fileName, ".json");
+}
 
-  log("picture saved", 1);
+// Report the saves that the worker has finished.
+//
+void ofApp::pollSaves() {
+  auto results = saver.poll();
+  for_each(results.begin(), results.end(), [this](const Tmnper::SaveResult &r) {
+    if (r.success) {
+      saveStatus = "Saved " + r.fileName;
+      LOG_INFO(saveStatus);
+    } else {
+      saveStatus = "Failed to save " + r.fileName;
+      LOG_ERROR(saveStatus);
+    }
+    saveStatusTime = ofGetElapsedTimef();
+  });
 }
 
 //--------------------------------------------------------------
@@ -1156,45 +1353,73 @@ void ofApp::savePicture() {
 void ofApp::dragEvent(ofDragInfo dragInfo) {
   std::for_each(dragInfo.files.begin(), dragInfo.files.end(), [this, &dragInfo](std::string filePath) {
     if (filePath.length() != 0 && regex_match(filePath, regex(".*PathPoints_.*\\" + FILE_EXT))) {
-      log("Restoring the path from disk!", 1);
+      if (!bTerrainLoaded) {
+        LOG_INFO("Drop the path again once the terrain is loaded");
+        return;
+      }
+      LOG_INFO("Restoring the path from disk!");
       this->loadPathFromDisk(filePath);
     } else {
-      log("Loading rover model from disk!", 1);
+      LOG_INFO("Loading rover model from disk!");
       this->loadRoverModel(filePath);
     }
   });
 }
 
 // -- added by sidmishraw for persistence
-// Load the rover model from disk
+// Load the rover model from disk. The file is read and its textures
+// decoded (or mapped from the texture cache) on the loader thread; the
+// frame after, the model is uploaded and measured, and the simulation
+// places the rover.
 //
 void ofApp::loadRoverModel(string filePath) {
   ofVec3f point;
   mouseIntersectPlane(ofVec3f(0, 0, 0), cams[cameraIndex].getZAxis(), point);
 
-  if (rover.loadModel(filePath)) {
-    rover.setScaleNormalization(false);
-    rover.setScale(.25, .25, .25);
-    rover.setPosition(point.x, point.y, point.z);
+  auto model = make_shared<SceneModel>();
+  auto work = [this, model, filePath, point](const AssetLoader::Report &report) -> AssetLoader::Finish {
+    report("model", 0);
+    if (!model->read(filePath, &textureCache)) {
+      LOG_ERROR("Error: Can't load model" << filePath);
+      return AssetLoader::Finish();
+    }
 
-    log("Rover position = " + ofToString(rover.getPosition()));
+    return [this, model, point]() {
+      roverModel = move(*model);
+      roverModel.upload();
+      roverModel.setScale(.25, .25, .25);
+      fleet.setModel(roverModel);
 
-    bRoverLoaded = true;
-    bRoverSelected = true;
+      LOG_DEBUG("Rover position = " << point);
 
-    auto pMin = rover.getSceneMin();
-    auto pMax = rover.getSceneMax();
+      bRoverLoaded = true;
+      bRoverSelected = true;
 
-    // the rover's bounding box (largest)
-    boundingBoxR = Box(Vector3(pMin.x, pMin.y, pMin.z), Vector3(pMax.x, pMax.y, pMax.z));
-    // the rover's component's bounding boxes (smaller ones)
-    for (int i = 0; i < rover.getMeshCount(); i++) {
-      roverCBBoxes.push_back(meshBounds(rover.getMesh(i)));
-    }
+      auto pMin = roverModel.getSceneMin();
+      auto pMax = roverModel.getSceneMax();
 
-  } else {
-    log("Error: Can't load model" + ofToString(filePath), 2);
-  }
+      // the rover's bounding box (largest)
+      boundingBoxR = Box(toVector3(pMin), toVector3(pMax));
+
+      // the rover's component's bounding boxes (smaller ones)
+      roverCBBoxes.clear();
+      for (unsigned i = 0; i < roverModel.getMeshCount(); i++) {
+        roverCBBoxes.push_back(meshBounds(roverModel.getMesh(i)));
+      }
+
+      // the wheel rectangle, from the world space box of the rover placed
+      // at the drop point (facing -Z)
+      //
+      auto placed = fleet.modelMatrix(ofMatrix4x4::newTranslationMatrix(point));
+      Box world = OrientedBox::fromBox(boundingBoxR, placed).bounds();
+      roverFootprint.halfTrack = (world.max().x() - world.min().x()) / 2;
+      roverFootprint.halfBase = (world.max().z() - world.min().z()) / 2;
+      roverFootprint.bottom = world.min().y() - point.y;
+      simulation.setFootprint(roverFootprint);
+      simulation.placeRover(point);
+    };
+  };
+  loader.load("rover", work);
 }
 
 bool ofApp::mouseIntersectPlane(ofVec3f planePoint, ofVec3f planeNorm, ofVec3f &point) {
@@ -1205,31 +1430,428 @@ bool ofApp::mouseIntersectPlane(ofVec3f planePoint, ofVec3f planeNorm, ofVec3f &
   return (rayIntersectPlane(rayPoint, rayDir, planePoint, planeNorm, point));
 }
 
+// Cycle the picking index through the octtree, the linear octree, the
+// compact octree and the BVH.
+//
+void ofApp::switchTerrainIndex() {
+  if (terrainIndex == octtreeT) {
+    if (!linearOctreeT) {
+      linearOctreeT = make_shared<LinearOctree>();
+      linearOctreeT->generate(mars->getMesh(0), MAX_LEVEL);
+    }
+    terrainIndex = linearOctreeT;
+  } else if (terrainIndex == linearOctreeT) {
+    if (!compactOctreeT) {
+      compactOctreeT = make_shared<CompactOctTree>();
+      compactOctreeT->generate(mars->getMesh(0), MAX_LEVEL);
+    }
+    terrainIndex = compactOctreeT;
+  } else if (terrainIndex == compactOctreeT) {
+    terrainBVH();
+    terrainIndex = bvhT;
+  } else {
+    terrainIndex = octtreeT;
+  }
+  LOG_INFO("Picking with the " << terrainIndex->name());
+}
+
+// The model is read and everything derived from it is built on the
+// loader thread into the Terrain, then swapped in at once, so picking,
+// planning and drawing never see half of a new terrain. The GL thread only
+// uploads the model's buffers.
+//
+void ofApp::loadTerrain(const string &fileName) {
+  struct Terrain {
+    shared_ptr<SceneModel> model;
+    Box bounds;
+    shared_ptr<OctTree> octtree;
+    shared_ptr<BVH> bvh;
+    TraversabilityMap traversability;
+    AmbientOcclusion occlusion;
+    TerrainLod lod;
+    shared_ptr<BVH> hover;
+  };
+  auto terrain = make_shared<Terrain>();
+  terrain->model = make_shared<SceneModel>();
+
+  auto work = [this, terrain, fileName](const AssetLoader::Report &report) -> AssetLoader::Finish {
+    report("model", 0);
+    auto &model = *terrain->model;
+    if (!model.read(fileName)) {
+      LOG_ERROR("Couldn't load the terrain " << fileName);
+      return AssetLoader::Finish();
+    }
+
+    // Before anything indexes the vertices
+    //
+    if (REORDER_TERRAIN) reorderMesh(model.parts[0].mesh);
+    const ofMesh &mesh = model.getMesh(0);
+    terrain->bounds = meshBounds(mesh);
+
+    report("octtree", 0.1f);
+    terrain->octtree = make_shared<OctTree>();
+    terrain->octtree->bLazy = LAZY_OCTREE;
+    terrain->octtree->generate(mesh, MAX_LEVEL);
+
+    report("bvh", 0.25f);
+    terrain->bvh = make_shared<BVH>();
+    terrain->bvh->generate(mesh, MAX_LEVEL);
+
+    // Traversability grid for path planning, and the ambient occlusion
+    // shading
+    //
+    report("traversability", 0.4f);
+    terrain->traversability.loadOrBuild(mesh, TRAVERSABILITY_CACHE);
+    report("ambient occlusion", 0.55f);
+    terrain->occlusion.loadOrBake(mesh, *terrain->bvh, OCCLUSION_CACHE);
+
+    // Coarser levels for drawing far chunks and for hover picking
+    //
+    report("levels of detail", 0.8f);
+    terrain->lod.loadOrBuild(mesh, LOD_CACHE);
+    terrain->hover = make_shared<BVH>();
+    terrain->hover->generate(terrain->lod.levelMesh(mesh, HOVER_LOD), MAX_LEVEL);
+
+    return [this, terrain]() {
+      terrain->model->upload();
+      mars = terrain->model;
+      LOG_INFO("Mesh count - terrain = " << mars->getMeshCount());
+
+      boundingBoxT = terrain->bounds;
+      octtreeT = terrain->octtree;
+      bvhT = terrain->bvh;
+      simulation.setTerrain(bvhT);
+      linearOctreeT.reset();
+      compactOctreeT.reset();
+      terrainIndex = octtreeT;
+      viewshed.reset();
+
+      traversability = move(terrain->traversability);
+      planner.prepare();
+      occlusion = move(terrain->occlusion);
+      occlusion.apply(*mars, 0, bShowOcclusion);
+      terrainLod = move(terrain->lod);
+      lodSelection.clear();
+      hoverBvh = terrain->hover;
+      bHoverPoint = false;
+
+      bTerrainLoaded = true;
+      prewarmOctree();
+    };
+  };
+  loader.load("terrain", work);
+}
+
+// The running load's job, step and progress.
+//
+void ofApp::drawLoadingProgress() {
+  auto progress = loader.progress();
+  if (progress.job.empty()) return;
+
+  float width = 300, height = 12;
+  float x = (ofGetWidth() - width) / 2, y = ofGetHeight() - 40;
+
+  ofFill();
+  ofSetColor(ofColor::gray);
+  ofDrawRectangle(x, y, width * ofClamp(progress.done, 0, 1), height);
+  ofNoFill();
+  ofSetColor(ofColor::white);
+  ofDrawRectangle(x, y, width, height);
+
+  string label = "Loading " + progress.job + (progress.step.empty() ? "" : ": " + progress.step);
+  if (progress.queued > 0) label += " (" + ofToString(progress.queued) + " more)";
+  ofDrawBitmapString(label, x, y - 6);
+}
+
+// Split the octtree's nodes along the path ahead of picking there.
+//
+void ofApp::prewarmOctree() {
+  if (!octtreeT || !octtreeT->bLazy || thePath.size() < 2) return;
+
+  auto start = ofGetElapsedTimeMillis();
+  auto samples = thePath.getResampledBySpacing(PREWARM_RADIUS).getVertices();
+  int split = octtreeT->expandAround(samples, PREWARM_RADIUS);
+  LOG_INFO("Prewarmed the octtree along the path: " << split << " nodes split in "
+                                                    << ofGetElapsedTimeMillis() - start << " ms, "
+                                                    << octtreeT->memoryUsage() / 1024 << " KiB");
+}
+
+// The terrain BVH, built the first time it is needed.
+//
+const BVH &ofApp::terrainBVH() {
+  if (!bvhT) {
+    bvhT = make_shared<BVH>();
+    bvhT->generate(mars->getMesh(0), MAX_LEVEL);
+  }
+  return *bvhT;
+}
+
+float ofApp::horizontalFov(const ofCamera &cam) {
+  float aspect = (float)ofGetWidth() / ofGetHeight();
+  return ofRadToDeg(2 * atan(tan(ofDegToRad(cam.getFov() / 2)) * aspect));
+}
+
+// Terrain visible from the driver's camera, or from the rear camera when
+// that is the one being viewed from.
+//
+void ofApp::computeViewshed() {
+  if (!bRoverLoaded) {
+    LOG_INFO("Load the rover to compute its viewshed");
+    bShowViewshed = false;
+    return;
+  }
+  if (!viewshed) viewshed = make_shared<Viewshed>(traversability, terrainBVH());
+
+  auto &cam = cams[cameraIndex == 4 ? 4 : 1];
+
+  Viewshed::Pose pose;
+  pose.eye = cam.getPosition();
+  pose.heading = cam.getLookAtDir();
+  pose.hfov = horizontalFov(cam);
+  pose.range = 0;
+
+  int visible = viewshed->compute(pose);
+  LOG_INFO("Viewshed from cam " << (cameraIndex == 4 ? 4 : 1) << ": " << visible << " cells visible, "
+                                << viewshed->stats.rays << " rays in " << viewshed->stats.ms << " ms ("
+                                << viewshed->stats.raysPerSec / 1e6 << " Mrays/s)");
+}
+
+// Camera coverage along the path: poses every cell along thePath for the
+// front and the rear camera, the counts saved as a grayscale image (one
+// pixel per traversability cell).
+//
+void ofApp::computePathCoverage() {
+  if (pathPoints.size() < 2) {
+    LOG_INFO("Create a path to compute its coverage");
+    return;
+  }
+  if (!viewshed) viewshed = make_shared<Viewshed>(traversability, terrainBVH());
+
+  float eyeHeight = roverEyeHeight();
+  float spacing = traversability.cellSize;
+  auto poses = Viewshed::posesAlongPath(thePath, spacing, eyeHeight, horizontalFov(cams[1]), false);
+  auto rear = Viewshed::posesAlongPath(thePath, spacing, eyeHeight, horizontalFov(cams[4]), true);
+  poses.insert(poses.end(), rear.begin(), rear.end());
+
+  viewshed->coverage(poses);
+  bShowViewshed = true;
+
+  auto &counts = viewshed->counts;
+  uint16_t most = max<uint16_t>(1, *max_element(counts.begin(), counts.end()));
+  int covered = counts.size() - count(counts.begin(), counts.end(), 0);
+
+  LOG_INFO("Coverage of " << poses.size() << " poses: " << covered << "/" << counts.size() << " cells seen, "
+                          << viewshed->stats.rays << " rays in " << viewshed->stats.ms << " ms ("
+                          << viewshed->stats.raysPerSec / 1e6 << " Mrays/s)");
+
+  ofPixels pixels;
+  pixels.allocate(traversability.cols, traversability.rows, OF_IMAGE_GRAYSCALE);
+  for (size_t i = 0; i < counts.size(); i++) pixels.getData()[i] = (unsigned char)(255 * counts[i] / most);
+
+  saver.savePixels(move(pixels), "Coverage_" + ofGetTimestampString("%Y_%m_%d_%H_%M_%S") + ".png");
+}
+
+float ofApp::roverEyeHeight() {
+  if (!roverPlaced()) return DEFAULT_EYE_HEIGHT;
+  return (roverModel.getSceneMax() * roverMatrix()).y - roverPosition().y;
+}
+
+// The renderer reads the terrain BVH and the baked occlusion, so the
+// pictures match the shaded terrain on screen.
+//
+void ofApp::saveSnapshot() {
+  SnapshotRenderer renderer(terrainBVH());
+  renderer.occlusion = bShowOcclusion ? &occlusion.occlusion : nullptr;
+
+  ofPixels pixels;
+  renderer.render(SnapshotRenderer::fromCamera(cams[cameraIndex]), SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT, pixels);
+  saver.savePixels(move(pixels), "Snapshot_" + ofGetTimestampString("%Y_%m_%d_%H_%M_%S") + ".png");
+
+  LOG_INFO("Snapshot from cam " << cameraIndex << " rendered in " << renderer.stats.ms << " ms ("
+                                << renderer.stats.raysPerSecond() / 1e6 << " Mrays/s)");
+}
+
+void ofApp::saveSnapshotsAlongPath() {
+  if (pathPoints.size() < 2) {
+    LOG_INFO("Create a path to render snapshots along it");
+    return;
+  }
+
+  // The job keeps what it reads, so a new terrain or path doesn't change
+  // the pictures halfway through
+  //
+  terrainBVH();
+  auto bvh = bvhT;
+  auto shading = make_shared<vector<float>>(bShowOcclusion ? occlusion.occlusion : vector<float>());
+  auto path = thePath;
+  float eyeHeight = roverEyeHeight(), fov = cams[1].getFov();
+  string prefix = "Snapshot_" + ofGetTimestampString("%Y_%m_%d_%H_%M_%S") + "_";
+
+  auto work = [this, bvh, shading, path, eyeHeight, fov, prefix](const AssetLoader::Report &report) {
+    SnapshotRenderer renderer(*bvh);
+    renderer.occlusion = shading->empty() ? nullptr : shading.get();
+    size_t count = renderer.renderAlongPath(
+        path, SNAPSHOT_SPACING, eyeHeight, fov, SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT,
+        [this, &report, &prefix](size_t i, size_t count, ofPixels &&pixels) {
+          saver.savePixels(move(pixels), prefix + ofToString(i, 4, '0') + ".png");
+          report("frame " + ofToString(i + 1) + " of " + ofToString(count), float(i + 1) / count);
+        });
+    LOG_INFO(count << " snapshots along the path queued for saving, " << (count == 0 ? 0 : renderer.stats.ms / count)
+                   << " ms per frame");
+    return AssetLoader::Finish();
+  };
+  loader.load("snapshots", work);
+}
+
+bool ofApp::roverPlaced() {
+  auto &state = simulation.latest();
+  return bRoverLoaded && state.roverPlaced && !state.fleet.empty();
+}
+
+ofMatrix4x4 ofApp::roverMatrix() { return fleet.modelMatrix(simulation.latest().fleet[0]); }
+
+ofVec3f ofApp::roverPosition() { return simulation.latest().fleet[0].getTranslation(); }
+
+// Checks the rover against the terrain: the body (its box above the wheel
+// clearance) and every component box.
+//
+void ofApp::checkRoverCollisions() {
+  auto &bvh = terrainBVH();
+  auto model = roverMatrix();
+
+  auto lo = boundingBoxR.min(), hi = boundingBoxR.max();
+  float clearance = ROVER_CLEARANCE * (hi.y() - lo.y());
+
+  // The model is flipped upside down by its transform, so the wheels are
+  // at the max Y side of the model space box.
+  //
+  Box body(lo, Vector3(hi.x(), hi.y() - clearance, hi.z()));
+  bool colliding = collide(bvh, OrientedBox::fromBox(body, model), collisionScratch) > 0;
+
+  if (colliding != bRoverColliding) {
+    if (colliding)
+      LOG_INFO("Rover body hits the terrain at " << roverPosition());
+    else
+      LOG_DEBUG("Rover body clear of the terrain");
+  }
+  bRoverColliding = colliding;
+
+  auto componentTransform = ofMatrix4x4::newRotationMatrix(-90, ofVec3f(1, 0, 0)) * model;
+  roverComponentHits.resize(roverCBBoxes.size());
+  for (size_t i = 0; i < roverCBBoxes.size(); i++) {
+    auto box = OrientedBox::fromBox(roverCBBoxes[i], componentTransform);
+    roverComponentHits[i] = collide(bvh, box, collisionScratch) > 0;
+  }
+}
+
+// Plans a path from start to goal over the traversability grid and
+// replaces the current path with it, ready to animate or save.
+//
+void ofApp::planPath(const ofVec3f &start, const ofVec3f &goal) {
+  vector<ofVec3f> planned;
+  if (!planner.plan(start, goal, planned)) {
+    LOG_INFO("No traversable path from " << start << " to " << goal << " (" << planner.stats.ms << " ms)");
+    return;
+  }
+
+  LOG_INFO("Planned " << planned.size() << " points in " << planner.stats.ms << " ms, "
+                      << planner.stats.coarseExpanded << " coarse / " << planner.stats.fineExpanded
+                      << " fine cells expanded" << (planner.stats.usedFallback ? " (full grid)" : ""));
+
+  // The planner gives cell centres; snap them to the terrain vertices under
+  // them, so the points can be picked for editing like hand placed ones.
+  //
+  terrainBVH();
+  auto &bvh = *bvhT;
+  float above = bvh.bounds.max().y() + 1;
+  pathPoints.clear();
+  for (auto &p : planned) {
+    auto snapped = bvh.search(Ray(Vector3(p.x, above, p.z), Vector3(0, -1, 0)), 0, FLT_MAX);
+    auto pt = snapped->isPresent() ? snapped->get() : p;
+    if (pathPoints.empty() || pathPoints.back() != pt) pathPoints.push_back(pt);
+  }
+  selectedPtIndex = -1;
+  aniSelectedIndex = -1;
+
+  thePath.clear();
+  for_each(pathPoints.begin(), pathPoints.end(), [this](ofVec3f pt) { this->thePath.curveTo(pt); });
+  prewarmOctree();
+
+  mode = NORMAL;
+}
+
+// Selects the terrain vertices seen through the rubber band, and the
+// triangles using them. A click without a drag clears the selection.
+//
+void ofApp::selectRegion() {
+  ofRectangle band(min(bandStart.x, bandEnd.x), min(bandStart.y, bandEnd.y), fabs(bandEnd.x - bandStart.x),
+                   fabs(bandEnd.y - bandStart.y));
+  if (band.width < 3 || band.height < 3) {
+    regionVertices.clear();
+    regionTriangles.clear();
+    regionOverlay.clear();
+    return;
+  }
+
+  auto start = chrono::steady_clock::now();
+  octtreeT->queryFrustum(Frustum::fromScreenRect(cams[cameraIndex], band), regionVertices);
+  octtreeT->trianglesOf(regionVertices, regionTriangles);
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  LOG_INFO("Selected " << regionVertices.size() << " vertices, " << regionTriangles.size() << " triangles in " << ms
+                       << " ms");
+
+  regionOverlay.clear();
+  regionOverlay.setMode(OF_PRIMITIVE_POINTS);
+  for (int index : regionVertices) regionOverlay.addVertex(octtreeT->mesh.getVertex(index));
+}
+
+// Adds rovers to the fleet, spread along thePath in lanes a rover and a
+// half wide. They drive at the speed the velocity slider gives the rover.
+//
+void ofApp::spawnFleet() {
+  if (!bRoverLoaded || pathPoints.size() < 2) {
+    LOG_INFO("Load the rover and create a path to spawn a fleet");
+    return;
+  }
+
+  // The simulation drives the fleet; the copy here only draws it
+  //
+  auto &state = simulation.latest();
+
+  // The rover moves 0.001 * velSlider of the path per tick
+  //
+  float speed = 0.001f * velSlider * Simulation::TICK_RATE * thePath.getPerimeter();
+  simulation.spawnFleet(FLEET_SPAWN, speed, 3 * roverFootprint.halfTrack);
+
+  LOG_INFO("Adding " << FLEET_SPAWN << " rovers to the fleet of " << state.fleet.size() << ", last tick "
+                     << state.fleetTickMs << " ms");
+}
+
 // -- added by sidmishraw
 // Switch the camera to view from.
 //
 void ofApp::switchCamera() {
   cameraIndex = (cameraIndex + 1) % 5;  // to keep the index
-  log("Viewing through camera #" + ofToString(cameraIndex));
+  LOG_DEBUG("Viewing through camera #" << cameraIndex);
 }
 
 // added by sidmishraw for persistence ---
 // Loads the pathPoints vector from the string
 //
-void ofApp::pathPointsFromString(string str) {
+void ofApp::pathPointsFromString(string str) { pathPoints = parsePathPoints(str); }
+
+vector<ofVec3f> ofApp::parsePathPoints(const string &str) {
   stringstream ss(str);
   string line;
-
-  // Clear the existing path points
-  //
-  pathPoints.clear();
+  vector<ofVec3f> points;
 
   int i = 0;
 
   vector<float> coordinates;
   while (ss >> line) {
     if (i == 3) {
-      pathPoints.push_back(ofVec3f(coordinates[0], coordinates[1], coordinates[2]));
+      points.push_back(ofVec3f(coordinates[0], coordinates[1], coordinates[2]));
       coordinates.clear();
     }
     i = i % 3;
@@ -1238,9 +1860,10 @@ void ofApp::pathPointsFromString(string str) {
   }
 
   if (coordinates.size() == 3) {
-    pathPoints.push_back(ofVec3f(coordinates[0], coordinates[1], coordinates[2]));
+    points.push_back(ofVec3f(coordinates[0], coordinates[1], coordinates[2]));
     coordinates.clear();
   }
+  return points;
 }
 
 // added by sidmishraw for persistence ---
@@ -1254,7 +1877,8 @@ string ofApp::pathPointsToString() {
 }
 
 // added by sidmishraw for persistence ---
-// Save the path points to a file using the current timestamp
+// Save the path points to a file using the current timestamp.
+// Returns once the save is queued.
 //
 bool ofApp::savePathToDisk() {
   stringstream fname;
@@ -1275,9 +1899,12 @@ bool ofApp::savePathToDisk() {
   auto ps = pathPointsToString();
   auto fileName = fname.str();
 
-  log("Saving path to disk at " + fileName, 1);
+  LOG_INFO("Saving path to disk at " << fileName);
 
-  return Tmnper::saveIntoTmpr(fileName, ps, FILE_EXT);
+  // The worker reports back through pollSaves() once the file is written.
+  //
+  saver.saveText(ps, fileName, FILE_EXT);
+  return true;
 }
 
 // added by sidmishraw for persistence ---
@@ -1290,4 +1917,5 @@ void ofApp::loadPathFromDisk(string fileName) {
   //
   thePath.clear();
   for_each(pathPoints.begin(), pathPoints.end(), [this](ofVec3f pt) { this->thePath.curveTo(pt); });
+  prewarmOctree();
 }
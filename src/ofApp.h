@@ -2,14 +2,31 @@
 
 #include "box.h"
 #include "ofMain.h"
-#include "ofxAssimpModelLoader.h"
 #include "ofxGui.h"
 #include "ray.h"
 
+#include "Profiler.h"
 #include "Util.h"
+#include "ambientocclusion.h"
+#include "assetloader.h"
+#include "bounds.h"
+#include "bvh.h"
+#include "collision.h"
+#include "compactocttree.h"
+#include "fleet.h"
+#include "linearoctree.h"
+#include "meshorder.h"
 #include "octtree.h"
+#include "planner.h"
+#include "scenemodel.h"
+#include "simulation.h"
+#include "snapshot.h"
+#include "terrainlod.h"
+#include "traversability.h"
+#include "viewshed.h"
 
-#include "Tmnper.hpp"  // for persistence -- by sidmishraw
+#include "AsyncSaver.hpp"  // for saving off the render thread
+#include "Tmnper.hpp"       // for persistence -- by sidmishraw
 
 using namespace sidmishraw_octtree;
 using namespace std;
@@ -18,15 +35,67 @@ using namespace std;
 //
 const string FILE_EXT = ".mars";
 
+// The terrain mesh and the caches of its traversability map, baked
+// ambient occlusion and levels of detail
+//
+const string TERRAIN_MODEL = "geo/mars-low-v2.obj";
+const string TRAVERSABILITY_CACHE = "geo/mars-low-v2.trav";
+const string OCCLUSION_CACHE = "geo/mars-low-v2.ao";
+const string LOD_CACHE = "geo/mars-low-v2.lod";
+
+// Where the rover's textures are kept decoded, and whether as BC1 blocks
+// (see texturecache.h)
+//
+const string TEXTURE_CACHE = "cache/textures";
+const bool COMPRESS_TEXTURES = true;
+
+// The error in pixels up to which a terrain chunk is drawn at a coarser
+// level, and the level hover picking runs on (see terrainlod.h)
+//
+const float LOD_PIXEL_ERROR = 1.5f;
+const int HOVER_LOD = 2;
+
+// Whether to put the terrain's vertices and triangles in spatial order
+// after loading it, for cache locality (see meshorder.h)
+//
+const bool REORDER_TERRAIN = true;
+
+// Whether the terrain octtree splits its nodes as picking reaches them
+// instead of all at startup
+//
+const bool LAZY_OCTREE = true;
+
+// added by sidmishraw ---
+// Maximum allowable depth at the moment.
+//
+const int MAX_LEVEL = 5;
+
+// Vertical field of view of the cameras, in degrees
+//
+const float CAMERA_FOV = 65.5f;
+
+// Height of the driver's camera above the path with no rover loaded
+//
+const float DEFAULT_EYE_HEIGHT = 1;
+
+// Spacing along the path of the ray traced snapshots, and their size
+// (see snapshot.h)
+//
+const float SNAPSHOT_SPACING = 10.0f;
+const int SNAPSHOT_WIDTH = 1280;
+const int SNAPSHOT_HEIGHT = 1024;
+
 // The various app modes.
 //
 enum AppMode {
-  NORMAL,                         // normal mode
-  POINT_SELECTION_MODE,           // select the point to retarget the camera
-  PATH_CREATION_MODE,             // create the path for the rover to follow
-  PATH_EDIT_MODE,                 // edit the path the rover is following
-  ROVER_ANIMATION_MODE,           // animate the rover -- move
-  ANIMATION_BEGIN_SELECTION_MODE  // select the starting point for the animation
+  NORMAL,                          // normal mode
+  POINT_SELECTION_MODE,            // select the point to retarget the camera
+  PATH_CREATION_MODE,              // create the path for the rover to follow
+  PATH_EDIT_MODE,                  // edit the path the rover is following
+  ROVER_ANIMATION_MODE,            // animate the rover -- move
+  ANIMATION_BEGIN_SELECTION_MODE,  // select the starting point for the animation
+  PATH_PLANNING_MODE,              // pick start and goal, the path is planned between them
+  REGION_SELECTION_MODE            // drag a rectangle to select the terrain inside it
 };
 
 class ofApp : public ofBaseApp {
@@ -62,7 +131,6 @@ class ofApp : public ofBaseApp {
   bool doPointSelection();
   void drawBox(const Box &box);
 
-  Box meshBounds(const ofMesh &);
   void subDivideBox8(const Box &b, vector<Box> &boxList);
 
   bool mouseIntersectPlane(ofVec3f planePoint, ofVec3f planeNorm, ofVec3f &point);
@@ -106,10 +174,6 @@ class ofApp : public ofBaseApp {
   //
   ofEasyCam cams[5];
 
-  // flag denoting if the POV cam has panned
-  //
-  bool bPanned;
-
   // offsets the follow cam so that it can follow
   // the rover.
   //
@@ -120,7 +184,15 @@ class ofApp : public ofBaseApp {
   //
   unsigned short int cameraIndex;
 
-  ofxAssimpModelLoader mars, rover;
+  // The terrain is replaced whole when a new one has loaded, see
+  // loadTerrain()
+  //
+  shared_ptr<SceneModel> mars = make_shared<SceneModel>();
+
+  // The rover as loaded, for measuring. It is drawn and posed as slot 0 of
+  // the fleet, see roverMatrix().
+  //
+  SceneModel roverModel;
   ofLight light;
 
   ofVec3f selectedPoint;
@@ -134,9 +206,15 @@ class ofApp : public ofBaseApp {
 
   bool bWireframe;
   bool bDisplayPoints;
+  bool bShowProfiler;  // frame profiler overlay
+  bool bShowTraversability;  // traversability grid overlay
+  bool bShowViewshed;        // viewshed / coverage overlay
+  bool bShowOcclusion;       // baked ambient occlusion on the terrain
+  bool bTerrainLod;          // terrain chunks drawn at their levels of detail
   bool bPointSelected;  // flag if point selection mode is online
   bool bTerrainSelected;
 
+  bool bTerrainLoaded;  // the input and the simulation wait for it
   bool bRoverLoaded;
   bool bRoverSelected;
 
@@ -160,6 +238,186 @@ class ofApp : public ofBaseApp {
   //
   shared_ptr<OctTree> octtreeT;
 
+  // BVH for the terrain, built the first time it is selected
+  //
+  shared_ptr<BVH> bvhT;
+
+  // Morton-code octree for the terrain, built the first time it is selected
+  //
+  shared_ptr<LinearOctree> linearOctreeT;
+
+  // Octtree with 8 byte nodes, built the first time it is selected
+  //
+  shared_ptr<CompactOctTree> compactOctreeT;
+
+  // The index used for picking -- octtreeT, linearOctreeT, compactOctreeT
+  // or bvhT
+  //
+  shared_ptr<SpatialIndex> terrainIndex;
+
+  // Cycles the picking index through the octtree, the linear octree, the
+  // compact octree and the BVH
+  //
+  void switchTerrainIndex();
+
+  // The terrain BVH, built on first use.
+  //
+  const BVH &terrainBVH();
+
+  // Expands the lazy octtree around thePath, PREWARM_RADIUS to either
+  // side, so picking along it doesn't stall on splitting nodes.
+  //
+  void prewarmOctree();
+  const float PREWARM_RADIUS = 5.0f;
+
+  // Slope / roughness / step grid of the terrain for the rover planner,
+  // cached in TRAVERSABILITY_CACHE next to the mesh.
+  //
+  TraversabilityMap traversability;
+
+  // Ambient occlusion of the terrain's vertices, cached in
+  // OCCLUSION_CACHE next to the mesh.
+  //
+  AmbientOcclusion occlusion;
+
+  // Coarser levels of the terrain, cached in LOD_CACHE next to the mesh,
+  // and the level every chunk is drawn at for the current camera.
+  //
+  TerrainLod terrainLod;
+  vector<int> lodSelection;
+
+  // Decoded model textures, cached in TEXTURE_CACHE. Only the loader
+  // thread uses it.
+  //
+  TextureCache textureCache{TEXTURE_CACHE};
+
+  // BVH over the terrain at HOVER_LOD, for the point under the mouse when
+  // it moves. Clicks still pick on the full terrain.
+  //
+  shared_ptr<BVH> hoverBvh;
+  ofVec3f hoverPoint;
+  bool bHoverPoint;
+
+  // Reads the terrain model and puts it in spatial order, then builds the
+  // octtree, the BVH, the traversability map, the occlusion and the levels
+  // of detail, all in the background (from their caches or built). The
+  // frame after they are done uploads the model and takes it and all of
+  // them in at once.
+  //
+  void loadTerrain(const string &fileName);
+
+  // Plans rover paths over the traversability grid.
+  //
+  PathPlanner planner{traversability};
+
+  // Start point picked in PATH_PLANNING_MODE, waiting for its goal.
+  //
+  ofVec3f planStart;
+  bool bPlanStartSet;
+
+  // Plans a path from start to goal and makes it the current path.
+  //
+  void planPath(const ofVec3f &start, const ofVec3f &goal);
+
+  // Visible terrain from the rover cameras, created on first use.
+  //
+  shared_ptr<Viewshed> viewshed;
+
+  // Computes the terrain visible from the driver's (or, when viewing from
+  // it, the rear) camera.
+  //
+  void computeViewshed();
+
+  // Sweeps the front and rear cameras along thePath and saves the coverage
+  // map as an image.
+  //
+  void computePathCoverage();
+
+  // Horizontal field of view of a camera, in degrees.
+  //
+  float horizontalFov(const ofCamera &cam);
+
+  // Height of the driver's camera above the rover's position.
+  //
+  float roverEyeHeight();
+
+  // Ray traced pictures of the terrain, which need no GL framebuffer: from
+  // the current camera, or from the driver's camera every SNAPSHOT_SPACING
+  // along thePath. The pictures along the path are rendered on the loader
+  // thread. Saved as SNAPSHOT_WIDTH x SNAPSHOT_HEIGHT PNGs.
+  //
+  void saveSnapshot();
+  void saveSnapshotsAlongPath();
+
+  // The rover's wheel rectangle, measured when the model is loaded.
+  //
+  Footprint roverFootprint;
+
+  // Fraction of the rover's height above the ground that only the wheels
+  // reach; terrain inside the box above it hits the body.
+  //
+  const float ROVER_CLEARANCE = 0.25f;
+
+  // Terrain contact of the body and of each component box, from the last
+  // check.
+  //
+  bool bRoverColliding;
+  vector<char> roverComponentHits;
+  vector<int> collisionScratch;
+
+  // Whether the simulation has placed the rover yet, and then its model
+  // transform and its position on its wheels, from the fleet's slot 0 in
+  // the latest snapshot.
+  //
+  bool roverPlaced();
+  ofMatrix4x4 roverMatrix();
+  ofVec3f roverPosition();
+
+  // Checks the rover's body and component boxes against the terrain.
+  //
+  void checkRoverCollisions();
+
+  // The user's rover, then copies of it driving along thePath, each in its
+  // own lane. The simulation moves them; this one only draws them.
+  //
+  RoverFleet fleet;
+
+  // Drives the rover and the fleet along the path on its own thread. The
+  // path points it was last given, the tick the copy in thePath was baked
+  // on and the last tick the rover was placed for.
+  //
+  Simulation simulation;
+  vector<ofVec3f> simulatedPathPoints;
+  uint64_t pathTick, roverTick;
+
+  // Fastest the simulation runs, in multiples of real time.
+  //
+  const float MAX_SIMULATION_SPEED = 32;
+
+  // Rovers added to the fleet at a time.
+  //
+  const int FLEET_SPAWN = 16;
+
+  // Adds FLEET_SPAWN rovers to the fleet, spread along thePath.
+  //
+  void spawnFleet();
+
+  // Rubber band dragged in REGION_SELECTION_MODE, in screen coordinates.
+  //
+  ofVec2f bandStart, bandEnd;
+  bool bBanding;
+
+  // The terrain vertices and triangles seen through the rubber band, and
+  // the vertices as points to draw.
+  //
+  vector<int> regionVertices, regionTriangles;
+  ofVboMesh regionOverlay;
+
+  // Selects the terrain inside the rubber band with an octtree frustum
+  // query.
+  //
+  void selectRegion();
+
   // -- added by sidmishraw --
   // for debugging rover
   //
@@ -194,13 +452,8 @@ class ofApp : public ofBaseApp {
   //
   float prevPct();
 
-  // For debugging --
-  //
-  ofVec3f roverPos;
-
   // -- added by sidmishraw
-  // Moves the rover on the selected path, starting from the specified
-  // point.
+  // Catches up with where the simulation last placed the rover.
   //
   void moveRover();
 
@@ -230,18 +483,6 @@ class ofApp : public ofBaseApp {
   //
   bool bMouseDown;
 
-  // -- added by sidmishraw
-  // Tracks the rover's current heading direction -- angle
-  //
-  float roverHeadingAngle;
-
-  // Keeps track of rover's current orientation
-  //
-  ofVec3f roverOrientation;
-  // Keeps track of rotations on the rover
-  //
-  int rotCount;
-
   // Animation related startpoint and index
   //
   ofVec3f aniStartPt;
@@ -253,16 +494,41 @@ class ofApp : public ofBaseApp {
   // Loads the pathPoints vector from the string
   //
   void pathPointsFromString(string str);
+  // The points of a path saved by pathPointsToString
+  //
+  static vector<ofVec3f> parsePathPoints(const string &str);
   // Creates the string representation for the pathPoints vector
   //
   string pathPointsToString();
   // Save the path points to a file using the current timestamp
   //
   bool savePathToDisk();
+  // Background worker that encodes and writes the screenshots and paths
+  //
+  Tmnper::AsyncSaver saver;
+  // Background worker that builds what is derived from the terrain
+  //
+  AssetLoader loader;
+  // Progress bar of the running load, at the bottom of the viewport
+  //
+  void drawLoadingProgress();
+  // Status of the last finished save, shown in the viewport for a while
+  //
+  string saveStatus;
+  float saveStatusTime;
+  // Reports the saves finished by the worker since the last frame
+  //
+  void pollSaves();
+
+  // Starts a profiler capture, or stops the running one and saves it
+  // as a Chrome trace (chrome://tracing).
+  //
+  void toggleProfilerCapture();
   // Load the contents from disk given the file name
   //
   void loadPathFromDisk(string fileName);
-  // Load the rover model from disk
+  // Load the rover model from disk, in the background. It is placed where
+  // the cursor was when it was dropped.
   //
   void loadRoverModel(string filePath);
 };
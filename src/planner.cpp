@@ -0,0 +1,224 @@
+//
+//  planner.cpp
+//  martian-terrain
+//
+
+#include "planner.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+
+using namespace std;
+
+// 8-connected neighbourhood.
+//
+static const int DX[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+static const int DZ[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+static const float SQRT2 = 1.41421356f;
+
+// Octile distance, a lower bound of the cost since no cell costs below 1.
+//
+static float octile(int dx, int dz) {
+  dx = abs(dx), dz = abs(dz);
+  return (dx + dz) + (SQRT2 - 2) * std::min(dx, dz);
+}
+
+PathPlanner::PathPlanner(const TraversabilityMap &map)
+    : map(map), preparedHash(0), coarseCols(0), coarseRows(0), currentStamp(0) {
+  stats = {0, 0, 0, false};
+}
+
+void PathPlanner::prepare() {
+  auto &limits = map.limits;
+  preparedHash = map.meshHash;
+  preparedLimits = limits;
+  preparedWeights = weights;
+
+  cost.resize(map.cells.size());
+  for (size_t i = 0; i < cost.size(); i++) {
+    auto &c = map.cells[i];
+    cost[i] = map.isTraversable(c) ? 1 + weights.slope * c.slope / limits.maxSlope +
+                                         weights.roughness * c.roughness / limits.maxRoughness
+                                   : INFINITY;
+  }
+
+  // A block costs the mean of its traversable cells; blocks that are
+  // mostly walls are walls themselves.
+  //
+  coarseCols = (map.cols + CLUSTER - 1) / CLUSTER;
+  coarseRows = (map.rows + CLUSTER - 1) / CLUSTER;
+  coarseCost.assign(coarseCols * coarseRows, INFINITY);
+
+  for (int bz = 0; bz < coarseRows; bz++) {
+    for (int bx = 0; bx < coarseCols; bx++) {
+      float sum = 0;
+      int open = 0, total = 0;
+      for (int z = bz * CLUSTER; z < std::min(map.rows, (bz + 1) * CLUSTER); z++) {
+        for (int x = bx * CLUSTER; x < std::min(map.cols, (bx + 1) * CLUSTER); x++) {
+          float c = cost[z * map.cols + x];
+          total++;
+          if (std::isfinite(c)) sum += c, open++;
+        }
+      }
+      if (open * 4 >= total) coarseCost[bz * coarseCols + bx] = sum / open;
+    }
+  }
+
+  g.assign(cost.size(), 0);
+  parent.assign(cost.size(), -1);
+  stamp.assign(cost.size(), 0);
+  currentStamp = 0;
+}
+
+bool PathPlanner::search(const Grid &grid, int start, int goal, vector<int> &route, int &expanded) {
+  typedef pair<float, int> Entry;  // f, cell
+  priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+
+  // Fresh stamp, so the scratch arrays need no clearing. On wrap around
+  // the stamps are reset once.
+  //
+  if (++currentStamp == 0) {
+    fill(stamp.begin(), stamp.end(), 0);
+    currentStamp = 1;
+  }
+
+  int goalX = goal % grid.cols, goalZ = goal / grid.cols;
+  float maxStep = grid.map ? grid.map->limits.maxStepPerCell * grid.map->cellSize : 0;
+
+  g[start] = 0;
+  parent[start] = -1;
+  stamp[start] = currentStamp;
+  open.push(Entry(octile(start % grid.cols - goalX, start / grid.cols - goalZ) * grid.cellScale, start));
+  expanded = 0;
+
+  while (!open.empty()) {
+    Entry top = open.top();
+    open.pop();
+
+    int cell = top.second;
+    int x = cell % grid.cols, z = cell / grid.cols;
+
+    // Stale entry, the cell was reached more cheaply since.
+    //
+    if (top.first > g[cell] + octile(x - goalX, z - goalZ) * grid.cellScale + 1e-4f) continue;
+
+    expanded++;
+    if (cell == goal) {
+      route.clear();
+      for (int c = goal; c != -1; c = parent[c]) route.push_back(c);
+      reverse(route.begin(), route.end());
+      return true;
+    }
+
+    for (int i = 0; i < 8; i++) {
+      int nx = x + DX[i], nz = z + DZ[i];
+      if (nx < 0 || nx >= grid.cols || nz < 0 || nz >= grid.rows) continue;
+
+      int next = nz * grid.cols + nx;
+      if (grid.allowed && !grid.allowed[next]) continue;
+
+      float c = grid.cost[next];
+      if (!std::isfinite(c)) {
+        if (next != goal) continue;
+        c = 1;  // a goal on a wall can still be reached from its neighbours
+      }
+
+      float length = i < 4 ? 1 : SQRT2;
+      if (grid.map && fabs(grid.map->cells[next].height - grid.map->cells[cell].height) > maxStep * length) continue;
+
+      float tentative = g[cell] + length * grid.cellScale * 0.5f * (grid.cost[cell] + c);
+      if (stamp[next] == currentStamp && tentative >= g[next]) continue;
+
+      stamp[next] = currentStamp;
+      g[next] = tentative;
+      parent[next] = cell;
+      open.push(Entry(tentative + octile(nx - goalX, nz - goalZ) * grid.cellScale, next));
+    }
+  }
+
+  return false;
+}
+
+bool PathPlanner::plan(const ofVec3f &start, const ofVec3f &goal, vector<ofVec3f> &path) {
+  PROFILE_ZONE("path plan");
+  auto begin = chrono::steady_clock::now();
+  stats = {0, 0, 0, false};
+
+  if (cost.size() != map.cells.size() || preparedHash != map.meshHash || preparedLimits != map.limits ||
+      preparedWeights != weights) {
+    prepare();
+  }
+
+  int sx, sz, gx, gz;
+  if (!map.cellIndex(start.x, start.z, sx, sz) || !map.cellIndex(goal.x, goal.z, gx, gz)) return false;
+
+  int startCell = sz * map.cols + sx, goalCell = gz * map.cols + gx;
+
+  // The start may sit on a wall (e.g. a rover parked on a rock); leaving it
+  // is allowed, entering other walls is not.
+  //
+  float startCost = cost[startCell];
+  if (!std::isfinite(startCost)) cost[startCell] = 1;
+
+  // Coarse route, then the corridor it runs through.
+  //
+  Grid coarse = {coarseCols, coarseRows, coarseCost.data(), nullptr, nullptr, (float)CLUSTER};
+  int coarseStart = (sz / CLUSTER) * coarseCols + sx / CLUSTER;
+  int coarseGoal = (gz / CLUSTER) * coarseCols + gx / CLUSTER;
+
+  float coarseStartCost = coarseCost[coarseStart];
+  if (!std::isfinite(coarseStartCost)) coarseCost[coarseStart] = 1;
+
+  vector<int> coarseRoute, route;
+  bool found = false;
+  if (search(coarse, coarseStart, coarseGoal, coarseRoute, stats.coarseExpanded)) {
+    vector<char> corridor(map.cells.size(), 0);
+    for (int block : coarseRoute) {
+      int bx = block % coarseCols, bz = block / coarseCols;
+      int x0 = std::max(0, (bx - 1) * CLUSTER), x1 = std::min(map.cols, (bx + 2) * CLUSTER);
+      int z0 = std::max(0, (bz - 1) * CLUSTER), z1 = std::min(map.rows, (bz + 2) * CLUSTER);
+      for (int z = z0; z < z1; z++) fill(&corridor[z * map.cols + x0], &corridor[z * map.cols] + x1, 1);
+    }
+
+    Grid fine = {map.cols, map.rows, cost.data(), corridor.data(), &map, 1};
+    found = search(fine, startCell, goalCell, route, stats.fineExpanded);
+  }
+
+  // The coarse grid only approximates connectivity; search the whole grid
+  // when the corridor doesn't get through.
+  //
+  if (!found) {
+    int expanded = 0;
+    Grid fine = {map.cols, map.rows, cost.data(), nullptr, &map, 1};
+    found = search(fine, startCell, goalCell, route, expanded);
+    stats.fineExpanded += expanded;
+    stats.usedFallback = true;
+  }
+
+  cost[startCell] = startCost;
+  coarseCost[coarseStart] = coarseStartCost;
+
+  if (found) {
+    // Keep the cells where the route turns, and enough in between for the
+    // curve through them to follow the route.
+    //
+    path.clear();
+    path.push_back(start);
+    int sinceLast = 0;
+    for (size_t i = 1; i + 1 < route.size(); i++) {
+      int dIn = route[i] - route[i - 1], dOut = route[i + 1] - route[i];
+      if (dIn != dOut || ++sinceLast >= SPACING) {
+        path.push_back(map.cellCenter(route[i] % map.cols, route[i] / map.cols));
+        sinceLast = 0;
+      }
+    }
+    path.push_back(goal);
+  }
+
+  stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+  return found;
+}
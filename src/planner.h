@@ -0,0 +1,110 @@
+//
+//  planner.h
+//  martian-terrain
+//
+
+#ifndef planner_h
+#define planner_h
+
+#include <vector>
+
+#include "ofMain.h"
+
+#include "traversability.h"
+
+//---------------------------------------------------------------
+// PathPlanner finds a minimum cost rover path over a TraversabilityMap.
+//
+// Moving through a cell costs 1 on flat, smooth ground and more on slopes
+// and rough ground; untraversable cells and steps taller than the rover can
+// climb are walls. Planning is hierarchical: A* first runs on a coarse grid
+// of CLUSTER x CLUSTER blocks, then a fine A* runs only through the blocks
+// of that coarse route (and their neighbours). When the corridor turns out
+// to be blocked, the fine search is repeated over the whole grid.
+//
+using namespace std;
+class PathPlanner {
+ public:
+  // Extra cost of a cell at the slope / roughness limit of the map.
+  //
+  struct Weights {
+    float slope = 4;
+    float roughness = 4;
+
+    bool operator!=(const Weights &other) const { return slope != other.slope || roughness != other.roughness; }
+  };
+
+  // Figures of the last plan() call.
+  //
+  struct Stats {
+    double ms;
+    int coarseExpanded;
+    int fineExpanded;
+    bool usedFallback;
+  };
+
+  // Fine cells per side of a coarse block.
+  //
+  static const int CLUSTER = 8;
+
+  // Path points are kept at least at every SPACING cells, and wherever the
+  // route turns.
+  //
+  static const int SPACING = 4;
+
+  explicit PathPlanner(const TraversabilityMap &map);
+
+  // ----------- OPERATIONS ------------------
+
+  // Computes the cell costs and the coarse grid. plan() calls it again
+  // itself when the map, its limits or the weights changed since.
+  //
+  void prepare();
+
+  // Plans from start to goal. On success the path (start and goal
+  // included, at terrain height) is written into path.
+  //
+  bool plan(const ofVec3f &start, const ofVec3f &goal, vector<ofVec3f> &path);
+
+  // ----------- ATTRIBUTES -----------------
+
+  Weights weights;
+  Stats stats;
+
+ private:
+  // A grid A* runs on: the costs per cell, the cells it may enter (all of
+  // them when allowed is NULL) and the map for step checks (coarse grids
+  // have none). cellScale is the length of a cell in fine cells.
+  //
+  struct Grid {
+    int cols, rows;
+    const float *cost;
+    const char *allowed;
+    const TraversabilityMap *map;
+    float cellScale;
+  };
+
+  bool search(const Grid &grid, int start, int goal, vector<int> &route, int &expanded);
+
+  const TraversabilityMap &map;
+
+  // What the costs were computed from
+  //
+  uint64_t preparedHash;
+  TraversabilityMap::Limits preparedLimits;
+  Weights preparedWeights;
+
+  vector<float> cost;  // per fine cell, INFINITY when blocked
+  int coarseCols, coarseRows;
+  vector<float> coarseCost;
+
+  // A* scratch, sized to the fine grid and reused between searches. A
+  // cell's entries are only valid when its stamp matches the search's.
+  //
+  vector<float> g;
+  vector<int> parent;
+  vector<unsigned> stamp;
+  unsigned currentStamp;
+};
+
+#endif /* planner_h */
@@ -11,32 +11,30 @@
  *      "An Efficient and Robust Ray-Box Intersection Algorithm"
  *      Journal of graphics tools, 10(1):49-54, 2005
  *
+ * The inverse direction and the direction signs are computed once here so
+ * the intersection kernels only multiply. The signs are packed in a 3 bit
+ * mask, bit i set when the direction is negative along axis i.
  */
 
 class Ray {
  public:
-  Ray() {}
-  Ray(Vector3 o, Vector3 d) {
-    origin = o;
-    direction = d;
-    inv_direction = Vector3(1 / d.x(), 1 / d.y(), 1 / d.z());
-    sign[0] = (inv_direction.x() < 0);
-    sign[1] = (inv_direction.y() < 0);
-    sign[2] = (inv_direction.z() < 0);
-  }
-  Ray(const Ray &r) {
-    origin = r.origin;
-    direction = r.direction;
-    inv_direction = r.inv_direction;
-    sign[0] = r.sign[0];
-    sign[1] = r.sign[1];
-    sign[2] = r.sign[2];
-  }
+  Ray() = default;
+  Ray(const Vector3 &o, const Vector3 &d)
+      : origin(o),
+        direction(d),
+        inv_direction(1 / d.x(), 1 / d.y(), 1 / d.z()),
+        signMask((inv_direction.x() < 0) | ((inv_direction.y() < 0) << 1) | ((inv_direction.z() < 0) << 2)) {}
+
+  // 1 if the direction is negative along the axis, else 0.
+  //
+  int sign(int axis) const { return (signMask >> axis) & 1; }
 
   Vector3 origin;
   Vector3 direction;
   Vector3 inv_direction;
-  int sign[3];
+  unsigned char signMask;
 };
 
+static_assert(std::is_trivially_copyable<Ray>::value, "Ray must stay trivially copyable");
+
 #endif  // _RAY_H_
@@ -0,0 +1,248 @@
+//
+//  scenemodel.cpp
+//  martian-terrain
+//
+
+#include "scenemodel.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <cfloat>
+#include <map>
+
+#include "assimp/cimport.h"
+#include "assimp/postprocess.h"
+#include "assimp/scene.h"
+
+using namespace std;
+
+// What ofxAssimpModelLoader::loadModel reads its files with, so the
+// meshes come out as the addon made them.
+//
+static const unsigned int READ_FLAGS =
+    aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_Triangulate | aiProcess_FlipUVs;
+
+// assimp's matrices are column vector, openFrameworks' row vector.
+//
+static ofMatrix4x4 toOf(const aiMatrix4x4 &m) {
+  return ofMatrix4x4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+}
+
+static ofFloatColor toOf(const aiColor4D &c) { return ofFloatColor(c.r, c.g, c.b, c.a); }
+
+static void readMesh(const aiMesh *source, ofMesh &mesh) {
+  mesh.clear();
+  mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+  unsigned int n = source->mNumVertices;
+  auto &vertices = mesh.getVertices();
+  vertices.reserve(n);
+  for (unsigned int v = 0; v < n; v++) {
+    auto &p = source->mVertices[v];
+    vertices.push_back(ofVec3f(p.x, p.y, p.z));
+  }
+  if (source->HasNormals()) {
+    auto &normals = mesh.getNormals();
+    normals.reserve(n);
+    for (unsigned int v = 0; v < n; v++) {
+      auto &normal = source->mNormals[v];
+      normals.push_back(ofVec3f(normal.x, normal.y, normal.z));
+    }
+  }
+  if (source->HasTextureCoords(0)) {
+    auto &texCoords = mesh.getTexCoords();
+    texCoords.reserve(n);
+    for (unsigned int v = 0; v < n; v++) {
+      auto &uv = source->mTextureCoords[0][v];
+      texCoords.push_back(ofVec2f(uv.x, uv.y));
+    }
+  }
+  if (source->HasVertexColors(0)) {
+    auto &colors = mesh.getColors();
+    colors.reserve(n);
+    for (unsigned int v = 0; v < n; v++) colors.push_back(toOf(source->mColors[0][v]));
+  }
+
+  auto &indices = mesh.getIndices();
+  indices.reserve(3 * source->mNumFaces);
+  for (unsigned int f = 0; f < source->mNumFaces; f++) {
+    auto &face = source->mFaces[f];
+    if (face.mNumIndices != 3) continue;
+    for (int k = 0; k < 3; k++) indices.push_back(face.mIndices[k]);
+  }
+}
+
+static void readMaterial(const aiMaterial *source, ofMaterial &material) {
+  aiColor4D color;
+  if (aiGetMaterialColor(source, AI_MATKEY_COLOR_DIFFUSE, &color) == AI_SUCCESS) {
+    material.setDiffuseColor(toOf(color));
+  }
+  if (aiGetMaterialColor(source, AI_MATKEY_COLOR_SPECULAR, &color) == AI_SUCCESS) {
+    material.setSpecularColor(toOf(color));
+  }
+  if (aiGetMaterialColor(source, AI_MATKEY_COLOR_AMBIENT, &color) == AI_SUCCESS) {
+    material.setAmbientColor(toOf(color));
+  }
+  if (aiGetMaterialColor(source, AI_MATKEY_COLOR_EMISSIVE, &color) == AI_SUCCESS) {
+    material.setEmissiveColor(toOf(color));
+  }
+  float shininess;
+  if (aiGetMaterialFloat(source, AI_MATKEY_SHININESS, &shininess) == AI_SUCCESS) material.setShininess(shininess);
+}
+
+static bool decodeImage(const string &path, TextureImage &image) {
+  ofPixels pixels;
+  if (!ofLoadImage(pixels, path)) return false;
+  const unsigned char *data = pixels.getData();
+  image.assign(TextureImage::RAW, pixels.getWidth(), pixels.getHeight(), pixels.getNumChannels(),
+               vector<unsigned char>(data, data + pixels.size()));
+  return true;
+}
+
+// Places the parts of the node and of the nodes below it in the model.
+//
+static void placeParts(const aiNode *node, const ofMatrix4x4 &parent, vector<SceneModel::Part> &parts) {
+  ofMatrix4x4 matrix = toOf(node->mTransformation) * parent;
+  for (unsigned int i = 0; i < node->mNumMeshes; i++) parts[node->mMeshes[i]].matrix = matrix;
+  for (unsigned int i = 0; i < node->mNumChildren; i++) placeParts(node->mChildren[i], matrix, parts);
+}
+
+SceneModel::SceneModel() : position(0, 0, 0), scale(1, 1, 1) { updateModelMatrix(); }
+
+bool SceneModel::read(const string &fileName, TextureCache *cache) {
+  PROFILE_ZONE("model read");
+  clear();
+
+  string file = ofToDataPath(fileName, true);
+  const aiScene *scene = aiImportFile(file.c_str(), READ_FLAGS);
+  if (!scene) {
+    LOG_ERROR("Assimp: " << aiGetErrorString());
+    return false;
+  }
+
+  // Textures are named relative to the model file. A texture used by
+  // several parts is decoded once.
+  //
+  string directory = ofFilePath::getEnclosingDirectory(file, false);
+  map<string, int> decoded;
+
+  parts.resize(scene->mNumMeshes);
+  for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+    const aiMesh *source = scene->mMeshes[m];
+    auto &part = parts[m];
+    readMesh(source, part.mesh);
+    part.texture = -1;
+    if (source->mMaterialIndex >= scene->mNumMaterials) continue;
+
+    const aiMaterial *material = scene->mMaterials[source->mMaterialIndex];
+    readMaterial(material, part.material);
+
+    aiString name;
+    if (material->GetTexture(aiTextureType_DIFFUSE, 0, &name) != AI_SUCCESS) continue;
+    string path = ofFilePath::join(directory, name.C_Str());
+    auto found = decoded.find(path);
+    if (found != decoded.end()) {
+      part.texture = found->second;
+      continue;
+    }
+
+    Texture texture;
+    texture.path = path;
+    if (!(cache ? cache->load(path, texture.image) : decodeImage(path, texture.image))) {
+      LOG_ERROR("Couldn't load the texture " << path);
+      continue;
+    }
+    part.texture = decoded[path] = textures.size();
+    textures.push_back(move(texture));
+  }
+  if (scene->mRootNode) placeParts(scene->mRootNode, ofMatrix4x4(), parts);
+  aiReleaseImport(scene);
+
+  sceneMin = ofVec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+  sceneMax = ofVec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (auto &part : parts) {
+    for (auto &v : part.mesh.getVertices()) {
+      ofVec3f p = v * part.matrix;
+      sceneMin = ofVec3f(std::min(sceneMin.x, p.x), std::min(sceneMin.y, p.y), std::min(sceneMin.z, p.z));
+      sceneMax = ofVec3f(std::max(sceneMax.x, p.x), std::max(sceneMax.y, p.y), std::max(sceneMax.z, p.z));
+    }
+  }
+
+  LOG_INFO("Read " << ofFilePath::getFileName(fileName) << ": " << parts.size() << " meshes, " << textures.size()
+                   << " textures");
+  return !parts.empty();
+}
+
+void SceneModel::upload() {
+  PROFILE_ZONE("model upload");
+
+  // The images (or the cache files they map) aren't needed once on the
+  // GPU.
+  //
+  for (auto &texture : textures) {
+    if (texture.image.isEmpty()) continue;
+    texture.image.upload(texture.texture);
+    texture.image.clear();
+  }
+  for (auto &part : parts) {
+    part.indices = part.mesh.getIndices();
+    part.vbo.setMesh(part.mesh, GL_STATIC_DRAW);
+  }
+}
+
+void SceneModel::clear() {
+  parts.clear();
+  textures.clear();
+  sceneMin = sceneMax = ofVec3f(0, 0, 0);
+}
+
+void SceneModel::drawFaces() { draw(OF_MESH_FILL); }
+
+void SceneModel::drawWireframe() { draw(OF_MESH_WIREFRAME); }
+
+void SceneModel::drawVertices() { draw(OF_MESH_POINTS); }
+
+void SceneModel::draw(ofPolyRenderMode mode) {
+  if (parts.empty()) return;
+
+  ofPushStyle();
+  ofPushMatrix();
+  ofMultMatrix(modelMatrix);
+  glPolygonMode(GL_FRONT_AND_BACK, ofGetGLPolyMode(mode));
+  for (auto &part : parts) {
+    ofTexture *texture = part.hasTexture() ? &textures[part.texture].texture : nullptr;
+    if (texture && !texture->isAllocated()) texture = nullptr;
+
+    ofPushMatrix();
+    ofMultMatrix(part.matrix);
+    if (texture) texture->bind();
+    part.material.begin();
+    part.vbo.drawElements(GL_TRIANGLES, part.indices.size());
+    part.material.end();
+    if (texture) texture->unbind();
+    ofPopMatrix();
+  }
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  ofPopMatrix();
+  ofPopStyle();
+}
+
+void SceneModel::setPosition(float x, float y, float z) {
+  position = ofVec3f(x, y, z);
+  updateModelMatrix();
+}
+
+void SceneModel::setScale(float x, float y, float z) {
+  scale = ofVec3f(x, y, z);
+  updateModelMatrix();
+}
+
+// As ofxAssimpModelLoader::updateModelMatrix: each gl call goes before
+// the ones made so far, so the scale applies first.
+//
+void SceneModel::updateModelMatrix() {
+  modelMatrix.makeIdentityMatrix();
+  modelMatrix.glTranslate(position);
+  modelMatrix.glRotate(180, 0, 0, 1);
+  modelMatrix.glScale(scale.x, scale.y, scale.z);
+}
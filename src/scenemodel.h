@@ -0,0 +1,111 @@
+//
+//  scenemodel.h
+//  martian-terrain
+//
+
+#ifndef scenemodel_h
+#define scenemodel_h
+
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "texturecache.h"
+
+using namespace std;
+
+//---------------------------------------------------------------
+// SceneModel is a model file read with assimp, drawn from its meshes.
+//
+// It loads in two steps, so that the GL thread only does the GL calls:
+// read() parses the file and decodes its textures, on any thread, and
+// upload() makes the VBOs and textures from them, on the GL thread.
+// ofxAssimpModelLoader does both in loadModel, on the thread calling it,
+// which holds up a frame for as long as the file takes. With a
+// TextureCache, read() takes the textures decoded from the cache instead.
+//
+// The file is read with the addon's default post processing, and the
+// model is posed and drawn the way the addon poses and draws its models,
+// so it stands in for it without moving anything on screen.
+//
+class SceneModel {
+ public:
+  // A texture of the model: decoded by read(), uploaded by upload().
+  //
+  struct Texture {
+    string path;
+    TextureImage image;
+    ofTexture texture;
+  };
+
+  // A mesh of the model, where it sits in the model and what it is drawn
+  // with.
+  //
+  struct Part {
+    ofMesh mesh;          // as read, in the part's own space
+    ofMatrix4x4 matrix;   // from the part's space into the model's
+    ofMaterial material;  // from the file's material
+    int texture;          // into textures, -1 for none
+
+    // What is drawn: the mesh's buffers, and the indices drawn from them.
+    // Changing the indices means setting them on the VBO too.
+    //
+    ofVbo vbo;
+    vector<ofIndexType> indices;
+
+    bool hasTexture() const { return texture >= 0; }
+  };
+
+  SceneModel();
+
+  // ----------- OPERATIONS ------------------
+
+  // Parses the file and decodes its textures, through the cache when
+  // given one, replacing what the model held. Doesn't touch GL, so it can
+  // run off the GL thread.
+  //
+  bool read(const string &fileName, TextureCache *cache = nullptr);
+
+  // Makes the VBOs and textures from what read() left. On the GL thread.
+  //
+  void upload();
+
+  void clear();
+
+  void drawFaces();
+  void drawWireframe();
+  void drawVertices();
+  void draw(ofPolyRenderMode mode);
+
+  // The pose: scaled, flipped about Z, then moved to the position.
+  //
+  void setPosition(float x, float y, float z);
+  void setScale(float x, float y, float z);
+
+  ofVec3f getPosition() const { return position; }
+  ofVec3f getScale() const { return scale; }
+  const ofMatrix4x4 &getModelMatrix() const { return modelMatrix; }
+
+  size_t getMeshCount() const { return parts.size(); }
+  const ofMesh &getMesh(int index) const { return parts[index].mesh; }
+
+  // Bounds of the parts in the model's space, before the pose.
+  //
+  ofVec3f getSceneMin() const { return sceneMin; }
+  ofVec3f getSceneMax() const { return sceneMax; }
+
+  // ----------- ATTRIBUTES -----------------
+
+  vector<Part> parts;
+  vector<Texture> textures;
+
+ private:
+  void updateModelMatrix();
+
+  ofVec3f position, scale;
+  ofMatrix4x4 modelMatrix;
+  ofVec3f sceneMin, sceneMax;
+};
+
+#endif /* scenemodel_h */
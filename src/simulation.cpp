@@ -0,0 +1,223 @@
+//
+//  simulation.cpp
+//  martian-terrain
+//
+
+#include "simulation.h"
+#include "Profiler.h"
+
+#include <chrono>
+
+using namespace std;
+
+// A thread that falls further behind than this, on a slow tick or at a
+// speed it can't keep up with, starts counting from now again rather than
+// catching up in a burst.
+//
+static const chrono::milliseconds MAX_LAG(250);
+
+// Wheels on level ground at the rover's own height, for a rover that
+// isn't resting on the terrain.
+//
+static GroundContact levelContact(const Footprint &footprint, const ofVec3f &position) {
+  GroundContact contact = GroundContact();
+  contact.normal = ofVec3f(0, 1, 0);
+  contact.height = position.y + footprint.bottom;
+  return contact;
+}
+
+Simulation::Snapshot::Snapshot()
+    : tick(0),
+      time(0),
+      tickMs(0),
+      pathTick(0),
+      roverPlaced(false),
+      roverPct(0),
+      roverHeading(0, 0, -1),
+      roverTick(0),
+      fleetTickMs(0) {}
+
+Simulation::Simulation()
+    : bStop(false),
+      speed(1),
+      roverSpeed(0),
+      controls(),
+      pathTick(0),
+      bRoverPlaced(false),
+      bRoverMoving(false),
+      roverPct(0),
+      roverHeading(0, 0, -1),
+      roverContact(),
+      roverTick(0),
+      ticks(0) {
+  footprint = {0, 0, 0};
+  worker = thread(&Simulation::run, this);
+}
+
+Simulation::~Simulation() {
+  {
+    lock_guard<mutex> lock(mtx);
+    bStop = true;
+  }
+  cv.notify_one();
+  if (worker.joinable()) worker.join();
+}
+
+void Simulation::setTerrain(shared_ptr<const BVH> terrain) {
+  lock_guard<mutex> lock(mtx);
+  controls.bvh = move(terrain);
+  controls.bTerrain = true;
+}
+
+void Simulation::setFootprint(const Footprint &wheels) {
+  lock_guard<mutex> lock(mtx);
+  controls.footprint = wheels;
+  controls.bFootprint = true;
+}
+
+void Simulation::setPath(const vector<ofVec3f> &points) {
+  lock_guard<mutex> lock(mtx);
+  controls.pathPoints = points;
+  controls.bPath = true;
+}
+
+void Simulation::startRover(float startPct, bool drive) {
+  lock_guard<mutex> lock(mtx);
+  controls.startPct = startPct;
+  controls.bStartRover = true;
+  controls.bDriveRover = drive;
+  controls.bPlaceRover = false;
+}
+
+void Simulation::placeRover(const ofVec3f &position) {
+  lock_guard<mutex> lock(mtx);
+  controls.placePosition = position;
+  controls.bPlaceRover = true;
+  controls.bStartRover = false;
+}
+
+void Simulation::spawnFleet(int count, float speed, float laneWidth) {
+  lock_guard<mutex> lock(mtx);
+  controls.spawnCount += count;
+  controls.spawnSpeed = speed;
+  controls.spawnLaneWidth = laneWidth;
+}
+
+void Simulation::clearFleet() {
+  lock_guard<mutex> lock(mtx);
+  controls.spawnCount = 0;
+  controls.bClearFleet = true;
+}
+
+void Simulation::run() {
+  auto next = chrono::steady_clock::now();
+
+  unique_lock<mutex> lock(mtx);
+  while (!bStop) {
+    lock.unlock();
+    tick();
+    lock.lock();
+
+    // The next tick is due 1 / (TICK_RATE * speed) seconds after this one
+    // was, whatever this one took.
+    //
+    float multiple = speed;
+    if (multiple <= 0) continue;
+
+    auto now = chrono::steady_clock::now();
+    next += chrono::duration_cast<chrono::steady_clock::duration>(
+        chrono::duration<double>(1.0 / (TICK_RATE * multiple)));
+    if (next < now - MAX_LAG) next = now;
+    cv.wait_until(lock, next, [this] { return bStop; });
+  }
+}
+
+void Simulation::tick() {
+  PROFILE_ZONE("simulation tick");
+  auto start = chrono::steady_clock::now();
+
+  Controls in = Controls();
+  {
+    lock_guard<mutex> lock(mtx);
+    swap(in, controls);
+  }
+  ticks++;
+
+  if (in.bTerrain) bvh = move(in.bvh);
+  if (in.bFootprint) {
+    footprint = in.footprint;
+    fleet.footprint = footprint;
+  }
+
+  // Baked here and measured before it is shared: ofPolyline works out its
+  // lengths on first use, and the render thread only ever reads it.
+  //
+  if (in.bPath) {
+    auto baked = make_shared<ofPolyline>();
+    for (auto &p : in.pathPoints) baked->curveTo(p);
+    baked->getPerimeter();
+    path = baked;
+    pathTick = ticks;
+    fleet.setRoute(*path);
+  }
+
+  if (in.bClearFleet) fleet.clear();
+  if (in.spawnCount > 0) fleet.spawn(in.spawnCount, in.spawnSpeed, in.spawnLaneWidth);
+
+  if (in.bPlaceRover) {
+    bRoverPlaced = true;
+    bRoverMoving = false;
+    roverPosition = in.placePosition;
+    roverContact = levelContact(footprint, roverPosition);
+    roverTick = ticks;
+  }
+
+  // At the start, facing the way it will move first.
+  //
+  if (in.bStartRover && path && path->size() >= 2) {
+    bRoverPlaced = true;
+    bRoverMoving = in.bDriveRover;
+    roverPct = in.startPct;
+    roverPosition = path->getPointAtPercent(roverPct);
+    ofVec3f p = path->getPointAtPercent(std::min(roverPct + roverSpeed, 1.0f));
+    ofVec3f heading(p.x - roverPosition.x, 0, p.z - roverPosition.z);
+    if (heading.lengthSquared() > 0) roverHeading = heading.getNormalized();
+    roverContact = bvh ? solveGroundContact(*bvh, footprint, roverPosition, roverHeading)
+                       : levelContact(footprint, roverPosition);
+    roverTick = ticks;
+  }
+
+  // The rover one step further along the path, resting on its wheels. It
+  // keeps its heading when it didn't move.
+  //
+  if (bRoverMoving && bvh && path && path->size() >= 2 && roverPct < 1) {
+    roverPct += roverSpeed;
+    ofVec3f p = path->getPointAtPercent(std::min(roverPct, 1.0f));
+    ofVec3f heading(p.x - roverPosition.x, 0, p.z - roverPosition.z);
+    if (heading.lengthSquared() > 0) roverHeading = heading.getNormalized();
+    roverPosition = p;
+    roverContact = solveGroundContact(*bvh, footprint, roverPosition, roverHeading);
+    roverTick = ticks;
+  }
+
+  if (bRoverPlaced) fleet.placeUser(roverPosition, roverHeading, roverContact);
+  if (bvh && fleet.size() > 0) fleet.tick(*bvh, 1.0f / TICK_RATE);
+
+  auto &out = snapshots.back();
+  out.tick = ticks;
+  out.time = double(ticks) / TICK_RATE;
+  out.path = path;
+  out.pathTick = pathTick;
+  out.roverPlaced = bRoverPlaced;
+  out.roverPct = roverPct;
+  out.roverHeading = roverHeading;
+  out.roverTick = roverTick;
+
+  // The others only once they have been rested on the terrain.
+  //
+  size_t placed = bvh ? fleet.size() : fleet.hasUser() ? 1 : 0;
+  out.fleet.assign(fleet.transforms.begin(), fleet.transforms.begin() + placed);
+  out.fleetTickMs = fleet.size() > (fleet.hasUser() ? 1u : 0u) ? fleet.stats.tickMs : 0;
+  out.tickMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  snapshots.publish();
+}
@@ -0,0 +1,180 @@
+//
+//  simulation.h
+//  martian-terrain
+//
+
+#ifndef simulation_h
+#define simulation_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "bvh.h"
+#include "collision.h"
+#include "fleet.h"
+#include "triplebuffer.h"
+
+using namespace std;
+using namespace sidmishraw_octtree;
+
+//---------------------------------------------------------------
+// Simulation moves the rovers on a thread of its own, at a fixed tick, so
+// a slow tick never holds up a frame and a slow frame never slows the
+// rovers down.
+//
+// Every tick it bakes the path when its points changed, drives the rover
+// along it and the fleet along the route, resting them on the terrain and
+// placing the rover as the fleet's slot 0, then publishes a Snapshot of the result through a TripleBuffer. The
+// render thread takes the latest snapshot once per frame and draws from
+// it; it never sees one half written, and the simulation never waits for
+// it.
+//
+// The render thread steers the simulation through the setters below,
+// which the next tick takes in. At a speed above 1 the ticks come that
+// many times more often (the simulated time per tick stays the same); at
+// 0 they come as fast as the thread can run them.
+//
+class Simulation {
+ public:
+  // Ticks per simulated second.
+  //
+  static const int TICK_RATE = 60;
+
+  // What a tick leaves for the render thread. Not changed once published.
+  //
+  struct Snapshot {
+    uint64_t tick;  // ticks run so far
+    double time;    // simulated seconds
+    double tickMs;  // what the last tick took
+
+    // The path through the points last set, and the tick it was baked on
+    //
+    shared_ptr<const ofPolyline> path;
+    uint64_t pathTick;
+
+    // The rover, whether it has been placed yet, and the last tick it was
+    // moved on
+    //
+    bool roverPlaced;
+    float roverPct;  // fraction of the path driven
+    ofVec3f roverHeading;
+    uint64_t roverTick;
+
+    // The fleet's rovers, placed on the terrain (see RoverFleet::draw()),
+    // the user's rover first once it is placed
+    //
+    vector<ofMatrix4x4> fleet;
+    double fleetTickMs;
+
+    Snapshot();
+  };
+
+  Simulation();
+
+  // Stops the thread.
+  //
+  ~Simulation();
+
+  // ----------- OPERATIONS ------------------
+
+  // The terrain the rovers drive on; nothing moves without one.
+  //
+  void setTerrain(shared_ptr<const BVH> bvh);
+
+  // The rover's wheels, for resting it and the fleet on the terrain.
+  //
+  void setFootprint(const Footprint &footprint);
+
+  // Bakes a new path through the points.
+  //
+  void setPath(const vector<ofVec3f> &points);
+
+  // Puts the rover at startPct along the path, facing along it and resting
+  // on the terrain; when driven, it then moves pctPerTick of the path per
+  // tick until it reaches the end.
+  //
+  void startRover(float startPct, bool drive = true);
+  void setRoverSpeed(float pctPerTick) { roverSpeed = pctPerTick; }
+
+  // Stands the rover level at position, stopped.
+  //
+  void placeRover(const ofVec3f &position);
+
+  // Adds count rovers to the fleet along the path, at around speed units
+  // per simulated second, in lanes laneWidth apart; or removes them all.
+  //
+  void spawnFleet(int count, float speed, float laneWidth);
+  void clearFleet();
+
+  // Simulated seconds per real second, 0 for as fast as it goes.
+  //
+  void setSpeed(float multiple) { speed = std::max(multiple, 0.0f); }
+  float getSpeed() const { return speed; }
+
+  // The latest snapshot, which stays as it is until the next call. On the
+  // render thread only.
+  //
+  const Snapshot &acquire() { return snapshots.acquire(); }
+
+  // The snapshot the last acquire() returned.
+  //
+  const Snapshot &latest() const { return snapshots.front(); }
+
+ private:
+  void run();
+
+  // Takes in what the setters left, then moves everything one tick on.
+  //
+  void tick();
+
+  thread worker;
+  bool bStop;  // under mtx
+  atomic<float> speed;
+  atomic<float> roverSpeed;
+
+  // Left by the setters for the next tick, under mtx
+  //
+  mutable mutex mtx;
+  condition_variable cv;
+  struct Controls {
+    shared_ptr<const BVH> bvh;
+    bool bTerrain;
+    Footprint footprint;
+    bool bFootprint;
+    vector<ofVec3f> pathPoints;
+    bool bPath;
+    float startPct;
+    bool bStartRover, bDriveRover;
+    ofVec3f placePosition;
+    bool bPlaceRover;
+    int spawnCount;
+    float spawnSpeed, spawnLaneWidth;
+    bool bClearFleet;
+  } controls;
+
+  // The thread's own state
+  //
+  shared_ptr<const BVH> bvh;
+  Footprint footprint;
+  shared_ptr<const ofPolyline> path;
+  uint64_t pathTick;
+  bool bRoverPlaced, bRoverMoving;
+  float roverPct;
+  ofVec3f roverPosition, roverHeading;
+  GroundContact roverContact;
+  uint64_t roverTick;
+  RoverFleet fleet;
+  uint64_t ticks;
+
+  TripleBuffer<Snapshot> snapshots;
+};
+
+#endif /* simulation_h */
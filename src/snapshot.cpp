@@ -0,0 +1,152 @@
+//
+//  snapshot.cpp
+//  martian-terrain
+//
+
+#include "snapshot.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include "viewshed.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+static_assert(SnapshotRenderer::PACKET * SnapshotRenderer::PACKET <= BVH::MAX_PACKET,
+              "a packet must fit the BVH's packet intersect");
+
+SnapshotRenderer::SnapshotRenderer(const BVH &bvh)
+    : lightDirection(ofVec3f(1, 1, 1).getNormalized()),
+      terrainColor(0.78f, 0.52f, 0.34f),
+      horizonColor(0.86f, 0.72f, 0.56f),
+      zenithColor(0.52f, 0.40f, 0.32f),
+      ambient(0.3f),
+      occlusion(nullptr),
+      bSingleRays(false),
+      bvh(bvh) {
+  stats = {0, 0, 0};
+}
+
+SnapshotRenderer::View SnapshotRenderer::fromCamera(const ofCamera &cam) {
+  return {cam.getPosition(), cam.getLookAtDir(), cam.getUpDir(), cam.getFov()};
+}
+
+SnapshotRenderer::View SnapshotRenderer::fromHeading(const ofVec3f &eye, const ofVec3f &heading, float fov) {
+  return {eye, heading.getNormalized(), ofVec3f(0, 1, 0), fov};
+}
+
+void SnapshotRenderer::render(const View &view, int width, int height, ofPixels &pixels) {
+  PROFILE_ZONE("snapshot render");
+  auto start = chrono::steady_clock::now();
+
+  pixels.allocate(width, height, OF_IMAGE_COLOR);
+
+  int cols = (width + TILE - 1) / TILE, rows = (height + TILE - 1) / TILE;
+  ThreadPool::parallelFor(cols * rows, 1, [&](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; tile++) {
+      int x0 = (tile % cols) * TILE, y0 = (tile / cols) * TILE;
+      renderBlock(view, width, height, x0, y0, min(x0 + TILE, width), min(y0 + TILE, height), pixels);
+    }
+  });
+
+  stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  stats.rays = (uint64_t)width * height;
+  stats.threads = ThreadPool::size();
+  LOG_DEBUG("Snapshot " << width << "x" << height << " in " << stats.ms << " ms: " << stats.raysPerSecond() / 1e6
+                        << " Mrays/s on " << stats.threads << " threads");
+}
+
+size_t SnapshotRenderer::renderAlongPath(const ofPolyline &path, float spacing, float eyeHeight, float fov, int width,
+                                         int height, const Save &save) {
+  float hfov = ofRadToDeg(2 * atan(tan(ofDegToRad(fov / 2)) * width / height));
+  auto poses = Viewshed::posesAlongPath(path, spacing, eyeHeight, hfov, false);
+
+  Stats total = {0, 0, 0};
+  for (size_t i = 0; i < poses.size(); i++) {
+    ofPixels pixels;
+    render(fromHeading(poses[i].eye, poses[i].heading, fov), width, height, pixels);
+    total.ms += stats.ms;
+    total.rays += stats.rays;
+    total.threads = stats.threads;
+    save(i, poses.size(), move(pixels));
+  }
+  stats = total;
+  return poses.size();
+}
+
+void SnapshotRenderer::renderBlock(const View &view, int width, int height, int x0, int y0, int x1, int y1,
+                                   ofPixels &pixels) const {
+  // Camera basis, with the image plane at distance 1
+  //
+  ofVec3f forward = view.forward.getNormalized();
+  ofVec3f right = forward.getCrossed(view.up).getNormalized();
+  ofVec3f up = right.getCrossed(forward);
+  float tanY = tan(ofDegToRad(view.fov / 2)), tanX = tanY * width / height;
+  Vector3 origin = toVector3(view.eye);
+
+  unsigned char *data = pixels.getData();
+  Ray rays[PACKET * PACKET];
+  int hits[PACKET * PACKET];
+  float t[PACKET * PACKET];
+
+  for (int py = y0; py < y1; py += PACKET) {
+    for (int px = x0; px < x1; px += PACKET) {
+      int w = min(PACKET, x1 - px), h = min(PACKET, y1 - py), n = w * h;
+      for (int i = 0; i < n; i++) {
+        float sx = (2 * (px + i % w + 0.5f) / width - 1) * tanX;
+        float sy = (1 - 2 * (py + i / w + 0.5f) / height) * tanY;
+        rays[i] = Ray(origin, toVector3((forward + right * sx + up * sy).getNormalized()));
+      }
+
+      if (bSingleRays) {
+        for (int i = 0; i < n; i++) hits[i] = bvh.intersect(rays[i], 0, FLT_MAX, t[i]);
+      } else {
+        bvh.intersect(rays, n, 0, FLT_MAX, hits, t);
+      }
+
+      for (int i = 0; i < n; i++) {
+        ofFloatColor c = shade(rays[i], hits[i], t[i]);
+        unsigned char *p = data + 3 * ((size_t)(py + i / w) * width + px + i % w);
+        p[0] = (unsigned char)(255 * ofClamp(c.r, 0, 1));
+        p[1] = (unsigned char)(255 * ofClamp(c.g, 0, 1));
+        p[2] = (unsigned char)(255 * ofClamp(c.b, 0, 1));
+      }
+    }
+  }
+}
+
+ofFloatColor SnapshotRenderer::shade(const Ray &ray, int hit, float t) const {
+  if (hit < 0) {
+    float up = max(0.0f, ray.direction.y());
+    return horizonColor.getLerped(zenithColor, up);
+  }
+
+  // Flat shaded: the face's normal, turned towards the eye
+  //
+  auto &tri = bvh.triangles[hit];
+  Vector3 normal = tri.e1 ^ tri.e2;
+  normal.normalize();
+  if (normal * ray.direction > 0) normal = -normal;
+  float light = ambient + (1 - ambient) * max(0.0f, normal * toVector3(lightDirection));
+
+  // The occlusion at the hit, from the triangle's vertices by barycentric
+  // weights
+  //
+  if (occlusion && occlusion->size() == bvh.mesh.getNumVertices()) {
+    Vector3 p = ray.origin + ray.direction * t - tri.v0;
+    float d00 = tri.e1 * tri.e1, d01 = tri.e1 * tri.e2, d11 = tri.e2 * tri.e2;
+    float d20 = p * tri.e1, d21 = p * tri.e2;
+    float denom = d00 * d11 - d01 * d01;
+    if (denom != 0) {
+      float v = (d11 * d20 - d01 * d21) / denom, w = (d00 * d21 - d01 * d20) / denom;
+      auto &o = *occlusion;
+      light *= (1 - v - w) * o[tri.index[0]] + v * o[tri.index[1]] + w * o[tri.index[2]];
+    }
+  }
+  return ofFloatColor(terrainColor.r * light, terrainColor.g * light, terrainColor.b * light);
+}
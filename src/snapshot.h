@@ -0,0 +1,116 @@
+//
+//  snapshot.h
+//  martian-terrain
+//
+
+#ifndef snapshot_h
+#define snapshot_h
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "bvh.h"
+
+using namespace std;
+using namespace sidmishraw_octtree;
+
+//---------------------------------------------------------------
+// SnapshotRenderer ray casts images of the terrain on the CPU, for
+// machines without a GL context (savePicture() can only read back the
+// framebuffer).
+//
+// The image is cut into TILE x TILE tiles that the worker threads take
+// in turn. Within a tile the camera rays go through the terrain BVH in
+// PACKET x PACKET packets, which walk the tree together. A hit is shaded
+// with the scene's light on the triangle's face, darkened by the baked
+// ambient occlusion when there is one; a miss gets the sky.
+//
+class SnapshotRenderer {
+ public:
+  // Pixels on a side of the tiles handed to the threads, and of the
+  // packets traced together (PACKET^2 <= BVH::MAX_PACKET).
+  //
+  static const int TILE = 32;
+  static const int PACKET = 8;
+
+  // Where the picture is taken from. fov is the vertical field of view in
+  // degrees, like ofCamera's.
+  //
+  struct View {
+    ofVec3f eye;
+    ofVec3f forward;
+    ofVec3f up;
+    float fov;
+  };
+
+  struct Stats {
+    double ms;
+    uint64_t rays;
+    unsigned threads;
+
+    double raysPerSecond() const { return ms > 0 ? rays / ms * 1000 : 0; }
+  };
+
+  explicit SnapshotRenderer(const BVH &bvh);
+
+  // The view of a camera, e.g. one of the app's ofEasyCams.
+  //
+  static View fromCamera(const ofCamera &cam);
+
+  // A view from eye looking along heading, level with the horizon.
+  //
+  static View fromHeading(const ofVec3f &eye, const ofVec3f &heading, float fov);
+
+  // ----------- OPERATIONS ------------------
+
+  // Renders a width x height RGB picture of the view into pixels.
+  //
+  void render(const View &view, int width, int height, ofPixels &pixels);
+
+  // Renders a width x height picture every spacing along the path, from
+  // eyeHeight above it looking along it, and hands each to save with its
+  // index and the number of pictures. Returns that number; stats add up
+  // over all of them.
+  //
+  using Save = function<void(size_t index, size_t count, ofPixels &&pixels)>;
+  size_t renderAlongPath(const ofPolyline &path, float spacing, float eyeHeight, float fov, int width, int height,
+                         const Save &save);
+
+  // ----------- ATTRIBUTES -----------------
+
+  // Direction towards the light, the GL light's by default.
+  //
+  ofVec3f lightDirection;
+
+  ofFloatColor terrainColor;
+  ofFloatColor horizonColor, zenithColor;
+
+  // Light reaching faces turned away from the light.
+  //
+  float ambient;
+
+  // Per vertex occlusion of the BVH's mesh (AmbientOcclusion::occlusion),
+  // or null for none.
+  //
+  const vector<float> *occlusion;
+
+  // Trace ray by ray instead of in packets, to compare the two.
+  //
+  bool bSingleRays;
+
+  Stats stats;
+
+ private:
+  // Renders the pixels of the rectangle [x0, x1) x [y0, y1).
+  //
+  void renderBlock(const View &view, int width, int height, int x0, int y0, int x1, int y1, ofPixels &pixels) const;
+
+  ofFloatColor shade(const Ray &ray, int hit, float t) const;
+
+  const BVH &bvh;
+};
+
+#endif /* snapshot_h */
@@ -0,0 +1,96 @@
+//
+//  spatialindex.h
+//  martian-terrain
+//
+
+#ifndef spatialindex_h
+#define spatialindex_h
+
+#include <memory>
+#include <string>
+
+#include "ofMain.h"
+
+#include "ray.h"
+
+namespace sidmishraw_octtree {
+
+// The maybe type for optional values
+//
+class MaybePoint {
+  bool bPresent;
+  ofVec3f point;
+
+ public:
+  // Create maybe without a point
+  //
+  MaybePoint() { bPresent = false; }
+
+  // Create Maybe with a point.
+  //
+  MaybePoint(ofVec3f p) {
+    bPresent = true;
+    point = p;
+  }
+
+  // Checks if there is a point. True means a point was found,
+  // else false.
+  //
+  bool isPresent() { return this->bPresent; }
+
+  // Clears the contents of this maybe container, signifying that
+  // the current value is no longer valid.
+  //
+  void clear() { this->bPresent = false; }
+
+  // Returns the point that is present.
+  //
+  ofVec3f get() { return this->point; }
+
+  // Places a point in the maybe
+  //
+  void set(ofVec3f p) {
+    bPresent = true;
+    point = p;
+  }
+};
+
+//---------------------------------------------------------------
+// SpatialIndex is the query interface shared by the terrain acceleration
+// structures, so the app can swap one for another at runtime.
+//
+using namespace std;
+class SpatialIndex {
+ public:
+  virtual ~SpatialIndex() {}
+
+  // Builds the index over the given mesh. maxLevel is the deepest level
+  // rendered by render().
+  //
+  virtual void generate(const ofMesh& mesh, int maxLevel) = 0;
+
+  // Renders the index' bounding boxes.
+  //
+  virtual void render() = 0;
+
+  // Searches the mesh vertex picked by the ray r within (t0, t1).
+  //
+  virtual shared_ptr<MaybePoint> search(const Ray& r, float t0, float t1) = 0;
+
+  // Bytes held by the index, for the benchmark.
+  //
+  virtual size_t memoryUsage() const = 0;
+
+  // Heap allocations the index has made for its nodes so far, for the
+  // benchmark; -1 when it doesn't count them.
+  //
+  virtual long heapAllocations() const { return -1; }
+
+  // Short name for logs and the benchmark report.
+  //
+  virtual string name() const = 0;
+};
+
+}  // namespace sidmishraw_octtree
+
+#endif /* spatialindex_h */
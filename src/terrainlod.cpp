@@ -0,0 +1,545 @@
+//
+//  terrainlod.cpp
+//  martian-terrain
+//
+
+#include "terrainlod.h"
+#include "AsyncSaver.hpp"
+#include "Log.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include "bounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <queue>
+
+using namespace std;
+
+// Header of the cache file, followed by every chunk: its bounds (6
+// floats), then for every level its error, triangle index count and
+// indices.
+//
+struct LodHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t meshHash;
+  int32_t grid;
+  int32_t levels;
+};
+
+static const char CACHE_MAGIC[4] = {'T', 'L', 'O', 'D'};
+static const uint32_t CACHE_VERSION = 1;
+
+// The squared distance to a set of planes, as the symmetric 4x4 matrix
+// sum of p p^T over the planes p = (a, b, c, d).
+//
+struct Quadric {
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+  Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+  void addPlane(double a, double b, double c, double d) {
+    a2 += a * a, ab += a * b, ac += a * c, ad += a * d;
+    b2 += b * b, bc += b * c, bd += b * d;
+    c2 += c * c, cd += c * d;
+    d2 += d * d;
+  }
+
+  Quadric operator+(const Quadric &q) const {
+    Quadric s;
+    s.a2 = a2 + q.a2, s.ab = ab + q.ab, s.ac = ac + q.ac, s.ad = ad + q.ad;
+    s.b2 = b2 + q.b2, s.bc = bc + q.bc, s.bd = bd + q.bd;
+    s.c2 = c2 + q.c2, s.cd = cd + q.cd;
+    s.d2 = d2 + q.d2;
+    return s;
+  }
+
+  double error(const ofVec3f &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return x * (a2 * x + 2 * (ab * y + ac * z + ad)) + y * (b2 * y + 2 * (bc * z + bd)) + z * (c2 * z + 2 * cd) + d2;
+  }
+};
+
+// A candidate collapse of vertex from onto vertex to, valid while neither
+// changed since (their stamps).
+//
+struct Collapse {
+  double cost;
+  int from, to;
+  uint32_t fromStamp, toStamp;
+
+  bool operator<(const Collapse &other) const { return cost > other.cost; }  // cheapest on top
+};
+
+// One chunk's triangles being collapsed, on its own vertex numbering.
+//
+class ChunkSimplifier {
+ public:
+  ChunkSimplifier(const vector<ofVec3f> &vertices, const vector<char> &locked, const vector<uint32_t> &triangles)
+      : live(0) {
+    // The chunk's vertices, numbered in source order
+    //
+    globals = triangles;
+    sort(globals.begin(), globals.end());
+    globals.erase(unique(globals.begin(), globals.end()), globals.end());
+
+    size_t n = globals.size();
+    positions.resize(n);
+    pinned.resize(n);
+    quadrics.resize(n);
+    stamps.assign(n, 0);
+    alive.assign(n, 1);
+    vertexTriangles.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      positions[i] = vertices[globals[i]];
+      pinned[i] = locked[globals[i]];
+    }
+
+    // Every triangle's plane goes into the quadrics of its corners
+    //
+    live = triangles.size() / 3;
+    corners.resize(triangles.size());
+    triangleAlive.assign(live, 1);
+    for (size_t t = 0; t < live; t++) {
+      for (int k = 0; k < 3; k++) {
+        corners[3 * t + k] = lower_bound(globals.begin(), globals.end(), triangles[3 * t + k]) - globals.begin();
+        vertexTriangles[corners[3 * t + k]].push_back(t);
+      }
+      const ofVec3f &p0 = positions[corners[3 * t]];
+      ofVec3f normal = (positions[corners[3 * t + 1]] - p0).getCrossed(positions[corners[3 * t + 2]] - p0);
+      if (normal.lengthSquared() == 0) continue;
+      normal.normalize();
+      for (int k = 0; k < 3; k++) quadrics[corners[3 * t + k]].addPlane(normal.x, normal.y, normal.z, -normal.dot(p0));
+    }
+
+    // Every edge once
+    //
+    vector<pair<int, int>> edges;
+    for (size_t t = 0; t < live; t++) {
+      for (int k = 0; k < 3; k++) {
+        int a = corners[3 * t + k], b = corners[3 * t + (k + 1) % 3];
+        edges.emplace_back(min(a, b), max(a, b));
+      }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    for (auto &edge : edges) push(edge.first, edge.second);
+  }
+
+  // Collapses the cheapest edges until at most target triangles are left
+  // or nothing can collapse.
+  //
+  void simplify(size_t target) {
+    while (live > target && !heap.empty()) {
+      Collapse c = heap.top();
+      heap.pop();
+      if (!alive[c.from] || !alive[c.to] || stamps[c.from] != c.fromStamp || stamps[c.to] != c.toStamp) continue;
+      if (!canCollapse(c.from, c.to)) continue;
+      collapse(c.from, c.to);
+    }
+  }
+
+  // The triangles left, on the source vertices.
+  //
+  vector<uint32_t> triangles() const {
+    vector<uint32_t> out;
+    out.reserve(3 * live);
+    for (size_t t = 0; t < triangleAlive.size(); t++) {
+      if (!triangleAlive[t]) continue;
+      for (int k = 0; k < 3; k++) out.push_back(globals[corners[3 * t + k]]);
+    }
+    return out;
+  }
+
+  // The furthest any of the chunk's vertices is above or below the
+  // triangles left, seen from above (the terrain is a height field). The
+  // triangles are bucketed in a grid over the chunk to find the one under
+  // each vertex.
+  //
+  float error() const {
+    float x0 = FLT_MAX, z0 = FLT_MAX, x1 = -FLT_MAX, z1 = -FLT_MAX;
+    for (auto &p : positions) {
+      x0 = min(x0, p.x), z0 = min(z0, p.z);
+      x1 = max(x1, p.x), z1 = max(z1, p.z);
+    }
+    int cells = max(1, (int)sqrt((double)live));
+    float cellX = max((x1 - x0) / cells, 1e-6f), cellZ = max((z1 - z0) / cells, 1e-6f);
+    auto cellOf = [&](float x, float z, int &cx, int &cz) {
+      cx = ofClamp((int)((x - x0) / cellX), 0, cells - 1);
+      cz = ofClamp((int)((z - z0) / cellZ), 0, cells - 1);
+    };
+
+    vector<vector<int>> buckets(cells * cells);
+    for (size_t t = 0; t < triangleAlive.size(); t++) {
+      if (!triangleAlive[t]) continue;
+      const ofVec3f &p0 = positions[corners[3 * t]], &p1 = positions[corners[3 * t + 1]],
+                    &p2 = positions[corners[3 * t + 2]];
+      int cx0, cz0, cx1, cz1;
+      cellOf(min(p0.x, min(p1.x, p2.x)), min(p0.z, min(p1.z, p2.z)), cx0, cz0);
+      cellOf(max(p0.x, max(p1.x, p2.x)), max(p0.z, max(p1.z, p2.z)), cx1, cz1);
+      for (int cz = cz0; cz <= cz1; cz++) {
+        for (int cx = cx0; cx <= cx1; cx++) buckets[cz * cells + cx].push_back(t);
+      }
+    }
+
+    float worst = 0;
+    for (auto &p : positions) {
+      int cx, cz;
+      cellOf(p.x, p.z, cx, cz);
+      for (int t : buckets[cz * cells + cx]) {
+        const ofVec3f &p0 = positions[corners[3 * t]], &p1 = positions[corners[3 * t + 1]],
+                      &p2 = positions[corners[3 * t + 2]];
+        float d = (p1.z - p2.z) * (p0.x - p2.x) + (p2.x - p1.x) * (p0.z - p2.z);
+        if (fabs(d) < 1e-12f) continue;
+        float l0 = ((p1.z - p2.z) * (p.x - p2.x) + (p2.x - p1.x) * (p.z - p2.z)) / d;
+        float l1 = ((p2.z - p0.z) * (p.x - p2.x) + (p0.x - p2.x) * (p.z - p2.z)) / d;
+        float l2 = 1 - l0 - l1;
+        if (l0 < -1e-4f || l1 < -1e-4f || l2 < -1e-4f) continue;
+        worst = max(worst, fabs(l0 * p0.y + l1 * p1.y + l2 * p2.y - p.y));
+        break;
+      }
+    }
+    return worst;
+  }
+
+  size_t live;
+
+ private:
+  // Queues the cheaper way of collapsing the edge that moves an unpinned
+  // vertex.
+  //
+  void push(int a, int b) {
+    if (pinned[a] && pinned[b]) return;
+    Quadric q = quadrics[a] + quadrics[b];
+    double toA = pinned[b] ? HUGE_VAL : q.error(positions[a]);
+    double toB = pinned[a] ? HUGE_VAL : q.error(positions[b]);
+    if (toA <= toB) {
+      heap.push({toA, b, a, stamps[b], stamps[a]});
+    } else {
+      heap.push({toB, a, b, stamps[a], stamps[b]});
+    }
+  }
+
+  // The vertices sharing a live triangle with v.
+  //
+  void neighbours(int v, vector<int> &out) const {
+    out.clear();
+    for (int t : vertexTriangles[v]) {
+      if (!triangleAlive[t]) continue;
+      for (int k = 0; k < 3; k++) {
+        int w = corners[3 * t + k];
+        if (w != v) out.push_back(w);
+      }
+    }
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+  }
+
+  // The collapse keeps the surface a manifold (the two vertices share no
+  // neighbours but those of the triangles on their edge) and turns none
+  // of the triangles that stay over, in space or seen from above.
+  //
+  bool canCollapse(int from, int to) {
+    neighbours(from, fromNeighbours);
+    neighbours(to, toNeighbours);
+    shared.clear();
+    set_intersection(fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(),
+                     back_inserter(shared));
+
+    int onEdge = 0;
+    for (int t : vertexTriangles[from]) {
+      if (!triangleAlive[t]) continue;
+      int *c = &corners[3 * t];
+      if (c[0] == to || c[1] == to || c[2] == to) {
+        onEdge++;
+        continue;
+      }
+
+      int k = c[0] == from ? 0 : c[1] == from ? 1 : 2;
+      const ofVec3f &p1 = positions[c[(k + 1) % 3]], &p2 = positions[c[(k + 2) % 3]];
+      ofVec3f before = (p1 - positions[from]).getCrossed(p2 - positions[from]);
+      ofVec3f after = (p1 - positions[to]).getCrossed(p2 - positions[to]);
+      if (before.dot(after) <= 0 || before.y * after.y <= 0) return false;
+    }
+    return onEdge > 0 && (int)shared.size() == onEdge;
+  }
+
+  void collapse(int from, int to) {
+    for (int t : vertexTriangles[from]) {
+      if (!triangleAlive[t]) continue;
+      int *c = &corners[3 * t];
+      if (c[0] == to || c[1] == to || c[2] == to) {
+        triangleAlive[t] = 0;
+        live--;
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        if (c[k] == from) c[k] = to;
+      }
+      vertexTriangles[to].push_back(t);
+    }
+    vector<int>().swap(vertexTriangles[from]);
+    alive[from] = 0;
+
+    auto &list = vertexTriangles[to];
+    list.erase(remove_if(list.begin(), list.end(), [this](int t) { return !triangleAlive[t]; }), list.end());
+    quadrics[to] = quadrics[to] + quadrics[from];
+    stamps[to]++;
+
+    neighbours(to, toNeighbours);
+    for (int w : toNeighbours) push(to, w);
+  }
+
+  vector<uint32_t> globals;  // source index of every vertex
+  vector<ofVec3f> positions;
+  vector<char> pinned;
+  vector<Quadric> quadrics;
+  vector<uint32_t> stamps;
+  vector<char> alive;
+  vector<vector<int>> vertexTriangles;
+  vector<int> corners;  // 3 per triangle
+  vector<char> triangleAlive;
+  priority_queue<Collapse> heap;
+
+  vector<int> fromNeighbours, toNeighbours, shared;
+};
+
+TerrainLod::TerrainLod() : grid(0), meshHash(0) { stats = {0, 0}; }
+
+void TerrainLod::build(const ofMesh &mesh, int gridSize, int levels) {
+  PROFILE_ZONE("terrain lod build");
+  auto start = chrono::steady_clock::now();
+
+  grid = max(gridSize, 1);
+  levels = max(levels, 1);
+  meshHash = ::meshHash(mesh);
+  chunks.assign(grid * grid, Chunk());
+
+  auto &vertices = mesh.getVertices();
+  vector<uint32_t> indices(mesh.getIndices().begin(), mesh.getIndices().end());
+  if (indices.empty()) {
+    indices.resize(vertices.size() - vertices.size() % 3);
+    for (size_t i = 0; i < indices.size(); i++) indices[i] = i;
+  }
+  size_t numTriangles = indices.size() / 3;
+
+  // Every triangle goes to the chunk under its center
+  //
+  Box bounds = meshBounds(mesh);
+  float x0 = bounds.min().x(), z0 = bounds.min().z();
+  float cellX = max((bounds.max().x() - x0) / grid, 1e-6f), cellZ = max((bounds.max().z() - z0) / grid, 1e-6f);
+  vector<int> owner(numTriangles);
+  vector<vector<uint32_t>> chunkTriangles(chunks.size());
+  for (size_t t = 0; t < numTriangles; t++) {
+    ofVec3f center = (vertices[indices[3 * t]] + vertices[indices[3 * t + 1]] + vertices[indices[3 * t + 2]]) / 3;
+    int cx = ofClamp((int)((center.x - x0) / cellX), 0, grid - 1);
+    int cz = ofClamp((int)((center.z - z0) / cellZ), 0, grid - 1);
+    owner[t] = cz * grid + cx;
+    chunkTriangles[owner[t]].insert(chunkTriangles[owner[t]].end(), &indices[3 * t], &indices[3 * t + 3]);
+  }
+
+  // Pinned in place: the vertices of triangles in more than one chunk,
+  // and those on the terrain's border (edges of one triangle) or on edges
+  // of more than two
+  //
+  vector<char> locked(vertices.size(), 0);
+  vector<int> firstChunk(vertices.size(), -1);
+  for (size_t t = 0; t < numTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[3 * t + k];
+      if (firstChunk[v] < 0) firstChunk[v] = owner[t];
+      if (firstChunk[v] != owner[t]) locked[v] = 1;
+    }
+  }
+  vector<uint64_t> edges;
+  edges.reserve(indices.size());
+  for (size_t t = 0; t < numTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint64_t a = indices[3 * t + k], b = indices[3 * t + (k + 1) % 3];
+      edges.push_back(min(a, b) << 32 | max(a, b));
+    }
+  }
+  sort(edges.begin(), edges.end());
+  for (size_t i = 0; i < edges.size();) {
+    size_t j = i;
+    while (j < edges.size() && edges[j] == edges[i]) j++;
+    if (j - i != 2) locked[edges[i] >> 32] = locked[edges[i] & 0xffffffff] = 1;
+    i = j;
+  }
+
+  ThreadPool::parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      auto &chunk = chunks[c];
+      auto &triangles = chunkTriangles[c];
+
+      ofVec3f lo = triangles.empty() ? ofVec3f(x0 + cellX * (c % grid), 0, z0 + cellZ * (c / grid))
+                                     : vertices[triangles[0]];
+      ofVec3f hi = lo;
+      for (uint32_t v : triangles) {
+        lo = ofVec3f(min(lo.x, vertices[v].x), min(lo.y, vertices[v].y), min(lo.z, vertices[v].z));
+        hi = ofVec3f(max(hi.x, vertices[v].x), max(hi.y, vertices[v].y), max(hi.z, vertices[v].z));
+      }
+      chunk.bounds = Box(toVector3(lo), toVector3(hi));
+      chunk.levels.assign(1, triangles);
+      chunk.errors.assign(1, 0);
+
+      ChunkSimplifier simplifier(vertices, locked, triangles);
+      size_t target = triangles.size() / 3;
+      for (int level = 1; level < levels; level++) {
+        target /= 4;
+        simplifier.simplify(target);
+        chunk.levels.push_back(simplifier.triangles());
+        chunk.errors.push_back(simplifier.error());
+      }
+    }
+  });
+
+  stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  stats.threads = ThreadPool::size();
+  for (int level = 0; level < levels; level++) {
+    float error = 0;
+    for (auto &chunk : chunks) error = max(error, chunk.errors[level]);
+    LOG_INFO("Terrain LOD " << level << ": " << triangleCount(level) << " triangles, error up to " << error);
+  }
+  LOG_INFO("Terrain LOD built, " << grid << "x" << grid << " chunks, in " << stats.ms << " ms on " << stats.threads
+                                 << " threads");
+}
+
+void TerrainLod::loadOrBuild(const ofMesh &mesh, const string &cacheFile) {
+  if (load(cacheFile, ::meshHash(mesh))) {
+    LOG_INFO("Terrain LOD loaded from " << cacheFile);
+    return;
+  }
+
+  build(mesh);
+  if (!save(cacheFile)) LOG_ERROR("Couldn't save the terrain LOD to " << cacheFile);
+}
+
+bool TerrainLod::save(const string &fileName) const {
+  auto path = ofToDataPath(fileName);
+  auto tmpName = Tmnper::partFileName(path);
+
+  LodHeader header;
+  copy(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic);
+  header.version = CACHE_VERSION;
+  header.meshHash = meshHash;
+  header.grid = grid;
+  header.levels = levelCount();
+
+  ofstream out(tmpName, ios::binary);
+  out.write((const char *)&header, sizeof(header));
+  for (auto &chunk : chunks) {
+    float box[6] = {chunk.bounds.min().x(), chunk.bounds.min().y(), chunk.bounds.min().z(),
+                    chunk.bounds.max().x(), chunk.bounds.max().y(), chunk.bounds.max().z()};
+    out.write((const char *)box, sizeof(box));
+    for (int level = 0; level < header.levels; level++) {
+      uint32_t count = chunk.levels[level].size();
+      out.write((const char *)&chunk.errors[level], sizeof(float));
+      out.write((const char *)&count, sizeof(count));
+      out.write((const char *)chunk.levels[level].data(), count * sizeof(uint32_t));
+    }
+  }
+  out.close();
+
+  return out && Tmnper::commitFile(tmpName, path);
+}
+
+bool TerrainLod::load(const string &fileName, uint64_t hash) {
+  ifstream in(ofToDataPath(fileName), ios::binary);
+  if (!in) return false;
+
+  LodHeader header;
+  if (!in.read((char *)&header, sizeof(header))) return false;
+  if (!equal(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic) || header.version != CACHE_VERSION) return false;
+  if (header.meshHash != hash || header.grid < 1 || header.levels < 1) return false;
+
+  vector<Chunk> loaded(header.grid * header.grid);
+  for (auto &chunk : loaded) {
+    float box[6];
+    if (!in.read((char *)box, sizeof(box))) return false;
+    chunk.bounds = Box(Vector3(box[0], box[1], box[2]), Vector3(box[3], box[4], box[5]));
+    chunk.levels.resize(header.levels);
+    chunk.errors.resize(header.levels);
+    for (int level = 0; level < header.levels; level++) {
+      uint32_t count;
+      if (!in.read((char *)&chunk.errors[level], sizeof(float)) || !in.read((char *)&count, sizeof(count))) {
+        return false;
+      }
+      chunk.levels[level].resize(count);
+      if (!in.read((char *)chunk.levels[level].data(), count * sizeof(uint32_t))) return false;
+    }
+  }
+
+  meshHash = header.meshHash;
+  grid = header.grid;
+  chunks.swap(loaded);
+  return true;
+}
+
+bool TerrainLod::select(const ofCamera &cam, float viewportHeight, float pixelError, vector<int> &selection) const {
+  bool changed = selection.size() != chunks.size();
+  selection.resize(chunks.size(), 0);
+
+  ofVec3f eye = cam.getGlobalPosition();
+  float pixelsPerUnit = viewportHeight / (2 * tan(ofDegToRad(cam.getFov() / 2)));
+  for (size_t c = 0; c < chunks.size(); c++) {
+    // The error stays under pixelError pixels at the chunk's nearest point
+    //
+    auto &chunk = chunks[c];
+    ofVec3f lo = toOf(chunk.bounds.min()), hi = toOf(chunk.bounds.max());
+    ofVec3f nearest(ofClamp(eye.x, lo.x, hi.x), ofClamp(eye.y, lo.y, hi.y), ofClamp(eye.z, lo.z, hi.z));
+    float allowed = pixelError * eye.distance(nearest) / pixelsPerUnit;
+
+    int level = 0;
+    while (level + 1 < (int)chunk.errors.size() && chunk.errors[level + 1] <= allowed) level++;
+    changed = changed || selection[c] != level;
+    selection[c] = level;
+  }
+  return changed;
+}
+
+void TerrainLod::apply(SceneModel &model, int index, const vector<int> &selection) const {
+  PROFILE_ZONE("terrain lod apply");
+  auto &part = model.parts[index];
+  if (selection.empty() || selection.size() != chunks.size()) {
+    part.indices = part.mesh.getIndices();
+  } else {
+    part.indices.clear();
+    for (size_t c = 0; c < chunks.size(); c++) {
+      auto &triangles = chunks[c].triangles(selection[c]);
+      part.indices.insert(part.indices.end(), triangles.begin(), triangles.end());
+    }
+  }
+
+  // The model draws part.indices.size() indices from the buffer
+  //
+  part.vbo.setIndexData(part.indices.data(), part.indices.size(), GL_DYNAMIC_DRAW);
+}
+
+ofMesh TerrainLod::levelMesh(const ofMesh &source, int level) const {
+  ofMesh mesh;
+  vector<int> remap(source.getNumVertices(), -1);
+  bool normals = source.getNumNormals() == source.getNumVertices();
+  for (auto &chunk : chunks) {
+    for (uint32_t v : chunk.triangles(level)) {
+      if (remap[v] < 0) {
+        remap[v] = mesh.getNumVertices();
+        mesh.addVertex(source.getVertex(v));
+        if (normals) mesh.addNormal(source.getNormal(v));
+      }
+      mesh.addIndex(remap[v]);
+    }
+  }
+  return mesh;
+}
+
+size_t TerrainLod::triangleCount(int level) const {
+  size_t count = 0;
+  for (auto &chunk : chunks) count += chunk.triangles(level).size() / 3;
+  return count;
+}
@@ -0,0 +1,116 @@
+//
+//  terrainlod.h
+//  martian-terrain
+//
+
+#ifndef terrainlod_h
+#define terrainlod_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "box.h"
+#include "scenemodel.h"
+
+using namespace std;
+
+//---------------------------------------------------------------
+// TerrainLod is a chain of coarser versions of the terrain, cut into a
+// grid of chunks so every chunk can be drawn at its own level.
+//
+// Each chunk is simplified on its own by quadric error edge collapses
+// (Garland and Heckbert): every vertex sums the squared distances to the
+// planes of the triangles around it, and the cheapest edge under that sum
+// collapses first, one end moving onto the other. The vertices on the
+// edges of the chunks (and of the terrain) never move, so neighbouring
+// chunks meet at any two levels without cracks. The collapses go on from
+// one level to the next, each keeping a quarter of the triangles of the
+// one before: half the resolution along each side.
+//
+// A collapse only ever keeps one of the two vertices, so every level
+// indexes the source mesh's vertices. Drawing a level swaps the index
+// buffer of the model, which keeps its normals, texture and occlusion.
+//
+// The chunks are simplified in parallel and the chain cached in a binary
+// file carrying the source mesh's hash, like the traversability map.
+//
+class TerrainLod {
+ public:
+  // Chunks along each side of the terrain, and levels in the chain (the
+  // source mesh is level 0).
+  //
+  static const int DEFAULT_GRID = 8;
+  static const int DEFAULT_LEVELS = 4;
+
+  struct Chunk {
+    Box bounds;
+
+    // Triangles (3 source vertex indices each) of every level, and the
+    // error of every level: how far, at most, a vertex of the chunk is
+    // above or below the level's surface.
+    //
+    vector<vector<uint32_t>> levels;
+    vector<float> errors;
+
+    // The level's triangles, or the coarsest's past the last level.
+    //
+    const vector<uint32_t> &triangles(int level) const {
+      return levels[std::min(std::max(level, 0), (int)levels.size() - 1)];
+    }
+  };
+
+  struct Stats {
+    double ms;
+    unsigned threads;
+  };
+
+  TerrainLod();
+
+  // ----------- OPERATIONS ------------------
+
+  // Builds the chain of levels over a grid x grid chunks of the mesh.
+  //
+  void build(const ofMesh &mesh, int grid = DEFAULT_GRID, int levels = DEFAULT_LEVELS);
+
+  // Loads the chain from the cache file when it was made for this mesh,
+  // builds and saves it otherwise.
+  //
+  void loadOrBuild(const ofMesh &mesh, const string &cacheFile);
+
+  // Binary cache. load() fails when the file was made for another mesh.
+  //
+  bool save(const string &fileName) const;
+  bool load(const string &fileName, uint64_t meshHash);
+
+  // Picks the level of every chunk seen from the camera: the coarsest
+  // whose error covers at most pixelError pixels of a viewport
+  // viewportHeight high. Returns whether any level changed.
+  //
+  bool select(const ofCamera &cam, float viewportHeight, float pixelError, vector<int> &selection) const;
+
+  // Draws the model's mesh with each chunk at its selected level, or back
+  // at the source triangles with an empty selection.
+  //
+  void apply(SceneModel &model, int index, const vector<int> &selection) const;
+
+  // The whole terrain at one level, holding only the vertices it uses.
+  //
+  ofMesh levelMesh(const ofMesh &source, int level) const;
+
+  int levelCount() const { return chunks.empty() ? 0 : (int)chunks[0].levels.size(); }
+  size_t triangleCount(int level) const;
+  bool isEmpty() const { return chunks.empty(); }
+
+  // ----------- ATTRIBUTES -----------------
+
+  vector<Chunk> chunks;  // row by row along +z, x within a row
+  int grid;
+  uint64_t meshHash;
+
+  Stats stats;
+};
+
+#endif /* terrainlod_h */
@@ -0,0 +1,363 @@
+//
+//  texturecache.cpp
+//  martian-terrain
+//
+
+#include "texturecache.h"
+#include "AsyncSaver.hpp"
+#include "Log.h"
+#include "Profiler.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+using namespace std;
+
+// Header of a cache entry, followed by bytes bytes of image. The entry
+// was decoded from the image file at the path hashed in sourceHash, when
+// it had sourceSize bytes and was last modified at sourceTime.
+//
+struct TextureHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash;
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  uint32_t format;
+  uint32_t width, height, channels;
+  uint64_t bytes;
+};
+
+static const char CACHE_MAGIC[4] = {'T', 'E', 'X', 'C'};
+static const uint32_t CACHE_VERSION = 2;
+
+static size_t bc1Size(uint32_t width, uint32_t height) { return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8; }
+
+TextureImage::TextureImage()
+    : format(RAW), width(0), height(0), channels(0), mapping(nullptr), mappingSize(0), bytes(nullptr), count(0) {}
+
+TextureImage::~TextureImage() { clear(); }
+
+TextureImage::TextureImage(TextureImage &&other) : TextureImage() { *this = move(other); }
+
+TextureImage &TextureImage::operator=(TextureImage &&other) {
+  if (this == &other) return *this;
+  clear();
+  format = other.format;
+  width = other.width;
+  height = other.height;
+  channels = other.channels;
+  owned.swap(other.owned);
+  mapping = other.mapping;
+  mappingSize = other.mappingSize;
+  bytes = other.bytes;
+  count = other.count;
+  other.mapping = nullptr;
+  other.clear();
+  return *this;
+}
+
+void TextureImage::assign(Format f, uint32_t w, uint32_t h, uint32_t c, vector<unsigned char> &&data) {
+  clear();
+  format = f;
+  width = w;
+  height = h;
+  channels = c;
+  owned = move(data);
+  bytes = owned.data();
+  count = owned.size();
+}
+
+void TextureImage::assignMapped(Format f, uint32_t w, uint32_t h, uint32_t c, void *map, size_t mapSize,
+                                const unsigned char *data, size_t n) {
+  clear();
+  format = f;
+  width = w;
+  height = h;
+  channels = c;
+  mapping = map;
+  mappingSize = mapSize;
+  bytes = data;
+  count = n;
+}
+
+void TextureImage::clear() {
+  if (mapping) munmap(mapping, mappingSize);
+  mapping = nullptr;
+  mappingSize = 0;
+  vector<unsigned char>().swap(owned);
+  bytes = nullptr;
+  count = 0;
+  width = height = channels = 0;
+}
+
+void TextureImage::upload(ofTexture &texture) const {
+  if (isEmpty()) return;
+
+  if (format == RAW) {
+    // The pixels point into the image, no copy is made. Model textures
+    // are addressed 0..1, so never rectangle textures.
+    //
+    ofPixels pixels;
+    pixels.setFromExternalPixels(const_cast<unsigned char *>(bytes), width, height, channels);
+    texture.allocate(width, height, ofGetGLInternalFormat(pixels), false, ofGetGLFormat(pixels), ofGetGlType(pixels));
+    texture.loadData(pixels);
+    return;
+  }
+
+  // Make the texture as for RGB pixels, then give it the blocks instead.
+  // The texture records the format it now has, so that reading it back or
+  // reallocating it doesn't take it for RGB.
+  //
+  texture.allocate(width, height, GL_RGB, false);
+  glBindTexture(texture.texData.textureTarget, texture.texData.textureID);
+  glCompressedTexImage2D(texture.texData.textureTarget, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height, 0,
+                         (GLsizei)count, bytes);
+  glBindTexture(texture.texData.textureTarget, 0);
+  texture.texData.glInternalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+TextureCache::TextureCache(const string &dir) : directory(dir), bCompress(false) { stats = {0, 0, 0}; }
+
+bool TextureCache::load(const string &path, TextureImage &image) {
+  PROFILE_ZONE("texture cache load");
+  auto start = chrono::steady_clock::now();
+  auto elapsed = [&start]() { return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(); };
+
+  // The file is told apart by its path, size and modification time, which
+  // a stat gives without reading it
+  //
+  Source source;
+  string file = ofToDataPath(path, true);
+  struct stat info;
+  if (stat(file.c_str(), &info) != 0 || info.st_size == 0) return false;
+  source.hash = fnv1a(file.data(), file.size());
+  source.size = info.st_size;
+  source.time = info.st_mtime;
+  string entry = entryPath(source);
+
+  if (loadEntry(entry, source, image)) {
+    stats.hits++;
+    double ms = elapsed();
+    stats.ms += ms;
+    LOG_INFO("Texture " << ofFilePath::getFileName(path) << " mapped from the cache in " << ms << " ms");
+    return true;
+  }
+
+  ofPixels pixels;
+  if (!ofLoadImage(pixels, file)) return false;
+
+  uint32_t width = pixels.getWidth(), height = pixels.getHeight(), channels = pixels.getNumChannels();
+  const unsigned char *data = pixels.getData();
+
+  // Only opaque color compresses; BC1's one bit alpha isn't enough
+  //
+  bool opaque = channels == 3;
+  if (channels == 4) {
+    opaque = true;
+    for (size_t i = 3; opaque && i < pixels.size(); i += 4) opaque = data[i] == 255;
+  }
+
+  if (bCompress && opaque) {
+    image.assign(TextureImage::BC1, width, height, 3, compressBC1(data, width, height, channels));
+  } else {
+    image.assign(TextureImage::RAW, width, height, channels, vector<unsigned char>(data, data + pixels.size()));
+  }
+  if (!saveEntry(entry, source, image)) LOG_ERROR("Couldn't cache the texture " << path << " in " << entry);
+
+  stats.misses++;
+  double ms = elapsed();
+  stats.ms += ms;
+  LOG_INFO("Texture " << ofFilePath::getFileName(path) << " decoded"
+                      << (image.format == TextureImage::BC1 ? " and compressed" : "") << " in " << ms << " ms");
+  return true;
+}
+
+string TextureCache::entryPath(const Source &source) const {
+  uint64_t key = fnv1a(&source.size, sizeof(source.size), source.hash);
+  key = fnv1a(&source.time, sizeof(source.time), key);
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.tex", (unsigned long long)key);
+  return ofToDataPath(ofFilePath::join(directory, name));
+}
+
+bool TextureCache::loadEntry(const string &entry, const Source &source, TextureImage &image) {
+  int fd = open(entry.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat info;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(TextureHeader)) {
+    mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);  // the mapping keeps the file
+  if (mapping == MAP_FAILED) return false;
+
+  size_t size = info.st_size;
+  TextureHeader header;
+  memcpy(&header, mapping, sizeof(header));
+
+  size_t expected = header.format == TextureImage::BC1 ? bc1Size(header.width, header.height)
+                                                        : (size_t)header.width * header.height * header.channels;
+  if (!equal(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic) || header.version != CACHE_VERSION ||
+      header.sourceHash != source.hash || header.sourceSize != source.size || header.sourceTime != source.time ||
+      header.format > TextureImage::BC1 || header.bytes != expected ||
+      size < sizeof(header) + header.bytes) {
+    munmap(mapping, size);
+    return false;
+  }
+
+  image.assignMapped((TextureImage::Format)header.format, header.width, header.height, header.channels, mapping, size,
+                     (const unsigned char *)mapping + sizeof(header), header.bytes);
+  return true;
+}
+
+bool TextureCache::saveEntry(const string &entry, const Source &source, const TextureImage &image) {
+  ofFilePath::createEnclosingDirectory(entry, false);
+  auto tmpName = Tmnper::partFileName(entry);
+
+  TextureHeader header;
+  memset(&header, 0, sizeof(header));
+  copy(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic);
+  header.version = CACHE_VERSION;
+  header.sourceHash = source.hash;
+  header.sourceSize = source.size;
+  header.sourceTime = source.time;
+  header.format = image.format;
+  header.width = image.width;
+  header.height = image.height;
+  header.channels = image.channels;
+  header.bytes = image.size();
+
+  ofstream out(tmpName, ios::binary);
+  out.write((const char *)&header, sizeof(header));
+  out.write((const char *)image.data(), image.size());
+  out.close();
+
+  return out && Tmnper::commitFile(tmpName, entry);
+}
+
+// RGB 565 of a color, and back.
+//
+static inline uint16_t pack565(const int c[3]) {
+  return (uint16_t)(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static inline void unpack565(uint16_t v, int c[3]) {
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// One 4x4 block of RGB triples.
+//
+static void compressBlock(const int block[16][3], unsigned char out[8]) {
+  // The box around the block's colors, and its diagonal that follows them:
+  // the red and blue extents flip when they fall as green rises
+  //
+  int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+  int mean[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int k = 0; k < 3; k++) {
+      lo[k] = min(lo[k], block[i][k]);
+      hi[k] = max(hi[k], block[i][k]);
+      mean[k] += block[i][k];
+    }
+  }
+  int covRG = 0, covBG = 0;
+  for (int i = 0; i < 16; i++) {
+    int g = 16 * block[i][1] - mean[1];
+    covRG += (16 * block[i][0] - mean[0]) * g / 16;
+    covBG += (16 * block[i][2] - mean[2]) * g / 16;
+  }
+  int axis[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+  if (covRG < 0) axis[0] = -axis[0];
+  if (covBG < 0) axis[2] = -axis[2];
+
+  // The colors furthest along it either way are the end points
+  //
+  int first = 0, last = 0, least = INT_MAX, most = INT_MIN;
+  for (int i = 0; i < 16; i++) {
+    int d = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+    if (d < least) {
+      least = d;
+      first = i;
+    }
+    if (d > most) {
+      most = d;
+      last = i;
+    }
+  }
+
+  uint16_t c0 = pack565(block[last]), c1 = pack565(block[first]);
+  if (c0 < c1) swap(c0, c1);
+
+  int palette[4][3];
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  for (int k = 0; k < 3; k++) {
+    palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+    palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+  }
+
+  // With c0 == c1 the block is in its 3 color mode, where every pixel
+  // takes index 0 anyway
+  //
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    for (int i = 0; i < 16; i++) {
+      int best = 0, bestDistance = INT_MAX;
+      for (int p = 0; p < 4; p++) {
+        int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+        int distance = dr * dr + dg * dg + db * db;
+        if (distance < bestDistance) {
+          bestDistance = distance;
+          best = p;
+        }
+      }
+      indices |= (uint32_t)best << (2 * i);
+    }
+  }
+
+  out[0] = c0 & 0xff;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xff;
+  out[3] = c1 >> 8;
+  for (int k = 0; k < 4; k++) out[4 + k] = (indices >> (8 * k)) & 0xff;
+}
+
+vector<unsigned char> TextureCache::compressBC1(const unsigned char *pixels, int width, int height, int channels) {
+  PROFILE_ZONE("compress BC1");
+  int cols = (width + 3) / 4, rows = (height + 3) / 4;
+  vector<unsigned char> blocks((size_t)cols * rows * 8);
+
+  // Blocks past the right or bottom edge repeat the edge pixels
+  //
+  int block[16][3];
+  for (int by = 0; by < rows; by++) {
+    for (int bx = 0; bx < cols; bx++) {
+      for (int i = 0; i < 16; i++) {
+        int x = min(4 * bx + i % 4, width - 1), y = min(4 * by + i / 4, height - 1);
+        const unsigned char *p = pixels + ((size_t)y * width + x) * channels;
+        for (int k = 0; k < 3; k++) block[i][k] = p[k];
+      }
+      compressBlock(block, &blocks[((size_t)by * cols + bx) * 8]);
+    }
+  }
+  return blocks;
+}
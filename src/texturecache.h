@@ -0,0 +1,132 @@
+//
+//  texturecache.h
+//  martian-terrain
+//
+
+#ifndef texturecache_h
+#define texturecache_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+using namespace std;
+
+//---------------------------------------------------------------
+// A decoded texture: plain pixels, or BC1 (DXT1) blocks that the GPU
+// samples as they are. Either owns its bytes or reads them straight from
+// a cache file mapped into memory, which stays mapped as long as the
+// image lives. Move only.
+//
+class TextureImage {
+ public:
+  enum Format : uint32_t {
+    RAW = 0,  // channels bytes per pixel, rows top down
+    BC1 = 1,  // 8 bytes per 4x4 block of RGB, blocks row by row
+  };
+
+  TextureImage();
+  ~TextureImage();
+  TextureImage(TextureImage &&other);
+  TextureImage &operator=(TextureImage &&other);
+  TextureImage(const TextureImage &) = delete;
+  TextureImage &operator=(const TextureImage &) = delete;
+
+  // ----------- OPERATIONS ------------------
+
+  // Makes this an image of its own bytes.
+  //
+  void assign(Format format, uint32_t width, uint32_t height, uint32_t channels, vector<unsigned char> &&bytes);
+
+  // Makes this an image of bytes in a mapping, which it unmaps when done.
+  //
+  void assignMapped(Format format, uint32_t width, uint32_t height, uint32_t channels, void *mapping,
+                    size_t mappingSize, const unsigned char *bytes, size_t count);
+
+  void clear();
+
+  // Uploads the image into the texture. On the GL thread.
+  //
+  void upload(ofTexture &texture) const;
+
+  const unsigned char *data() const { return bytes; }
+  size_t size() const { return count; }
+  bool isEmpty() const { return count == 0; }
+  bool isMapped() const { return mapping != nullptr; }
+
+  // ----------- ATTRIBUTES -----------------
+
+  Format format;
+  uint32_t width, height, channels;
+
+ private:
+  vector<unsigned char> owned;
+  void *mapping;
+  size_t mappingSize;
+  const unsigned char *bytes;
+  size_t count;
+};
+
+//---------------------------------------------------------------
+// TextureCache keeps the textures of the models decoded on disk, so
+// loading a model again skips decoding its PNGs.
+//
+// Every entry is a file in the cache directory named after the path,
+// size and modification time of the image file it was decoded from: a
+// header, then the pixels (or their BC1 blocks) ready to upload. A hit
+// maps the entry into memory and uploads from the mapping, so it costs a
+// stat of the image file and the pages the upload touches; the image
+// itself is never read. Editing the image changes its size or time, so a
+// stale entry is never used; it is just left behind.
+//
+// With bCompress, opaque color textures are stored as BC1, a sixth of
+// their RGB size (an eighth of RGBA) on disk and in GPU memory, at some
+// loss of color precision.
+//
+class TextureCache {
+ public:
+  struct Stats {
+    int hits, misses;
+    double ms;  // in load()
+  };
+
+  explicit TextureCache(const string &directory);
+
+  // ----------- OPERATIONS ------------------
+
+  // The decoded image file: from the cache when it has it, decoded and
+  // added to the cache otherwise. Not thread safe; meant for the loader
+  // thread.
+  //
+  bool load(const string &path, TextureImage &image);
+
+  // BC1 blocks of the pixels (3 or 4 channels, alpha ignored), by the
+  // bounding box fit: the block's extreme colors along its main diagonal
+  // are the end points.
+  //
+  static vector<unsigned char> compressBC1(const unsigned char *pixels, int width, int height, int channels);
+
+  // ----------- ATTRIBUTES -----------------
+
+  string directory;
+  bool bCompress;
+  Stats stats;
+
+ private:
+  // What an entry is keyed on: the hash of the image file's absolute path,
+  // its size and its modification time.
+  //
+  struct Source {
+    uint64_t hash;
+    uint64_t size;
+    int64_t time;
+  };
+
+  string entryPath(const Source &source) const;
+  bool loadEntry(const string &entry, const Source &source, TextureImage &image);
+  bool saveEntry(const string &entry, const Source &source, const TextureImage &image);
+};
+
+#endif /* texturecache_h */
@@ -0,0 +1,299 @@
+//
+//  traversability.cpp
+//  martian-terrain
+//
+
+#include "traversability.h"
+#include "AsyncSaver.hpp"
+#include "Log.h"
+#include "Profiler.h"
+#include "Util.h"
+#include "bounds.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+
+// Header of the cache file, followed by cols * rows Cells.
+//
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t meshHash;
+  float cellSize;
+  float originX, originZ;
+  int32_t cols, rows;
+};
+
+static const char CACHE_MAGIC[4] = {'T', 'R', 'A', 'V'};
+static const uint32_t CACHE_VERSION = 2;
+
+// Running sums for one cell while rasterizing.
+//
+struct CellSums {
+  double area;
+  double weightedHeight;
+  double nx, ny, nz;  // area weighted unit normals
+  float minY, maxY;
+  uint32_t triangles;
+};
+
+TraversabilityMap::TraversabilityMap()
+    : cellSize(0), originX(0), originZ(0), cols(0), rows(0), meshHash(0), bOverlayDirty(true) {}
+
+void TraversabilityMap::build(const ofMesh &mesh, float size) {
+  PROFILE_ZONE("traversability build");
+  auto start = chrono::steady_clock::now();
+
+  Box bounds = meshBounds(mesh);
+  float w = bounds.max().x() - bounds.min().x();
+  float d = bounds.max().z() - bounds.min().z();
+
+  cellSize = size > 0 ? size : std::max(std::max(w, d) / DEFAULT_RESOLUTION, 1e-3f);
+  originX = bounds.min().x();
+  originZ = bounds.min().z();
+  cols = std::max(1, (int)ceil(w / cellSize));
+  rows = std::max(1, (int)ceil(d / cellSize));
+  meshHash = ::meshHash(mesh);
+
+  auto &vertices = mesh.getVertices();
+  auto &indices = mesh.getIndices();
+
+  // Meshes without indices list the triangles' vertices in order.
+  //
+  bool indexed = !indices.empty();
+  int numTriangles = (int)(indexed ? indices.size() : vertices.size()) / 3;
+  auto vertex = [&](int i) -> const ofVec3f & { return vertices[indexed ? indices[i] : i]; };
+
+  CellSums empty = {0, 0, 0, 0, 0, INFINITY, -INFINITY, 0};
+  vector<CellSums> sums(cols * rows, empty);
+
+  // Every thread owns a band of rows, so no two threads write the same
+  // cell; each walks all the triangles and keeps the rows in its band.
+  //
+  auto rasterize = [&](int rowBegin, int rowEnd) {
+    for (int t = 0; t < numTriangles; t++) {
+      const ofVec3f &a = vertex(3 * t);
+      const ofVec3f &b = vertex(3 * t + 1);
+      const ofVec3f &c = vertex(3 * t + 2);
+
+      int r0 = std::max(rowBegin, (int)floor((std::min(std::min(a.z, b.z), c.z) - originZ) / cellSize));
+      int r1 = std::min(rowEnd - 1, (int)floor((std::max(std::max(a.z, b.z), c.z) - originZ) / cellSize));
+      if (r0 > r1) continue;
+
+      int c0 = std::max(0, (int)floor((std::min(std::min(a.x, b.x), c.x) - originX) / cellSize));
+      int c1 = std::min(cols - 1, (int)floor((std::max(std::max(a.x, b.x), c.x) - originX) / cellSize));
+
+      ofVec3f n = (b - a).getCrossed(c - a);
+      float area = n.length() / 2;
+      if (area <= 0) continue;
+      n /= 2 * area;
+      if (n.y < 0) n = -n;  // the terrain faces up whatever the winding
+
+      float centroidY = (a.y + b.y + c.y) / 3;
+      float lo = std::min(std::min(a.y, b.y), c.y), hi = std::max(std::max(a.y, b.y), c.y);
+      float minX = std::min(std::min(a.x, b.x), c.x), maxX = std::max(std::max(a.x, b.x), c.x);
+      float minZ = std::min(std::min(a.z, b.z), c.z), maxZ = std::max(std::max(a.z, b.z), c.z);
+
+      for (int r = r0; r <= r1; r++) {
+        for (int col = c0; col <= c1; col++) {
+          CellSums &s = sums[r * cols + col];
+          s.area += area;
+          s.weightedHeight += area * centroidY;
+          s.nx += area * n.x, s.ny += area * n.y, s.nz += area * n.z;
+          s.triangles++;
+
+          // Height range of the triangle's plane over the part of its
+          // bounds inside this cell, so a triangle reaching into the cell
+          // adds only its share of the step.
+          //
+          if (n.y < 1e-3f) {
+            s.minY = std::min(s.minY, lo);
+            s.maxY = std::max(s.maxY, hi);
+            continue;
+          }
+          float x0 = std::max(minX, originX + col * cellSize), x1 = std::min(maxX, originX + (col + 1) * cellSize);
+          float z0 = std::max(minZ, originZ + r * cellSize), z1 = std::min(maxZ, originZ + (r + 1) * cellSize);
+          float xs[2] = {x0, x1}, zs[2] = {z0, z1};
+          for (float x : xs) {
+            for (float z : zs) {
+              float y = ofClamp(a.y - (n.x * (x - a.x) + n.z * (z - a.z)) / n.y, lo, hi);
+              s.minY = std::min(s.minY, y);
+              s.maxY = std::max(s.maxY, y);
+            }
+          }
+        }
+      }
+    }
+  };
+
+  int threads = std::max(1, std::min((int)thread::hardware_concurrency(), rows));
+  int band = (rows + threads - 1) / threads;
+  vector<thread> workers;
+  for (int i = 1; i < threads; i++) {
+    workers.emplace_back(rasterize, std::min(rows, i * band), std::min(rows, (i + 1) * band));
+  }
+  rasterize(0, std::min(rows, band));
+  for (auto &worker : workers) worker.join();
+
+  cells.resize(sums.size());
+  for (size_t i = 0; i < sums.size(); i++) {
+    const CellSums &s = sums[i];
+    Cell &cell = cells[i];
+    cell.triangles = s.triangles;
+    if (s.triangles == 0) {
+      cell.height = cell.minY = cell.maxY = cell.slope = cell.roughness = 0;
+      continue;
+    }
+
+    double len = sqrt(s.nx * s.nx + s.ny * s.ny + s.nz * s.nz);
+    cell.height = s.weightedHeight / s.area;
+    cell.minY = s.minY;
+    cell.maxY = s.maxY;
+    cell.slope = ofRadToDeg(acos(ofClamp(s.ny / len, -1, 1)));
+    cell.roughness = 1 - len / s.area;
+  }
+
+  bOverlayDirty = true;
+
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  LOG_INFO("Traversability map " << cols << "x" << rows << " cells of " << cellSize << " built in " << ms << " ms on "
+                                 << threads << " threads");
+}
+
+void TraversabilityMap::loadOrBuild(const ofMesh &mesh, const string &cacheFile, float size) {
+  if (load(cacheFile, ::meshHash(mesh)) && (size <= 0 || size == cellSize)) {
+    LOG_INFO("Traversability map " << cols << "x" << rows << " loaded from " << cacheFile);
+    return;
+  }
+
+  build(mesh, size);
+  if (!save(cacheFile)) LOG_ERROR("Couldn't save the traversability map to " << cacheFile);
+}
+
+bool TraversabilityMap::save(const string &fileName) const {
+  auto path = ofToDataPath(fileName);
+  auto tmpName = Tmnper::partFileName(path);
+
+  CacheHeader header;
+  copy(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic);
+  header.version = CACHE_VERSION;
+  header.meshHash = meshHash;
+  header.cellSize = cellSize;
+  header.originX = originX;
+  header.originZ = originZ;
+  header.cols = cols;
+  header.rows = rows;
+
+  ofstream out(tmpName, ios::binary);
+  out.write((const char *)&header, sizeof(header));
+  out.write((const char *)cells.data(), cells.size() * sizeof(Cell));
+  out.close();
+
+  return out && Tmnper::commitFile(tmpName, path);
+}
+
+bool TraversabilityMap::load(const string &fileName, uint64_t hash) {
+  ifstream in(ofToDataPath(fileName), ios::binary);
+  if (!in) return false;
+
+  CacheHeader header;
+  if (!in.read((char *)&header, sizeof(header))) return false;
+  if (!equal(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic) || header.version != CACHE_VERSION) return false;
+  if (header.meshHash != hash || header.cols <= 0 || header.rows <= 0) return false;
+
+  vector<Cell> loaded(header.cols * header.rows);
+  if (!in.read((char *)loaded.data(), loaded.size() * sizeof(Cell))) return false;
+
+  meshHash = header.meshHash;
+  cellSize = header.cellSize;
+  originX = header.originX;
+  originZ = header.originZ;
+  cols = header.cols;
+  rows = header.rows;
+  cells.swap(loaded);
+  bOverlayDirty = true;
+
+  return true;
+}
+
+bool TraversabilityMap::cellIndex(float x, float z, int &col, int &row) const {
+  if (cells.empty()) return false;
+  col = (int)floor((x - originX) / cellSize);
+  row = (int)floor((z - originZ) / cellSize);
+  return col >= 0 && col < cols && row >= 0 && row < rows;
+}
+
+const TraversabilityMap::Cell *TraversabilityMap::cellAt(float x, float z) const {
+  int col, row;
+  return cellIndex(x, z, col, row) ? &cell(col, row) : nullptr;
+}
+
+ofVec3f TraversabilityMap::cellCenter(int col, int row) const {
+  return ofVec3f(originX + (col + 0.5f) * cellSize, cell(col, row).height, originZ + (row + 0.5f) * cellSize);
+}
+
+bool TraversabilityMap::isTraversable(const Cell &c) const {
+  return c.triangles > 0 && c.slope <= limits.maxSlope && c.roughness <= limits.maxRoughness &&
+         c.step() <= limits.maxStepPerCell * cellSize;
+}
+
+bool TraversabilityMap::isTraversable(float x, float z) const {
+  auto c = cellAt(x, z);
+  return c && isTraversable(*c);
+}
+
+void TraversabilityMap::addCellQuad(ofMesh &mesh, int col, int row, float lift, const ofFloatColor &color) const {
+  float x0 = originX + col * cellSize, z0 = originZ + row * cellSize, y = cell(col, row).height + lift;
+  ofVec3f corners[4] = {ofVec3f(x0, y, z0), ofVec3f(x0 + cellSize, y, z0), ofVec3f(x0 + cellSize, y, z0 + cellSize),
+                        ofVec3f(x0, y, z0 + cellSize)};
+  const int order[6] = {0, 1, 2, 0, 2, 3};
+  for (int i = 0; i < 6; i++) {
+    mesh.addVertex(corners[order[i]]);
+    mesh.addColor(color);
+  }
+}
+
+void TraversabilityMap::buildOverlay() {
+  overlay.clear();
+  overlay.setMode(OF_PRIMITIVE_TRIANGLES);
+
+  // Lift the quads a little so they don't z-fight with the terrain.
+  //
+  float lift = cellSize * 0.05f;
+
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      const Cell &c = cell(col, row);
+      if (c.triangles == 0) continue;
+
+      ofFloatColor color;
+      if (isTraversable(c)) {
+        float t = ofClamp(c.slope / limits.maxSlope, 0, 1);
+        color = ofFloatColor(t, 1 - 0.5f * t, 0, 0.45f);  // green .. yellow
+      } else {
+        color = ofFloatColor(1, 0, 0, 0.45f);
+      }
+
+      addCellQuad(overlay, col, row, lift, color);
+    }
+  }
+
+  overlayLimits = limits;
+  bOverlayDirty = false;
+}
+
+void TraversabilityMap::draw() {
+  if (cells.empty()) return;
+  if (bOverlayDirty || overlayLimits != limits) buildOverlay();
+
+  ofPushStyle();
+  ofDisableLighting();
+  ofEnableAlphaBlending();
+  overlay.draw();
+  ofPopStyle();
+}
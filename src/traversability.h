@@ -0,0 +1,130 @@
+//
+//  traversability.h
+//  martian-terrain
+//
+
+#ifndef traversability_h
+#define traversability_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "box.h"
+
+//---------------------------------------------------------------
+// TraversabilityMap rasterizes the terrain into a regular grid over the XZ
+// plane and keeps per cell statistics the rover planner needs: height,
+// slope, roughness and step height. Once built, lookups are O(1) and never
+// touch the triangles again.
+//
+// Building is done in parallel and the result can be cached in a binary
+// file next to the mesh; the cache carries a hash of the mesh so a changed
+// terrain is rebuilt instead of loaded.
+//
+using namespace std;
+class TraversabilityMap {
+ public:
+  // Statistics of one grid cell, over every triangle overlapping it.
+  //
+  struct Cell {
+    float height;     // area weighted mean height
+    float minY;       // lowest vertex of the overlapping triangles
+    float maxY;       // highest vertex of the overlapping triangles
+    float slope;      // degrees, of the area weighted mean normal
+    float roughness;  // 0 (all normals agree) .. 1, spread of the normals
+    uint32_t triangles;
+
+    // Height difference the rover has to climb within the cell.
+    //
+    float step() const { return maxY - minY; }
+  };
+
+  // Thresholds above which a cell is not traversable.
+  //
+  struct Limits {
+    float maxSlope = 30;        // degrees
+    float maxRoughness = 0.08;  // spread of the normals
+    float maxStepPerCell = 1;   // step height, in cell sizes
+
+    bool operator==(const Limits &other) const {
+      return maxSlope == other.maxSlope && maxRoughness == other.maxRoughness &&
+             maxStepPerCell == other.maxStepPerCell;
+    }
+    bool operator!=(const Limits &other) const { return !(*this == other); }
+  };
+
+  TraversabilityMap();
+
+  // ----------- OPERATIONS ------------------
+
+  // Rasterizes the mesh into cells of the given size. With a size of 0
+  // the grid gets DEFAULT_RESOLUTION cells along the longer side.
+  //
+  void build(const ofMesh &mesh, float cellSize = 0);
+
+  // Loads the map from the cache file when it was made for this mesh,
+  // builds and saves it otherwise.
+  //
+  void loadOrBuild(const ofMesh &mesh, const string &cacheFile, float cellSize = 0);
+
+  // Binary cache. load() fails when the file was made for another mesh.
+  //
+  bool save(const string &fileName) const;
+  bool load(const string &fileName, uint64_t meshHash);
+
+  // Cell containing the point (x, z), NULL outside the grid.
+  //
+  const Cell *cellAt(float x, float z) const;
+  const Cell &cell(int col, int row) const { return cells[row * cols + col]; }
+
+  // Grid coordinates of (x, z); false outside the grid.
+  //
+  bool cellIndex(float x, float z, int &col, int &row) const;
+
+  // Center of a cell, at the cell's height.
+  //
+  ofVec3f cellCenter(int col, int row) const;
+
+  bool isTraversable(const Cell &c) const;
+  bool isTraversable(float x, float z) const;
+
+  // Adds the cell as a flat quad (two triangles), lift above its height.
+  //
+  void addCellQuad(ofMesh &mesh, int col, int row, float lift, const ofFloatColor &color) const;
+
+  // Draws the cells colour-mapped by slope, untraversable ones in red.
+  //
+  void draw();
+
+  bool isEmpty() const { return cells.empty(); }
+
+  // ----------- ATTRIBUTES -----------------
+
+  // Cells along the longer side when no cell size is given.
+  //
+  static const int DEFAULT_RESOLUTION = 128;
+
+  Limits limits;
+
+  float cellSize;
+  float originX, originZ;  // corner of cell (0, 0)
+  int cols, rows;          // cells along X and Z
+  uint64_t meshHash;
+
+  vector<Cell> cells;
+
+ private:
+  // Overlay geometry, rebuilt when the cells or limits change, and the
+  // limits it was built for.
+  //
+  ofVboMesh overlay;
+  bool bOverlayDirty;
+  Limits overlayLimits;
+
+  void buildOverlay();
+};
+
+#endif /* traversability_h */
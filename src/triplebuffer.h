@@ -0,0 +1,63 @@
+//
+//  triplebuffer.h
+//  martian-terrain
+//
+
+#ifndef triplebuffer_h
+#define triplebuffer_h
+
+#include <atomic>
+#include <cstdint>
+
+//---------------------------------------------------------------
+// TripleBuffer hands values from one writer thread to one reader thread
+// without locks, and without either ever waiting for the other.
+//
+// Of its three slots the writer owns one, the reader another, and the
+// third sits in the middle holding the latest value published. publish()
+// swaps the writer's slot with the middle one; acquire() swaps the middle
+// slot with the reader's when it holds something newer. Values the reader
+// never got to are overwritten, and the one it holds stays untouched until
+// it acquires again.
+//
+template <class T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : middle(1), writing(2), reading(0) {}
+
+  // ----------- OPERATIONS ------------------
+
+  // The slot to fill, the writer's own. It still holds whatever was
+  // published into it two or more times ago.
+  //
+  T &back() { return slots[writing]; }
+
+  // Makes the filled slot the latest value.
+  //
+  void publish() { writing = middle.exchange(writing | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+  // Takes the latest value, if there is a newer one than the reader holds,
+  // and returns the reader's slot.
+  //
+  const T &acquire() {
+    if (middle.load(std::memory_order_relaxed) & FRESH) {
+      reading = middle.exchange(reading, std::memory_order_acq_rel) & INDEX;
+    }
+    return slots[reading];
+  }
+
+  // The reader's slot, as of the last acquire().
+  //
+  const T &front() const { return slots[reading]; }
+
+ private:
+  static const uint8_t INDEX = 3;
+  static const uint8_t FRESH = 4;
+
+  T slots[3];
+  std::atomic<uint8_t> middle;  // slot index, FRESH when published and not yet acquired
+  uint8_t writing;
+  uint8_t reading;
+};
+
+#endif /* triplebuffer_h */
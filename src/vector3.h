@@ -2,30 +2,31 @@
 #define _VECTOR3_H_
 
 #include <math.h>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VECTOR3_SSE 1
+#endif
 
 // added by sidmishraw
 // #include <iostream>
 // using namespace std;
 
+// Plain 3 float vector. Trivially copyable (no user copy constructor) so
+// arrays of it can be memcpy'd and the compiler is free to keep it in
+// registers; the arithmetic is constexpr where C++11 allows it.
+//
 class Vector3 {
  public:
-  Vector3(){};
-  Vector3(float x, float y, float z) {
-    d[0] = x;
-    d[1] = y;
-    d[2] = z;
-  }
-  Vector3(const Vector3 &v) {
-    d[0] = v.d[0];
-    d[1] = v.d[1];
-    d[2] = v.d[2];
-  }
+  Vector3() = default;
+  constexpr Vector3(float x, float y, float z) : d{x, y, z} {}
 
-  float x() const { return d[0]; }
-  float y() const { return d[1]; }
-  float z() const { return d[2]; }
+  constexpr float x() const { return d[0]; }
+  constexpr float y() const { return d[1]; }
+  constexpr float z() const { return d[2]; }
 
-  float operator[](int i) const { return d[i]; }
+  constexpr float operator[](int i) const { return d[i]; }
 
   float length() const { return sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]); }
   void normalize() {
@@ -42,48 +43,141 @@ class Vector3 {
   // Overloaded operators
   /////////////////////////////////////////////////////////
 
-  Vector3 operator+(const Vector3 &op2) const {  // vector addition
+  constexpr Vector3 operator+(const Vector3 &op2) const {  // vector addition
     return Vector3(d[0] + op2.d[0], d[1] + op2.d[1], d[2] + op2.d[2]);
   }
-  Vector3 operator-(const Vector3 &op2) const {  // vector subtraction
+  constexpr Vector3 operator-(const Vector3 &op2) const {  // vector subtraction
     return Vector3(d[0] - op2.d[0], d[1] - op2.d[1], d[2] - op2.d[2]);
   }
-  Vector3 operator-() const {  // unary minus
+  constexpr Vector3 operator-() const {  // unary minus
     return Vector3(-d[0], -d[1], -d[2]);
   }
-  Vector3 operator*(float s) const {  // scalar multiplication
+  constexpr Vector3 operator*(float s) const {  // scalar multiplication
     return Vector3(d[0] * s, d[1] * s, d[2] * s);
   }
-  void operator*=(float s) {
-    d[0] *= s;
-    d[1] *= s;
-    d[2] *= s;
-  }
-  Vector3 operator/(float s) const {  // scalar division
+  constexpr Vector3 operator/(float s) const {  // scalar division
     return Vector3(d[0] / s, d[1] / s, d[2] / s);
   }
-  float operator*(const Vector3 &op2) const {  // dot product
+  constexpr float operator*(const Vector3 &op2) const {  // dot product
     return d[0] * op2.d[0] + d[1] * op2.d[1] + d[2] * op2.d[2];
   }
-  Vector3 operator^(const Vector3 &op2) const {  // cross product
+  constexpr Vector3 operator^(const Vector3 &op2) const {  // cross product
     return Vector3(d[1] * op2.d[2] - d[2] * op2.d[1], d[2] * op2.d[0] - d[0] * op2.d[2],
                    d[0] * op2.d[1] - d[1] * op2.d[0]);
   }
-  bool operator==(const Vector3 &op2) const { return (d[0] == op2.d[0] && d[1] == op2.d[1] && d[2] == op2.d[2]); }
-  bool operator!=(const Vector3 &op2) const { return (d[0] != op2.d[0] || d[1] != op2.d[1] || d[2] != op2.d[2]); }
 
-  bool operator<(const Vector3 &op2) const {
-    // added by sidmishraw
-    // cout << "d = " << d[0] << " " << d[1] << " " << d[2] << endl;
-    // cout << "op2 = " << op2.d[0] << " " << op2.d[1] << " " << op2.d[2] <<
-    // endl;
+  // In place versions -- no temporaries.
+  //
+  Vector3 &operator+=(const Vector3 &op2) {
+    d[0] += op2.d[0];
+    d[1] += op2.d[1];
+    d[2] += op2.d[2];
+    return *this;
+  }
+  Vector3 &operator-=(const Vector3 &op2) {
+    d[0] -= op2.d[0];
+    d[1] -= op2.d[1];
+    d[2] -= op2.d[2];
+    return *this;
+  }
+  Vector3 &operator*=(float s) {
+    d[0] *= s;
+    d[1] *= s;
+    d[2] *= s;
+    return *this;
+  }
+
+  constexpr bool operator==(const Vector3 &op2) const {
+    return (d[0] == op2.d[0] && d[1] == op2.d[1] && d[2] == op2.d[2]);
+  }
+  constexpr bool operator!=(const Vector3 &op2) const {
+    return (d[0] != op2.d[0] || d[1] != op2.d[1] || d[2] != op2.d[2]);
+  }
 
+  constexpr bool operator<(const Vector3 &op2) const {
     return (d[0] < op2.d[0] && d[1] < op2.d[1] && d[2] < op2.d[2]);
   }
-  bool operator<=(const Vector3 &op2) const { return (d[0] <= op2.d[0] && d[1] <= op2.d[1] && d[2] <= op2.d[2]); }
+  constexpr bool operator<=(const Vector3 &op2) const {
+    return (d[0] <= op2.d[0] && d[1] <= op2.d[1] && d[2] <= op2.d[2]);
+  }
+
+  // Pointer to the x, y, z floats -- layout compatible with ofVec3f.
+  //
+  const float *data() const { return d; }
+  float *data() { return d; }
 
  private:
   float d[3];
 };
 
+static_assert(std::is_trivially_copyable<Vector3>::value, "Vector3 must stay trivially copyable");
+static_assert(sizeof(Vector3) == 3 * sizeof(float), "Vector3 must stay 3 packed floats");
+
+// Component wise product.
+//
+constexpr Vector3 mul(const Vector3 &a, const Vector3 &b) { return Vector3(a.x() * b.x(), a.y() * b.y(), a.z() * b.z()); }
+
+// Minimizes the vectors passed in and returns the vector with the minimum
+// of all the x, y, z coordinates.
+// For eg: if we pass in (1, 1, 0) and (1, 0, 1)
+// the minimized vector would be (1, 0, 0).
+//
+constexpr Vector3 minimize(const Vector3 &a, const Vector3 &b) {
+  return Vector3(a.x() <= b.x() ? a.x() : b.x(), a.y() <= b.y() ? a.y() : b.y(), a.z() <= b.z() ? a.z() : b.z());
+}
+
+// Maximizes the vectors passed in and returns the vector with the maximum
+// of all the x, y, z coordinates.
+// For eg: if we pass in (1, 1, 0) and (1, 0, 1)
+// the maximized vector would be (1, 1, 1).
+//
+constexpr Vector3 maximize(const Vector3 &a, const Vector3 &b) {
+  return Vector3(a.x() >= b.x() ? a.x() : b.x(), a.y() >= b.y() ? a.y() : b.y(), a.z() >= b.z() ? a.z() : b.z());
+}
+
+// 16 byte aligned, 4 wide variant of Vector3 (w is padding, kept at 0) for
+// the SIMD kernels. Uses SSE when available and plain floats otherwise.
+//
+struct alignas(16) Vector3A {
+  float d[4];
+
+  Vector3A() = default;
+  constexpr Vector3A(float x, float y, float z) : d{x, y, z, 0} {}
+  constexpr explicit Vector3A(const Vector3 &v) : d{v.x(), v.y(), v.z(), 0} {}
+
+  constexpr float x() const { return d[0]; }
+  constexpr float y() const { return d[1]; }
+  constexpr float z() const { return d[2]; }
+  constexpr float operator[](int i) const { return d[i]; }
+
+  constexpr Vector3 toVector3() const { return Vector3(d[0], d[1], d[2]); }
+};
+
+static_assert(std::is_trivially_copyable<Vector3A>::value, "Vector3A must stay trivially copyable");
+
+#ifdef VECTOR3_SSE
+inline Vector3A fromSSE(__m128 v) {
+  Vector3A r;
+  _mm_store_ps(r.d, v);
+  return r;
+}
+inline __m128 toSSE(const Vector3A &v) { return _mm_load_ps(v.d); }
+
+inline Vector3A operator+(const Vector3A &a, const Vector3A &b) { return fromSSE(_mm_add_ps(toSSE(a), toSSE(b))); }
+inline Vector3A operator-(const Vector3A &a, const Vector3A &b) { return fromSSE(_mm_sub_ps(toSSE(a), toSSE(b))); }
+inline Vector3A mul(const Vector3A &a, const Vector3A &b) { return fromSSE(_mm_mul_ps(toSSE(a), toSSE(b))); }
+inline Vector3A minimize(const Vector3A &a, const Vector3A &b) { return fromSSE(_mm_min_ps(toSSE(a), toSSE(b))); }
+inline Vector3A maximize(const Vector3A &a, const Vector3A &b) { return fromSSE(_mm_max_ps(toSSE(a), toSSE(b))); }
+#else
+inline Vector3A operator+(const Vector3A &a, const Vector3A &b) { return Vector3A(a[0] + b[0], a[1] + b[1], a[2] + b[2]); }
+inline Vector3A operator-(const Vector3A &a, const Vector3A &b) { return Vector3A(a[0] - b[0], a[1] - b[1], a[2] - b[2]); }
+inline Vector3A mul(const Vector3A &a, const Vector3A &b) { return Vector3A(a[0] * b[0], a[1] * b[1], a[2] * b[2]); }
+inline Vector3A minimize(const Vector3A &a, const Vector3A &b) {
+  return Vector3A(a[0] < b[0] ? a[0] : b[0], a[1] < b[1] ? a[1] : b[1], a[2] < b[2] ? a[2] : b[2]);
+}
+inline Vector3A maximize(const Vector3A &a, const Vector3A &b) {
+  return Vector3A(a[0] > b[0] ? a[0] : b[0], a[1] > b[1] ? a[1] : b[1], a[2] > b[2] ? a[2] : b[2]);
+}
+#endif
+
 #endif  // _VECTOR3_H_
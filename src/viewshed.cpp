@@ -0,0 +1,181 @@
+//
+//  viewshed.cpp
+//  martian-terrain
+//
+
+#include "viewshed.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+// Directions are sorted by azimuth bucket first, then by elevation within
+// the bucket.
+//
+static const int AZIMUTH_BUCKETS = 4096;
+
+Viewshed::Viewshed(const TraversabilityMap &map, const BVH &bvh)
+    : map(map), bvh(bvh), bOverlayDirty(true), bShowCoverage(false) {
+  stats = {0, 0, 0};
+}
+
+size_t Viewshed::castPose(const Pose &pose, vector<uint8_t> &visible) {
+  ofVec3f heading(pose.heading.x, 0, pose.heading.z);
+  heading.normalize();
+  float cosHalfFov = pose.hfov >= 360 ? -2 : cos(ofDegToRad(pose.hfov / 2));
+  float range2 = pose.range > 0 ? pose.range * pose.range : INFINITY;
+
+  // Targets sit a little above the cell's mean height, so the cell's own
+  // triangles don't hide it.
+  //
+  float lift = map.cellSize * 0.25f;
+
+  order.clear();
+  for (int row = 0; row < map.rows; row++) {
+    for (int col = 0; col < map.cols; col++) {
+      if (map.cell(col, row).triangles == 0) continue;
+
+      ofVec3f d = map.cellCenter(col, row) - pose.eye;
+      d.y += lift;
+      float flat2 = d.x * d.x + d.z * d.z;
+      if (flat2 > range2 || flat2 == 0) continue;
+
+      float flat = sqrt(flat2);
+      if ((d.x * heading.x + d.z * heading.z) / flat < cosHalfFov) continue;
+
+      // Bucket by azimuth, then order by elevation angle (as a fraction
+      // of the bucket) so neighbours in the list have similar directions.
+      //
+      float azimuth = (atan2(d.z, d.x) + PI) / TWO_PI;
+      float elevation = (atan2(d.y, flat) / PI + 0.5f) * 0.999f;
+      int bucket = std::min(AZIMUTH_BUCKETS - 1, (int)(azimuth * AZIMUTH_BUCKETS));
+      order.push_back(make_pair(bucket + elevation, row * map.cols + col));
+    }
+  }
+  sort(order.begin(), order.end());
+
+  // The rays go to the thread pool BATCH at a time.
+  //
+  ThreadPool::parallelFor(order.size(), BATCH, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      int cell = order[i].second;
+      ofVec3f target = map.cellCenter(cell % map.cols, cell / map.cols);
+      target.y += lift;
+
+      ofVec3f d = target - pose.eye;
+      float dist = d.length();
+      d /= dist;
+
+      // Hits within a cell of the target belong to the target itself.
+      //
+      Ray ray(toVector3(pose.eye), toVector3(d));
+      visible[cell] = !bvh.occluded(ray, 1e-3f, dist - map.cellSize);
+    }
+  });
+
+  return order.size();
+}
+
+int Viewshed::compute(const Pose &pose) {
+  PROFILE_ZONE("viewshed");
+  auto start = chrono::steady_clock::now();
+
+  visible.assign(map.cells.size(), 0);
+  stats.rays = castPose(pose, visible);
+  stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  stats.raysPerSec = stats.ms > 0 ? stats.rays / (stats.ms / 1000) : 0;
+
+  bShowCoverage = false;
+  bOverlayDirty = true;
+
+  return (int)count(visible.begin(), visible.end(), 1);
+}
+
+void Viewshed::coverage(const vector<Pose> &poses) {
+  PROFILE_ZONE("viewshed coverage");
+  auto start = chrono::steady_clock::now();
+
+  counts.assign(map.cells.size(), 0);
+  vector<uint8_t> seen(map.cells.size());
+  stats.rays = 0;
+
+  for (auto &pose : poses) {
+    fill(seen.begin(), seen.end(), 0);
+    stats.rays += castPose(pose, seen);
+    for (size_t i = 0; i < seen.size(); i++) {
+      if (seen[i] && counts[i] < UINT16_MAX) counts[i]++;
+    }
+  }
+
+  stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  stats.raysPerSec = stats.ms > 0 ? stats.rays / (stats.ms / 1000) : 0;
+
+  bShowCoverage = true;
+  bOverlayDirty = true;
+}
+
+vector<Viewshed::Pose> Viewshed::posesAlongPath(const ofPolyline &path, float spacing, float eyeHeight, float hfov,
+                                                bool rear) {
+  vector<Pose> poses;
+  float length = path.getPerimeter();
+  if (length <= 0 || spacing <= 0) return poses;
+
+  for (float s = 0; s <= length; s += spacing) {
+    ofVec3f p = path.getPointAtLength(s);
+    ofVec3f ahead = path.getPointAtLength(std::min(length, s + spacing / 2));
+    ofVec3f behind = path.getPointAtLength(std::max(0.0f, s - spacing / 2));
+
+    Pose pose;
+    pose.eye = p + ofVec3f(0, eyeHeight, 0);
+    pose.heading = rear ? behind - ahead : ahead - behind;
+    pose.hfov = hfov;
+    pose.range = 0;
+    poses.push_back(pose);
+  }
+  return poses;
+}
+
+void Viewshed::buildOverlay() {
+  overlay.clear();
+  overlay.setMode(OF_PRIMITIVE_TRIANGLES);
+
+  uint16_t most = 1;
+  if (bShowCoverage) {
+    for (auto c : counts) most = std::max(most, c);
+  }
+
+  float lift = map.cellSize * 0.06f;
+  for (int row = 0; row < map.rows; row++) {
+    for (int col = 0; col < map.cols; col++) {
+      int i = row * map.cols + col;
+      float value = bShowCoverage ? (float)counts[i] / most : visible[i];
+      if (value <= 0) continue;
+
+      // cyan for visible cells, dark to bright blue for coverage
+      //
+      ofFloatColor color = bShowCoverage ? ofFloatColor(0.2f * value, 0.3f + 0.5f * value, 1, 0.5f)
+                                         : ofFloatColor(0, 1, 1, 0.45f);
+
+      map.addCellQuad(overlay, col, row, lift, color);
+    }
+  }
+
+  bOverlayDirty = false;
+}
+
+void Viewshed::draw() {
+  if ((bShowCoverage ? counts.size() : visible.size()) != map.cells.size()) return;
+  if (bOverlayDirty) buildOverlay();
+
+  ofPushStyle();
+  ofDisableLighting();
+  ofEnableAlphaBlending();
+  overlay.draw();
+  ofPopStyle();
+}
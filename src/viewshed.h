@@ -0,0 +1,108 @@
+//
+//  viewshed.h
+//  martian-terrain
+//
+
+#ifndef viewshed_h
+#define viewshed_h
+
+#include <cstdint>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "bvh.h"
+#include "traversability.h"
+
+//---------------------------------------------------------------
+// Viewshed finds the terrain cells visible from a camera pose. Every cell
+// of a TraversabilityMap within the camera's horizontal field of view and
+// range gets a shadow ray cast from the eye to it through the BVH.
+//
+// The rays are sorted by direction before they are handed out in batches
+// to the thread pool, so the rays of a batch walk the same BVH nodes. A
+// sweep over many poses (e.g. along the rover's path) adds the results up
+// into a coverage map: how many poses see each cell.
+//
+// The octree is not used: it only indexes vertices, and its search writes
+// into the tree, so it can't be shared between threads.
+//
+using namespace std;
+using namespace sidmishraw_octtree;
+class Viewshed {
+ public:
+  // A camera pose. hfov is the horizontal field of view in degrees,
+  // 360 for all around; a range of 0 means unlimited.
+  //
+  struct Pose {
+    ofVec3f eye;
+    ofVec3f heading;
+    float hfov;
+    float range;
+  };
+
+  // Throughput of the last compute() / coverage() call.
+  //
+  struct Stats {
+    size_t rays;
+    double ms;
+    double raysPerSec;
+  };
+
+  // Rays per batch handed to a pool thread.
+  //
+  static const int BATCH = 64;
+
+  Viewshed(const TraversabilityMap &map, const BVH &bvh);
+
+  // ----------- OPERATIONS ------------------
+
+  // Marks the cells visible from the pose in visible and returns how many
+  // there are.
+  //
+  int compute(const Pose &pose);
+
+  // Counts for every cell the poses that see it, into counts.
+  //
+  void coverage(const vector<Pose> &poses);
+
+  // Poses every spacing units along the path, eyeHeight above it, looking
+  // along the path (or back along it when rear is set).
+  //
+  static vector<Pose> posesAlongPath(const ofPolyline &path, float spacing, float eyeHeight, float hfov, bool rear);
+
+  // Overlays the result of the last compute() or coverage() call on the
+  // terrain.
+  //
+  void draw();
+
+  // ----------- ATTRIBUTES -----------------
+
+  Stats stats;
+
+  // One entry per cell of the map: visible from the last compute() pose,
+  // and the number of poses that see it in the last coverage() sweep.
+  //
+  vector<uint8_t> visible;
+  vector<uint16_t> counts;
+
+ private:
+  // Casts the rays for one pose, marks the visible cells.
+  //
+  size_t castPose(const Pose &pose, vector<uint8_t> &visible);
+
+  const TraversabilityMap &map;
+  const BVH &bvh;
+
+  // Cells sorted by direction for the current pose, reused between poses.
+  //
+  vector<pair<float, int>> order;
+
+  ofVboMesh overlay;
+  bool bOverlayDirty;
+  bool bShowCoverage;
+
+  void buildOverlay();
+};
+
+#endif /* viewshed_h */